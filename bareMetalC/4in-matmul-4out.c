@@ -16,49 +16,12 @@
 #include "include/gemmini.h"
 
 
-elem_t extract_4bit_signed(elem_t num, elem_t high) {
-    elem_t mask = 0b1111;
-    if (high) {
-        num = num >> 4;
-    }
-    num = num & mask;
-    elem_t extend = (num >> 3) & 1;
-    if (extend) {
-        return num | 0xf0;
-    } else {
-        return num;
-    }
-}
-
-void compress_matrix(elem_t src[DIM][DIM], elem_t dst[DIM][DIM/2]) {
-  for (size_t i = 0; i < DIM; ++i) {
-    for (size_t j = 0; j < DIM/2; ++j) {
-        elem_t low = src[i][2 * j];
-        if (low < -8) {
-            low = -8;
-        } else if (low > 7) {
-            low = 7;
-        }
-        low = low & 0X0F;
-        elem_t high = src[i][(2 * j) + 1];
-        if (high < -8) {
-            high = -8;
-        } else if (high > 7) {
-            high = 7;
-        }
-        high = high & 0X0F;
-        elem_t result = ((high << 4) & 0xF0) | low;
-        dst[i][j] = result;
-    }
-  }
-}
-
 void software_matmul_halfdim(elem_t A[DIM][DIM/2], elem_t B[DIM][DIM/2], elem_t C[DIM][DIM]) {
   for (size_t j = 0; j < DIM; ++j) {
     for (size_t k = 0; k < DIM; ++k) {
       for (size_t i = 0; i < DIM; ++i) {
-         elem_t a = extract_4bit_signed(A[i][k /2], k % 2);
-         elem_t b = extract_4bit_signed(B[k][j /2], j % 2);
+         elem_t a = packed_get(A[i], k, 4);
+         elem_t b = packed_get(B[k], j, 4);
          C[i][j] += a * b;
       }
     }  
@@ -140,7 +103,7 @@ int main() {
   memset(Out_Software, 0, DIM * DIM / 2 * sizeof(elem_t));
   // Do a software version of the same results
   software_matmul_halfdim(In_1, In_2, Temp_Software);
-  compress_matrix(Temp_Software, Out_Software);
+  pack_matrix(DIM, DIM, &Temp_Software[0][0], DIM, Out_Software, DIM/2, 4);
 
   printf("Check whether \"Gemmini\" and \"Software\" matrices are identical\n");
   if (!is_equal_4bit(Out_Software, Out)) {
@@ -0,0 +1,99 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+
+#ifndef BAREMETAL
+#define BATCH_SIZE 2
+#define IN_DIM 15
+#define CHANNELS 40
+#else
+#define BATCH_SIZE 1
+#define IN_DIM 6
+#define CHANNELS 20
+#endif
+
+#define KERNEL_SIZE 3
+#define IN_I (BATCH_SIZE * IN_DIM * IN_DIM)
+#define MAX_I IN_I
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  static elem_t input[IN_I][CHANNELS] row_align(1);
+  static elem_t weights[CHANNELS][KERNEL_SIZE][KERNEL_SIZE];
+  static acc_t bias[CHANNELS] row_align_acc(1);
+  static elem_t output[MAX_I][CHANNELS] row_align(1);
+  static elem_t gold[MAX_I][CHANNELS];
+
+  for (size_t i = 0; i < IN_I; i++)
+    for (size_t c = 0; c < CHANNELS; c++)
+      input[i][c] = (rand() % 17) - 8;
+
+  for (size_t c = 0; c < CHANNELS; c++)
+    for (size_t r = 0; r < KERNEL_SIZE; r++)
+      for (size_t s = 0; s < KERNEL_SIZE; s++)
+        weights[c][r][s] = (rand() % 9) - 4;
+
+  for (size_t c = 0; c < CHANNELS; c++)
+    bias[c] = (rand() % 201) - 100;
+
+  // Test both a "same" and a strided convolution, with and without a bias
+  for (int test = 0; test < 4; test++) {
+    struct ConvParams params;
+    memset(&params, 0, sizeof(params));
+    params.batch_size = BATCH_SIZE;
+    params.in_dim = IN_DIM;
+    params.kernel_size = KERNEL_SIZE;
+    params.in_channels = CHANNELS;
+    params.out_channels = CHANNELS;
+    params.depthwise = true;
+    params.stride = test % 2 + 1;
+    params.padding = 1;
+    params.bias = test < 2;
+    params.output_scale = 2;
+    params.out_dim = (IN_DIM + 2*params.padding - KERNEL_SIZE) / params.stride + 1;
+    params.n_patches = BATCH_SIZE * params.out_dim * params.out_dim;
+    params.I = params.n_patches;
+    params.J = CHANNELS;
+
+    const size_t I = params.I;
+
+    conv_dw_with_col2im(IN_I, CHANNELS, I, CHANNELS,
+        BATCH_SIZE, CHANNELS, params.out_dim, KERNEL_SIZE,
+        input, weights, bias, gold, &params);
+
+    printf("Starting depthwise conv (stride %d, bias %d)\n",
+        params.stride, params.bias);
+    tiled_conv_dw_with_col2im(IN_I, CHANNELS, I, CHANNELS,
+        BATCH_SIZE, CHANNELS, params.out_dim, KERNEL_SIZE,
+        input, weights, bias, output, &params,
+        WS);
+
+    for (size_t i = 0; i < I; i++)
+      for (size_t c = 0; c < CHANNELS; c++)
+        if (output[i][c] != gold[i][c]) {
+          printf("Mismatch at pixel %zu, channel %zu: %d (expected %d)\n",
+              i, c, output[i][c], gold[i][c]);
+          exit(1);
+        }
+  }
+
+  exit(0);
+}
@@ -0,0 +1,101 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+
+// These cross matmul_cpu's block sizes, and leave partial blocks at the edges
+#ifndef BAREMETAL
+#define MAT_DIM_I 67
+#define MAT_DIM_K 300
+#define MAT_DIM_J 131
+#else
+#define MAT_DIM_I 19
+#define MAT_DIM_K 40
+#define MAT_DIM_J 70
+#endif
+
+// The straightforward definition of matmul_cpu, which it must match exactly
+void naive_matmul(elem_t A[MAT_DIM_I][MAT_DIM_K], elem_t B[MAT_DIM_K][MAT_DIM_J],
+    const acc_t * D, elem_t C[MAT_DIM_I][MAT_DIM_J],
+    int act, size_t shift, size_t relu6_shift, bool repeating_bias) {
+  for (size_t i = 0; i < MAT_DIM_I; i++)
+    for (size_t j = 0; j < MAT_DIM_J; j++) {
+      acc_t result = D == NULL ? 0 : D[(repeating_bias ? 0 : i) * MAT_DIM_J + j];
+
+      for (size_t k = 0; k < MAT_DIM_K; k++)
+        result += A[i][k] * B[k][j];
+
+      result = ROUNDING_RIGHT_SHIFT(result, shift);
+      result = result > elem_t_max ? elem_t_max : (result < elem_t_min ? elem_t_min : result);
+
+      if (act == RELU) {
+        result = result < 0 ? 0 : result;
+      } else if (act == RELU6) {
+        int max = 6 << relu6_shift;
+        result = result < 0 ? 0 : (result > max ? max : result);
+      }
+
+      C[i][j] = result;
+    }
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  static elem_t full_A[MAT_DIM_I][MAT_DIM_K];
+  static elem_t full_B[MAT_DIM_K][MAT_DIM_J];
+  static elem_t full_C[MAT_DIM_I][MAT_DIM_J];
+  static acc_t full_D[MAT_DIM_I][MAT_DIM_J];
+  static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t k = 0; k < MAT_DIM_K; ++k)
+      full_A[i][k] = (rand() % 256) - 128;
+
+  for (size_t k = 0; k < MAT_DIM_K; ++k)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      full_B[k][j] = (rand() % 256) - 128;
+
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      full_D[i][j] = (rand() % 20001) - 10000;
+
+  const int acts[] = {NO_ACTIVATION, RELU, RELU6};
+
+  for (int test = 0; test < 9; test++) {
+    // bias == 0: no bias, bias == 1: repeating bias, bias == 2: full bias
+    const int bias = test % 3;
+    const int act = acts[test / 3];
+    const acc_t * D = bias == 0 ? NULL : &full_D[0][0];
+    const size_t shift = 11 + test % 4;
+
+    naive_matmul(full_A, full_B, D, gold, act, shift, 4, bias == 1);
+
+    printf("Starting CPU matmul (bias mode %d, activation %d)\n", bias, act);
+    matmul_cpu(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+        full_A, full_B, D, full_C,
+        act, shift, 4, bias == 1);
+
+    for (size_t i = 0; i < MAT_DIM_I; i++)
+      for (size_t j = 0; j < MAT_DIM_J; j++)
+        if (full_C[i][j] != gold[i][j]) {
+          printf("Mismatch at (%zu, %zu): %d (expected %d)\n",
+              i, j, full_C[i][j], gold[i][j]);
+          exit(1);
+        }
+  }
+
+  exit(0);
+}
@@ -0,0 +1,245 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+#include "include/gemmini_net.h"
+#include "include/gemmini_model.h"
+
+// Writes a small network's weights and parameters to a model, and runs it
+// with them straight out of the model, once from memory, as a bare-metal
+// binary would with MODEL_INCBIN, and on Linux once more from a mapped file.
+// Both must match the network run on the original arrays.
+//
+// conv_1 (3x3) -> conv_dw_2 -> average -> fc_3
+
+#ifndef BAREMETAL
+#define BATCH_SIZE 2
+#define IN_DIM 12
+#define CHANNELS 32
+#else
+#define BATCH_SIZE 1
+#define IN_DIM 6
+#define CHANNELS 16
+#endif
+
+#define IN_CHANNELS 3
+#define CLASSES 10
+#define CONV_I (BATCH_SIZE * IN_DIM * IN_DIM)
+
+static elem_t images[BATCH_SIZE][IN_DIM][IN_DIM][IN_CHANNELS];
+
+static elem_t conv_1_w[IN_CHANNELS * 9][CHANNELS] row_align(1);
+static elem_t conv_dw_2_w[CHANNELS][3][3];
+static elem_t fc_3_w[CLASSES][CHANNELS] row_align(1);
+static acc_t conv_1_b[CHANNELS] row_align_acc(1);
+static acc_t conv_dw_2_b[CHANNELS] row_align_acc(1);
+static acc_t fc_3_b[CLASSES][BATCH_SIZE] row_align_acc(1);
+
+static elem_t conv_1_in[CONV_I][IN_CHANNELS * 9] row_align(1);
+static elem_t conv_1_out[CONV_I][CHANNELS] row_align(1);
+static elem_t conv_dw_2_out[CONV_I][CHANNELS] row_align(1);
+static elem_t average[CHANNELS][BATCH_SIZE] row_align(1);
+static elem_t fc_3_out[CLASSES][BATCH_SIZE] row_align(1);
+static elem_t gold[CLASSES][BATCH_SIZE];
+
+static uint8_t blob[64 * 1024] __attribute__((aligned(MODEL_ALIGN)));
+
+static struct net_t net;
+static struct model_t model;
+
+static struct ConvParams conv_params(int in_channels, bool depthwise) {
+  struct ConvParams p;
+  memset(&p, 0, sizeof(p));
+  p.batch_size = BATCH_SIZE;
+  p.in_dim = IN_DIM;
+  p.out_dim = IN_DIM;
+  p.kernel_size = 3;
+  p.in_channels = in_channels;
+  p.out_channels = CHANNELS;
+  p.stride = 1;
+  p.padding = 1;
+  p.bias = true;
+  p.depthwise = depthwise;
+  p.output_scale = 5;
+  p.out_dim_pooled = IN_DIM;
+  p.n_patches = CONV_I;
+  p.patch_size = in_channels * 9;
+  p.I = CONV_I;
+  p.J = CHANNELS;
+  p.K = p.patch_size;
+  return p;
+}
+
+static void fill(elem_t * x, size_t n, int range) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = (rand() % (2*range + 1)) - range;
+}
+
+static void fill_acc(acc_t * x, size_t n, int range) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = (rand() % (2*range + 1)) - range;
+}
+
+#define SAME_FIELD(field) same = same && a->field == b->field;
+
+static bool same_conv_params(const struct ConvParams * a, const struct ConvParams * b) {
+  bool same = true;
+  MODEL_CONV_PARAMS_FIELDS(SAME_FIELD)
+  return same;
+}
+
+static bool same_fc_params(const struct FcParams * a, const struct FcParams * b) {
+  bool same = true;
+  MODEL_FC_PARAMS_FIELDS(SAME_FIELD)
+  return same;
+}
+
+static bool in_model(const void * p) {
+  return (const uint8_t *)p >= model.data && (const uint8_t *)p < model.data + model.size;
+}
+
+// Runs the network with the model's weights and parameters, and checks that
+// they weren't copied out of it
+static void run_model(const char * from) {
+  net_init(&net);
+
+  const struct ConvParams * p = model_conv_params(&model, "conv_1_params");
+  const int in = net_tensor(&net, CONV_I, IN_CHANNELS,
+      (elem_t *) model_elems(&model, "images", CONV_I, IN_CHANNELS, ELEM_T_BITS));
+  const int conv_1 = net_tensor(&net, p->I, p->J, &conv_1_out[0][0]);
+  const int conv_dw_2 = net_tensor(&net, p->I, p->J, &conv_dw_2_out[0][0]);
+  const int avg = net_tensor(&net, CHANNELS, BATCH_SIZE, &average[0][0]);
+  const int fc_3 = net_tensor(&net, CLASSES, BATCH_SIZE, &fc_3_out[0][0]);
+
+  model_net_conv(&net, &model, "conv_1", in, conv_1, RELU, &conv_1_in[0][0]);
+  model_net_conv_dw(&net, &model, "conv_dw_2", conv_1, conv_dw_2);
+  net_avgpool(&net, "average", conv_dw_2, avg, model_conv_params(&model, "conv_dw_2_params"));
+  model_net_fc(&net, &model, "fc_3", avg, fc_3, NO_ACTIVATION);
+
+  for (int l = 0; l < net.n_layers; l++) {
+    const struct net_layer_t * layer = &net.layers[l];
+
+    if ((layer->weights != NULL && !in_model(layer->weights)) ||
+        (layer->bias != NULL && !in_model(layer->bias))) {
+      printf("%s: %s's weights were copied out of the model\n", from, layer->name);
+      exit(1);
+    }
+  }
+
+  memset(fc_3_out, 0, sizeof(fc_3_out));
+  net_run(&net, WS, false);
+
+  for (size_t i = 0; i < CLASSES; i++)
+    for (size_t b = 0; b < BATCH_SIZE; b++)
+      if (fc_3_out[i][b] != gold[i][b]) {
+        printf("%s: mismatch at (%zu, %zu): %d (expected %d)\n",
+            from, i, b, fc_3_out[i][b], gold[i][b]);
+        exit(1);
+      }
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  fill(&images[0][0][0][0], sizeof(images), 30);
+  fill(&conv_1_w[0][0], sizeof(conv_1_w), 4);
+  fill(&conv_dw_2_w[0][0][0], sizeof(conv_dw_2_w), 4);
+  fill(&fc_3_w[0][0], sizeof(fc_3_w), 4);
+  fill_acc(conv_1_b, CHANNELS, 100);
+  fill_acc(conv_dw_2_b, CHANNELS, 100);
+  fill_acc(&fc_3_b[0][0], CLASSES * BATCH_SIZE, 100);
+
+  const struct ConvParams conv_1_params = conv_params(IN_CHANNELS, false);
+  const struct ConvParams conv_dw_2_params = conv_params(CHANNELS, true);
+  const struct FcParams fc_3_params = {BATCH_SIZE, CHANNELS, CLASSES, 4, true,
+    CLASSES, BATCH_SIZE, CHANNELS};
+
+  // The expected results, from the original arrays
+  net_init(&net);
+
+  const int in = net_tensor(&net, CONV_I, IN_CHANNELS, &images[0][0][0][0]);
+  const int conv_1 = net_tensor(&net, CONV_I, CHANNELS, &conv_1_out[0][0]);
+  const int conv_dw_2 = net_tensor(&net, CONV_I, CHANNELS, &conv_dw_2_out[0][0]);
+  const int avg = net_tensor(&net, CHANNELS, BATCH_SIZE, &average[0][0]);
+  const int fc_3 = net_tensor(&net, CLASSES, BATCH_SIZE, &gold[0][0]);
+
+  net_conv(&net, "conv_1", in, conv_1, &conv_1_w[0][0], conv_1_b, RELU,
+      &conv_1_params, &conv_1_in[0][0]);
+  net_conv_dw(&net, "conv_dw_2", conv_1, conv_dw_2, &conv_dw_2_w[0][0][0], conv_dw_2_b,
+      &conv_dw_2_params);
+  net_avgpool(&net, "average", conv_dw_2, avg, &conv_dw_2_params);
+  net_fc(&net, "fc_3", avg, fc_3, &fc_3_w[0][0], &fc_3_b[0][0], NO_ACTIVATION,
+      &fc_3_params);
+
+  net_run(&net, WS, false);
+
+  // The model, with its entries named and shaped like a generated header's
+  // arrays. The depthwise weights keep all three of their dimensions.
+  static struct model_writer_t w;
+  model_writer_init(&w, blob, sizeof(blob), 16);
+
+  const size_t images_dims[] = {BATCH_SIZE, IN_DIM, IN_DIM, IN_CHANNELS};
+  const size_t conv_dw_2_w_dims[] = {CHANNELS, 3, 3};
+  const size_t bias_dims[] = {CHANNELS};
+
+  model_write_entry(&w, "images", MODEL_ELEM, ELEM_T_BITS, 4, images_dims, images);
+  model_write_conv_params(&w, "conv_1_params", &conv_1_params);
+  model_write_elems(&w, "conv_1_w", IN_CHANNELS * 9, CHANNELS, conv_1_w, ELEM_T_BITS);
+  model_write_entry(&w, "conv_1_b", MODEL_ACC, 32, 1, bias_dims, conv_1_b);
+  model_write_conv_params(&w, "conv_dw_2_params", &conv_dw_2_params);
+  model_write_entry(&w, "conv_dw_2_w", MODEL_ELEM, ELEM_T_BITS, 3, conv_dw_2_w_dims, conv_dw_2_w);
+  model_write_entry(&w, "conv_dw_2_b", MODEL_ACC, 32, 1, bias_dims, conv_dw_2_b);
+  model_write_fc_params(&w, "fc_3_params", &fc_3_params);
+  model_write_elems(&w, "fc_3_w", CLASSES, CHANNELS, fc_3_w, ELEM_T_BITS);
+  model_write_accs(&w, "fc_3_b", CLASSES, BATCH_SIZE, &fc_3_b[0][0]);
+
+  const size_t size = model_writer_finish(&w);
+  printf("Model is %zu bytes\n", size);
+
+  model_open(&model, blob, size);
+
+  if (!same_conv_params(model_conv_params(&model, "conv_1_params"), &conv_1_params) ||
+      !same_conv_params(model_conv_params(&model, "conv_dw_2_params"), &conv_dw_2_params) ||
+      !same_fc_params(model_fc_params(&model, "fc_3_params"), &fc_3_params)) {
+    printf("Parameters changed in the model\n");
+    exit(1);
+  }
+
+  run_model("memory");
+
+#ifndef BAREMETAL
+  char path[] = "/tmp/gemmini_model_XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp failed");
+    exit(1);
+  }
+  close(fd);
+
+  model_save(path, blob, size);
+  model_load(&model, path, false);
+  unlink(path);
+
+  run_model("file");
+  model_close(&model);
+#endif
+
+  printf("Network matches when run from the model\n");
+  exit(0);
+}
@@ -14,29 +14,6 @@
 #error not enough scratchpad space
 #endif
 
-void compress_matrix(elem_t src[DIM][DIM], elem_t dst[DIM][DIM/2]) {
-  for (size_t i = 0; i < DIM; ++i) {
-    for (size_t j = 0; j < DIM/2; ++j) {
-        elem_t low = src[i][2 * j];
-        if (low < -8) {
-            low = -8;
-        } else if (low > 7) {
-            low = 7;
-        }
-        low = low & 0X0F;
-        elem_t high = src[i][(2 * j) + 1];
-        if (high < -8) {
-            high = -8;
-        } else if (high > 7) {
-            high = 7;
-        }
-        high = high & 0X0F;
-        elem_t result = ((high << 4) & 0xF0) | low;
-        dst[i][j] = result;
-    }
-  }
-}
-
 int main() {
 #ifndef BAREMETAL
     if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
@@ -78,7 +55,7 @@ int main() {
   printf("Fence\n");
   gemmini_fence();
 
-  compress_matrix(In, In_compressed);
+  pack_matrix(DIM, DIM, &In[0][0], DIM, In_compressed, DIM/2, 4);
   int exitcode = 0;
   if (!is_equal_4bit(In_compressed, Out[0])) {
     printf("Input and Output Matrix do not match\n");
@@ -14,28 +14,6 @@
 #error not enough scratchpad space
 #endif
 
-elem_t extract_4bit_signed(elem_t num, elem_t high) {
-    elem_t mask = 0b1111;
-    if (high) {
-        num = num >> 4;
-    }
-    num = num & mask;
-    elem_t extend = (num >> 3) & 1;
-    if (extend) {
-        return num | 0xf0;
-    } else {
-        return num;
-    }
-}
-
-void decompress_matrix(elem_t src[DIM][DIM/2], elem_t dst[DIM][DIM]) {
-  for (size_t i = 0; i < DIM; ++i) {
-    for (size_t j = 0; j < DIM; ++j) {
-        dst[i][j] = extract_4bit_signed(src[i][j/2], j % 2);
-    }
-  }
-}
-
 int main() {
 #ifndef BAREMETAL
     if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
@@ -77,7 +55,7 @@ int main() {
   printf("Fence\n");
   gemmini_fence();
 
-  decompress_matrix(In, In_decompressed);
+  unpack_matrix(DIM, DIM, In, DIM/2, &In_decompressed[0][0], DIM, 4);
   int exitcode = 0;
   if (!is_equal(In_decompressed, Out[0])) {
     printf("Input and Output Matrix do not match\n");
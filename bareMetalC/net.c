@@ -0,0 +1,311 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+#include "include/gemmini_net.h"
+
+// A small residual network, run once by hand on the CPU, and once through
+// the network runtime. The runtime then streams several batches of images
+// through it as a pipeline, which must match running them one at a time.
+//
+// conv_1 (3x3) -> pool -> conv_2 (1x1) -> conv_3 (3x3) -> + pool -> conv_dw_4
+//   -> average -> fc_5
+
+#ifndef BAREMETAL
+#define BATCH_SIZE 2
+#define IN_DIM 16
+#define CHANNELS 32
+#else
+#define BATCH_SIZE 1
+#define IN_DIM 6
+#define CHANNELS 16
+#endif
+
+#define IN_CHANNELS 3
+#define POOL_DIM ((IN_DIM + 2 - 3) / 2 + 1)
+#define CLASSES 10
+
+#define CONV_I (BATCH_SIZE * IN_DIM * IN_DIM)
+#define POOL_I (BATCH_SIZE * POOL_DIM * POOL_DIM)
+
+#define PIPELINE_ITEMS 4
+#define PIPELINE_STAGES 3
+#define PIPELINE_DEPTH 2
+
+static elem_t images[BATCH_SIZE][IN_DIM][IN_DIM][IN_CHANNELS];
+
+static elem_t conv_1_w[IN_CHANNELS * 9][CHANNELS] row_align(1);
+static elem_t conv_2_w[CHANNELS][CHANNELS] row_align(1);
+static elem_t conv_3_w[CHANNELS * 9][CHANNELS] row_align(1);
+static elem_t conv_dw_4_w[CHANNELS][3][3];
+static elem_t fc_5_w[CLASSES][CHANNELS] row_align(1);
+static acc_t conv_1_b[CHANNELS] row_align_acc(1);
+static acc_t conv_2_b[CHANNELS] row_align_acc(1);
+static acc_t conv_3_b[CHANNELS] row_align_acc(1);
+static acc_t conv_dw_4_b[CHANNELS] row_align_acc(1);
+static acc_t fc_5_b[CLASSES][BATCH_SIZE] row_align_acc(1);
+
+static elem_t conv_1_in[CONV_I][IN_CHANNELS * 9] row_align(1);
+static elem_t conv_1_out[CONV_I][CHANNELS] row_align(1);
+static elem_t conv_1_out_pooled[POOL_I][CHANNELS] row_align(1);
+static elem_t conv_2_out[POOL_I][CHANNELS] row_align(1);
+static elem_t conv_3_in[POOL_I][CHANNELS * 9] row_align(1);
+static elem_t conv_3_out[POOL_I][CHANNELS] row_align(1);
+static elem_t conv_dw_4_out[POOL_I][CHANNELS] row_align(1);
+static elem_t average[CHANNELS][BATCH_SIZE] row_align(1);
+static elem_t fc_5_out[CLASSES][BATCH_SIZE] row_align(1);
+
+static elem_t gold_patches[CONV_I][CHANNELS * 9];
+static elem_t gold_conv[CONV_I][CHANNELS];
+static elem_t gold_pooled[POOL_I][CHANNELS];
+static elem_t gold_conv_2[POOL_I][CHANNELS];
+static elem_t gold_conv_3[POOL_I][CHANNELS];
+static elem_t gold_conv_dw_4[POOL_I][CHANNELS];
+static elem_t gold_average[CHANNELS][BATCH_SIZE];
+static elem_t gold_fc_5[CLASSES][BATCH_SIZE];
+
+static elem_t item_images[PIPELINE_ITEMS][BATCH_SIZE][IN_DIM][IN_DIM][IN_CHANNELS];
+static elem_t item_fc_5[PIPELINE_ITEMS][CLASSES][BATCH_SIZE] row_align(1);
+static elem_t item_gold[PIPELINE_ITEMS][CLASSES][BATCH_SIZE];
+static elem_t pipeline_arena[NET_PIPELINE_COPIES(PIPELINE_STAGES, PIPELINE_DEPTH)]
+  [sizeof(conv_1_in) + sizeof(conv_1_out) + sizeof(conv_3_in) + 4 * sizeof(conv_3_out) +
+   sizeof(average)] row_align(1);
+
+static struct ConvParams conv_params(int in_dim, int in_channels, int kernel_size,
+    int stride, int padding) {
+  struct ConvParams p;
+  memset(&p, 0, sizeof(p));
+  p.batch_size = BATCH_SIZE;
+  p.in_dim = in_dim;
+  p.kernel_size = kernel_size;
+  p.in_channels = in_channels;
+  p.out_channels = CHANNELS;
+  p.stride = stride;
+  p.padding = padding;
+  p.bias = true;
+  p.output_scale = 5;
+  p.out_dim = (in_dim + 2*padding - kernel_size) / stride + 1;
+  p.out_dim_pooled = p.out_dim;
+  p.n_patches = BATCH_SIZE * p.out_dim * p.out_dim;
+  p.patch_size = in_channels * kernel_size * kernel_size;
+  p.I = p.n_patches;
+  p.J = CHANNELS;
+  p.K = p.patch_size;
+  return p;
+}
+
+static void fill(elem_t * x, size_t n, int range) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = (rand() % (2*range + 1)) - range;
+}
+
+static void fill_acc(acc_t * x, size_t n, int range) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = (rand() % (2*range + 1)) - range;
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  fill(&images[0][0][0][0], sizeof(images), 30);
+  fill(&conv_1_w[0][0], sizeof(conv_1_w), 4);
+  fill(&conv_2_w[0][0], sizeof(conv_2_w), 4);
+  fill(&conv_3_w[0][0], sizeof(conv_3_w), 4);
+  fill(&conv_dw_4_w[0][0][0], sizeof(conv_dw_4_w), 4);
+  fill(&fc_5_w[0][0], sizeof(fc_5_w), 4);
+  fill_acc(conv_1_b, CHANNELS, 100);
+  fill_acc(conv_2_b, CHANNELS, 100);
+  fill_acc(conv_3_b, CHANNELS, 100);
+  fill_acc(conv_dw_4_b, CHANNELS, 100);
+  fill_acc(&fc_5_b[0][0], CLASSES * BATCH_SIZE, 100);
+
+  struct ConvParams conv_1_params = conv_params(IN_DIM, IN_CHANNELS, 3, 1, 1);
+  conv_1_params.pool_size = 3;
+  conv_1_params.pool_stride = 2;
+  conv_1_params.pool_padding = 1;
+  conv_1_params.out_dim_pooled = POOL_DIM;
+
+  struct ConvParams conv_2_params = conv_params(POOL_DIM, CHANNELS, 1, 1, 0);
+  struct ConvParams conv_3_params = conv_params(POOL_DIM, CHANNELS, 3, 1, 1);
+  conv_3_params.res_scale = 1;
+
+  struct ConvParams conv_dw_4_params = conv_params(POOL_DIM, CHANNELS, 3, 1, 1);
+  conv_dw_4_params.depthwise = true;
+
+  struct FcParams fc_5_params = {BATCH_SIZE, CHANNELS, CLASSES, 4, true,
+    CLASSES, BATCH_SIZE, CHANNELS};
+
+  // The expected results, with the layers called by hand
+  im2col(BATCH_SIZE, IN_CHANNELS, IN_DIM, CONV_I, IN_CHANNELS * 9,
+      images, gold_patches, &conv_1_params);
+  matmul_cpu(CONV_I, CHANNELS, IN_CHANNELS * 9,
+      (elem_t (*)[IN_CHANNELS * 9]) gold_patches, conv_1_w, conv_1_b, gold_conv,
+      RELU, conv_1_params.output_scale, 0, true);
+  pool_with_col2im(CONV_I, CHANNELS, BATCH_SIZE, CHANNELS, POOL_DIM,
+      gold_conv, (elem_t (*)[POOL_DIM][POOL_DIM][CHANNELS]) gold_pooled, &conv_1_params);
+
+  matmul_cpu(POOL_I, CHANNELS, CHANNELS,
+      gold_pooled, conv_2_w, conv_2_b, gold_conv_2,
+      RELU, conv_2_params.output_scale, 0, true);
+
+  memset(gold_patches, 0, sizeof(gold_patches));
+  im2col_with_col2im(POOL_I, CHANNELS, POOL_I, CHANNELS * 9,
+      gold_conv_2, gold_patches, &conv_3_params);
+  matmul_cpu(POOL_I, CHANNELS, CHANNELS * 9,
+      (elem_t (*)[CHANNELS * 9]) gold_patches, conv_3_w, conv_3_b, gold_conv_3,
+      NO_ACTIVATION, conv_3_params.output_scale, 0, true);
+  resadd3(POOL_I, CHANNELS, gold_pooled, gold_conv_3, gold_conv_3, true, &conv_3_params);
+
+  conv_dw_with_col2im(POOL_I, CHANNELS, POOL_I, CHANNELS,
+      BATCH_SIZE, CHANNELS, POOL_DIM, 3,
+      gold_conv_3, conv_dw_4_w, conv_dw_4_b, gold_conv_dw_4, &conv_dw_4_params);
+
+  for (int batch = 0; batch < BATCH_SIZE; batch++) {
+    for (int channel = 0; channel < CHANNELS; channel++) {
+      int sum = 0;
+      for (int r = 0; r < POOL_DIM * POOL_DIM; r++)
+        sum += gold_conv_dw_4[batch * POOL_DIM * POOL_DIM + r][channel];
+
+      const int count = POOL_DIM * POOL_DIM;
+      gold_average[channel][batch] = (sum + count/2) / count;
+    }
+  }
+
+  matmul_cpu(CLASSES, BATCH_SIZE, CHANNELS,
+      fc_5_w, gold_average, &fc_5_b[0][0], gold_fc_5,
+      NO_ACTIVATION, fc_5_params.output_scale, 0, false);
+
+  // The same network, described as a graph. The layers are added out of
+  // order, and the residual addition's output has no buffer of its own.
+  static struct net_t net;
+  net_init(&net);
+
+  const int in = net_tensor(&net, CONV_I, IN_CHANNELS, &images[0][0][0][0]);
+  const int conv_1 = net_tensor(&net, CONV_I, CHANNELS, &conv_1_out[0][0]);
+  const int pooled = net_tensor(&net, POOL_I, CHANNELS, &conv_1_out_pooled[0][0]);
+  const int conv_2 = net_tensor(&net, POOL_I, CHANNELS, &conv_2_out[0][0]);
+  const int conv_3 = net_tensor(&net, POOL_I, CHANNELS, &conv_3_out[0][0]);
+  const int res_3 = net_tensor(&net, POOL_I, CHANNELS, NULL);
+  const int conv_dw_4 = net_tensor(&net, POOL_I, CHANNELS, &conv_dw_4_out[0][0]);
+  const int avg = net_tensor(&net, CHANNELS, BATCH_SIZE, &average[0][0]);
+  const int fc_5 = net_tensor(&net, CLASSES, BATCH_SIZE, &fc_5_out[0][0]);
+
+  net_conv(&net, "conv_1", in, conv_1, &conv_1_w[0][0], conv_1_b, RELU,
+      &conv_1_params, &conv_1_in[0][0]);
+  net_pool(&net, "pool_1", conv_1, pooled, &conv_1_params);
+  net_conv(&net, "conv_3", conv_2, conv_3, &conv_3_w[0][0], conv_3_b, NO_ACTIVATION,
+      &conv_3_params, &conv_3_in[0][0]);
+  net_conv(&net, "conv_2", pooled, conv_2, &conv_2_w[0][0], conv_2_b, RELU,
+      &conv_2_params, NULL);
+  net_resadd(&net, "res_3", pooled, conv_3, res_3, true, &conv_3_params);
+  net_conv_dw(&net, "conv_dw_4", res_3, conv_dw_4, &conv_dw_4_w[0][0][0], conv_dw_4_b,
+      &conv_dw_4_params);
+  net_avgpool(&net, "average", conv_dw_4, avg, &conv_dw_4_params);
+  net_fc(&net, "fc_5", avg, fc_5, &fc_5_w[0][0], &fc_5_b[0][0], NO_ACTIVATION,
+      &fc_5_params);
+
+  net_compile(&net);
+
+  if (net.tensors[res_3].data != net.tensors[conv_3].data) {
+    printf("The residual addition wasn't done in place\n");
+    exit(1);
+  }
+
+  const enum tiled_matmul_type_t types[] = {WS, OS, CPU};
+
+  for (int type = 0; type < 3; type++) {
+    printf("Starting network (matmul type %d)\n", types[type]);
+    memset(fc_5_out, 0, sizeof(fc_5_out));
+
+    net_run(&net, types[type], false);
+
+    for (size_t i = 0; i < CLASSES; i++)
+      for (size_t b = 0; b < BATCH_SIZE; b++)
+        if (fc_5_out[i][b] != gold_fc_5[i][b]) {
+          printf("Mismatch at (%zu, %zu): %d (expected %d)\n",
+              i, b, fc_5_out[i][b], gold_fc_5[i][b]);
+          exit(1);
+        }
+  }
+
+  net_print_cycles(&net);
+
+  // The same network again, with everything but its input and output in the
+  // arena, so that each item in the pipeline gets buffers of its own
+  static struct net_t pnet;
+  net_init(&pnet);
+  net_arena(&pnet, &pipeline_arena[0][0], sizeof(pipeline_arena));
+
+  const int p_in = net_tensor(&pnet, CONV_I, IN_CHANNELS, &images[0][0][0][0]);
+  const int p_conv_1 = net_tensor(&pnet, CONV_I, CHANNELS, NULL);
+  const int p_pooled = net_tensor(&pnet, POOL_I, CHANNELS, NULL);
+  const int p_conv_2 = net_tensor(&pnet, POOL_I, CHANNELS, NULL);
+  const int p_conv_3 = net_tensor(&pnet, POOL_I, CHANNELS, NULL);
+  const int p_res_3 = net_tensor(&pnet, POOL_I, CHANNELS, NULL);
+  const int p_conv_dw_4 = net_tensor(&pnet, POOL_I, CHANNELS, NULL);
+  const int p_avg = net_tensor(&pnet, CHANNELS, BATCH_SIZE, NULL);
+  const int p_fc_5 = net_tensor(&pnet, CLASSES, BATCH_SIZE, &fc_5_out[0][0]);
+
+  net_conv(&pnet, "conv_1", p_in, p_conv_1, &conv_1_w[0][0], conv_1_b, RELU,
+      &conv_1_params, NULL);
+  net_pool(&pnet, "pool_1", p_conv_1, p_pooled, &conv_1_params);
+  net_conv(&pnet, "conv_2", p_pooled, p_conv_2, &conv_2_w[0][0], conv_2_b, RELU,
+      &conv_2_params, NULL);
+  net_conv(&pnet, "conv_3", p_conv_2, p_conv_3, &conv_3_w[0][0], conv_3_b, NO_ACTIVATION,
+      &conv_3_params, NULL);
+  net_resadd(&pnet, "res_3", p_pooled, p_conv_3, p_res_3, true, &conv_3_params);
+  net_conv_dw(&pnet, "conv_dw_4", p_res_3, p_conv_dw_4, &conv_dw_4_w[0][0][0], conv_dw_4_b,
+      &conv_dw_4_params);
+  net_avgpool(&pnet, "average", p_conv_dw_4, p_avg, &conv_dw_4_params);
+  net_fc(&pnet, "fc_5", p_avg, p_fc_5, &fc_5_w[0][0], &fc_5_b[0][0], NO_ACTIVATION,
+      &fc_5_params);
+
+  elem_t * item_in[PIPELINE_ITEMS];
+  elem_t * item_out[PIPELINE_ITEMS];
+
+  for (size_t n = 0; n < PIPELINE_ITEMS; n++) {
+    fill(&item_images[n][0][0][0][0], sizeof(item_images[n]), 30);
+    item_in[n] = &item_images[n][0][0][0][0];
+    item_out[n] = &item_fc_5[n][0][0];
+
+    pnet.tensors[p_in].data = item_in[n];
+    net_run(&pnet, WS, false);
+    memcpy(item_gold[n], fc_5_out, sizeof(fc_5_out));
+  }
+
+  printf("Starting pipelined network\n");
+
+  static struct net_pipeline_t pipeline;
+  net_pipeline_init(&pipeline, &pnet, PIPELINE_ITEMS, PIPELINE_STAGES, PIPELINE_DEPTH,
+      WS, false);
+  net_pipeline_tensor(&pipeline, p_in, item_in);
+  net_pipeline_tensor(&pipeline, p_fc_5, item_out);
+  net_pipeline_run(&pipeline, 0, 1);
+
+  for (size_t n = 0; n < PIPELINE_ITEMS; n++)
+    for (size_t i = 0; i < CLASSES; i++)
+      for (size_t b = 0; b < BATCH_SIZE; b++)
+        if (item_fc_5[n][i][b] != item_gold[n][i][b]) {
+          printf("Mismatch in item %zu at (%zu, %zu): %d (expected %d)\n",
+              n, i, b, item_fc_5[n][i][b], item_gold[n][i][b]);
+          exit(1);
+        }
+
+  exit(0);
+}
@@ -0,0 +1,220 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+#include "include/gemmini_net.h"
+
+// A chain of residual blocks, run once with a buffer for every tensor, and
+// once with every intermediate buffer carved out of an arena:
+//
+// conv_1 (3x3) -> conv_2 (1x1) -> conv_3 (3x3) -> + conv_1 -> conv_4 (1x1)
+//   -> conv_5 (3x3) -> + res_3 -> average -> fc_6
+
+#ifndef BAREMETAL
+#define BATCH_SIZE 2
+#define IMAGE_DIM 12
+#define CHANNELS 32
+#else
+#define BATCH_SIZE 1
+#define IMAGE_DIM 4
+#define CHANNELS 16
+#endif
+
+#define IN_CHANNELS 3
+#define CLASSES 10
+#define ROWS (BATCH_SIZE * IMAGE_DIM * IMAGE_DIM)
+#define N_CONVS 5
+
+static elem_t images[ROWS][IN_CHANNELS];
+
+static elem_t conv_1_w[IN_CHANNELS * 9][CHANNELS] row_align(1);
+static elem_t conv_w[N_CONVS][CHANNELS * 9][CHANNELS] row_align(1);
+static acc_t conv_b[N_CONVS][CHANNELS] row_align_acc(1);
+static elem_t fc_6_w[CLASSES][CHANNELS] row_align(1);
+static acc_t fc_6_b[CLASSES][BATCH_SIZE] row_align_acc(1);
+
+// The buffers of the first network
+static elem_t patches[N_CONVS][ROWS][CHANNELS * 9] row_align(1);
+static elem_t outs[N_CONVS + 2][ROWS][CHANNELS] row_align(1);
+static elem_t average[CHANNELS][BATCH_SIZE] row_align(1);
+static elem_t fc_6_out[CLASSES][BATCH_SIZE] row_align(1);
+
+// The second network's arena, and its own output
+static elem_t arena[(N_CONVS + 2) * ROWS * CHANNELS + ROWS * CHANNELS * 9] row_align(1);
+static elem_t arena_fc_6_out[CLASSES][BATCH_SIZE] row_align(1);
+
+static struct ConvParams conv_params(int in_channels, int kernel_size) {
+  struct ConvParams p;
+  memset(&p, 0, sizeof(p));
+  p.batch_size = BATCH_SIZE;
+  p.in_dim = IMAGE_DIM;
+  p.out_dim = IMAGE_DIM;
+  p.out_dim_pooled = IMAGE_DIM;
+  p.kernel_size = kernel_size;
+  p.in_channels = in_channels;
+  p.out_channels = CHANNELS;
+  p.stride = 1;
+  p.padding = kernel_size / 2;
+  p.bias = true;
+  p.output_scale = 5;
+  p.res_scale = 1;
+  p.n_patches = ROWS;
+  p.patch_size = in_channels * kernel_size * kernel_size;
+  p.I = p.n_patches;
+  p.J = CHANNELS;
+  p.K = p.patch_size;
+  return p;
+}
+
+static void fill(elem_t * x, size_t n, int range) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = (rand() % (2*range + 1)) - range;
+}
+
+static void fill_acc(acc_t * x, size_t n, int range) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = (rand() % (2*range + 1)) - range;
+}
+
+static struct ConvParams params[N_CONVS];
+static struct FcParams fc_6_params = {BATCH_SIZE, CHANNELS, CLASSES, 4, true,
+  CLASSES, BATCH_SIZE, CHANNELS};
+
+// Describes the network. Without "own_buffers", only the input, the
+// weights and the final output have buffers.
+static void build(struct net_t * net, bool own_buffers, elem_t * output) {
+  static const int acts[N_CONVS] = {RELU, RELU, NO_ACTIVATION, RELU, NO_ACTIVATION};
+  int convs[N_CONVS];
+
+  net_init(net);
+
+  const int in = net_tensor(net, ROWS, IN_CHANNELS, &images[0][0]);
+  int x = in;
+  int res = -1;
+
+  for (int c = 0; c < N_CONVS; c++) {
+    convs[c] = net_tensor(net, ROWS, CHANNELS, own_buffers ? &outs[c][0][0] : NULL);
+
+    net_conv(net, "conv", x, convs[c],
+        c == 0 ? &conv_1_w[0][0] : &conv_w[c][0][0], conv_b[c], acts[c],
+        &params[c], own_buffers ? &patches[c][0][0] : NULL);
+
+    x = convs[c];
+
+    // Close a residual block after conv_3 and conv_5
+    if (c == 2 || c == 4) {
+      const int skip = c == 2 ? convs[0] : res;
+      res = net_tensor(net, ROWS, CHANNELS, own_buffers ? &outs[N_CONVS + c/4][0][0] : NULL);
+      net_resadd(net, "res", skip, x, res, true, &params[c]);
+      x = res;
+    }
+  }
+
+  const int avg = net_tensor(net, CHANNELS, BATCH_SIZE, own_buffers ? &average[0][0] : NULL);
+  net_avgpool(net, "average", x, avg, &params[N_CONVS-1]);
+
+  const int fc_6 = net_tensor(net, CLASSES, BATCH_SIZE, output);
+  net_fc(net, "fc_6", avg, fc_6, &fc_6_w[0][0], &fc_6_b[0][0], NO_ACTIVATION,
+      &fc_6_params);
+}
+
+static bool overlap(const struct net_tensor_t * a, const elem_t * b, size_t b_size) {
+  return a->data < b + b_size && b < a->data + a->rows * a->cols;
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  fill(&images[0][0], sizeof(images), 30);
+  fill(&conv_1_w[0][0], sizeof(conv_1_w), 4);
+  fill(&conv_w[0][0][0], sizeof(conv_w), 4);
+  fill(&fc_6_w[0][0], sizeof(fc_6_w), 4);
+  fill_acc(&conv_b[0][0], N_CONVS * CHANNELS, 100);
+  fill_acc(&fc_6_b[0][0], CLASSES * BATCH_SIZE, 100);
+
+  for (int c = 0; c < N_CONVS; c++)
+    params[c] = conv_params(c == 0 ? IN_CHANNELS : CHANNELS, c % 2 == 0 ? 3 : 1);
+
+  static struct net_t net, arena_net;
+  build(&net, true, &fc_6_out[0][0]);
+  build(&arena_net, false, &arena_fc_6_out[0][0]);
+
+  const size_t arena_size = net_arena_size(&arena_net);
+  const size_t separate_size = sizeof(outs) + sizeof(patches) + sizeof(average);
+  printf("Arena: %zu bytes, instead of %zu\n", arena_size, separate_size);
+
+  if (arena_size > sizeof(arena) || arena_size >= separate_size / 2) {
+    printf("The arena is too large\n");
+    exit(1);
+  }
+
+  net_arena(&arena_net, arena, sizeof(arena));
+  net_compile(&arena_net);
+
+  // No layer may write over a buffer which it, or a later layer, still
+  // reads, except for a residual addition writing over its own inputs
+  int step[NET_MAX_LAYERS];
+  for (int n = 0; n < arena_net.n_layers; n++)
+    step[arena_net.order[n]] = n;
+
+  for (int n = 0; n < arena_net.n_layers; n++) {
+    const struct net_layer_t * l = &arena_net.layers[arena_net.order[n]];
+    const struct net_tensor_t * out = &arena_net.tensors[l->output];
+
+    for (int t = 0; t < arena_net.n_tensors; t++) {
+      const struct net_tensor_t * tensor = &arena_net.tensors[t];
+      const bool read = t == l->inputs[0] || (l->n_inputs > 1 && t == l->inputs[1]);
+      const bool live = (tensor->producer < 0 || step[tensor->producer] < n) &&
+        (tensor->last_use < 0 || tensor->last_use > n);
+
+      if (t != l->output && (live || (read && l->type != NET_RESADD)) &&
+          overlap(tensor, out->data, out->rows * out->cols)) {
+        printf("Step %d writes over tensor %d\n", n, t);
+        exit(1);
+      }
+
+      if (l->type == NET_CONV && !l->direct && (live || read || t == l->output) &&
+          overlap(tensor, l->patches, l->conv_params->I * l->conv_params->K)) {
+        printf("Step %d's im2col writes over tensor %d\n", n, t);
+        exit(1);
+      }
+    }
+  }
+
+  const enum tiled_matmul_type_t types[] = {WS, OS, CPU};
+
+  for (int type = 0; type < 3; type++) {
+    printf("Starting networks (matmul type %d)\n", types[type]);
+    memset(fc_6_out, 0, sizeof(fc_6_out));
+    memset(arena_fc_6_out, 1, sizeof(arena_fc_6_out));
+
+    net_run(&net, types[type], false);
+    net_run(&arena_net, types[type], false);
+
+    for (size_t i = 0; i < CLASSES; i++)
+      for (size_t b = 0; b < BATCH_SIZE; b++)
+        if (fc_6_out[i][b] != arena_fc_6_out[i][b]) {
+          printf("Mismatch at (%zu, %zu): %d (expected %d)\n",
+              i, b, arena_fc_6_out[i][b], fc_6_out[i][b]);
+          exit(1);
+        }
+  }
+
+  exit(0);
+}
@@ -0,0 +1,339 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+#include "include/gemmini_net.h"
+#include "include/gemmini_model.h"
+
+// Runs an MLP whose weights are mapped from a model file, without mlockall.
+// net_run only locks each layer's memory while it runs, and faults in the
+// next layer's weights meanwhile, so at most one layer's weights are ever
+// locked. The results must match the MLP run on the original arrays. Then
+// does the same for a conv_dw -> resadd -> pool block, whose layers also use
+// the static buffers in include/gemmini_nn.h.
+
+#ifndef BAREMETAL
+#define FEATURES 512
+#define BATCH_SIZE 4
+#else
+#define FEATURES 64
+#define BATCH_SIZE 2
+#endif
+
+#define LAYERS 4
+#define WEIGHT_BYTES (FEATURES * FEATURES * sizeof(elem_t))
+#define BIAS_BYTES (FEATURES * BATCH_SIZE * sizeof(acc_t))
+
+#ifndef BAREMETAL
+#define CONV_BATCH_SIZE 2
+#define IN_DIM 12
+#define CHANNELS 32
+#else
+#define CONV_BATCH_SIZE 1
+#define IN_DIM 6
+#define CHANNELS 16
+#endif
+
+#define POOLED_DIM ((IN_DIM + 2 - 3) / 2 + 1)
+#define CONV_I (CONV_BATCH_SIZE * IN_DIM * IN_DIM)
+#define POOLED_I (CONV_BATCH_SIZE * POOLED_DIM * POOLED_DIM)
+
+static elem_t input[FEATURES][BATCH_SIZE] row_align(1);
+static elem_t weights[LAYERS][FEATURES][FEATURES] row_align(1);
+static acc_t bias[LAYERS][FEATURES][BATCH_SIZE] row_align_acc(1);
+static elem_t out[LAYERS][FEATURES][BATCH_SIZE] row_align(1);
+static elem_t gold[FEATURES][BATCH_SIZE];
+
+static elem_t images[CONV_I][CHANNELS] row_align(1);
+static elem_t dw_weights[CHANNELS][3][3];
+static acc_t dw_bias[CHANNELS] row_align_acc(1);
+static elem_t dw_out[CONV_I][CHANNELS] row_align(1);
+static elem_t sum[CONV_I][CHANNELS] row_align(1);
+static elem_t pooled_gold[POOLED_I][CHANNELS];
+
+static struct ConvParams dw_params, res_params, pool_params;
+
+static uint8_t blob[LAYERS * (WEIGHT_BYTES + BIAS_BYTES) + 64 * 1024]
+  __attribute__((aligned(MODEL_ALIGN)));
+
+static struct net_t net;
+static struct model_t model;
+
+static char * names[LAYERS] = {"fc_1", "fc_2", "fc_3", "fc_4"};
+
+// Builds the MLP, from the model if "from_model" is set, and runs it
+static void run(bool from_model, bool lock, elem_t result[FEATURES][BATCH_SIZE]) {
+  const struct FcParams params = {BATCH_SIZE, FEATURES, FEATURES, 7, true,
+    FEATURES, BATCH_SIZE, FEATURES};
+
+  net_init(&net);
+
+  int t = net_tensor(&net, FEATURES, BATCH_SIZE, &input[0][0]);
+
+  for (int l = 0; l < LAYERS; l++) {
+    elem_t * o = l == LAYERS - 1 ? &result[0][0] : &out[l][0][0];
+    const int next = net_tensor(&net, FEATURES, BATCH_SIZE, o);
+
+    if (from_model)
+      model_net_fc(&net, &model, names[l], t, next, RELU);
+    else
+      net_fc(&net, names[l], t, next, &weights[l][0][0], &bias[l][0][0], RELU, &params);
+
+    t = next;
+  }
+
+#ifndef BAREMETAL
+  if (lock)
+    net_lock_layers(&net);
+#endif
+
+  net_run(&net, WS, false);
+}
+
+// Builds the conv_dw -> resadd -> pool block, from the model if
+// "from_model" is set, and runs it
+static void run_conv(bool from_model, bool lock, elem_t result[POOLED_I][CHANNELS]) {
+  net_init(&net);
+
+  const int in = net_tensor(&net, CONV_I, CHANNELS, &images[0][0]);
+  const int dw = net_tensor(&net, CONV_I, CHANNELS, &dw_out[0][0]);
+  const int res = net_tensor(&net, CONV_I, CHANNELS, &sum[0][0]);
+  const int pool = net_tensor(&net, POOLED_I, CHANNELS, &result[0][0]);
+
+  if (from_model)
+    model_net_conv_dw(&net, &model, "conv_dw_1", in, dw);
+  else
+    net_conv_dw(&net, "conv_dw_1", in, dw, &dw_weights[0][0][0], dw_bias, &dw_params);
+
+  net_resadd(&net, "res_2", dw, in, res, true, &res_params);
+  net_pool(&net, "pool_3", res, pool, &pool_params);
+
+#ifndef BAREMETAL
+  if (lock)
+    net_lock_layers(&net);
+#endif
+
+  net_run(&net, WS, false);
+}
+
+static void check_conv(const char * from, elem_t result[POOLED_I][CHANNELS]) {
+  for (size_t i = 0; i < POOLED_I; i++)
+    for (size_t c = 0; c < CHANNELS; c++)
+      if (result[i][c] != pooled_gold[i][c]) {
+        printf("%s: conv mismatch at (%zu, %zu): %d (expected %d)\n",
+            from, i, c, result[i][c], pooled_gold[i][c]);
+        exit(1);
+      }
+}
+
+#ifndef BAREMETAL
+// Checks that a layer's ranges, which net_run locks, cover a buffer
+static void check_locks(const struct net_layer_t * l, const void * buffer, size_t bytes,
+    const char * buffer_name) {
+  struct net_range_t ranges[NET_MAX_RANGES];
+  const int n = net_layer_ranges(&net, l, ranges, false);
+
+  for (int r = 0; r < n; r++) {
+    const uint8_t * start = (const uint8_t *)ranges[r].start;
+    if (start <= (const uint8_t *)buffer &&
+        (const uint8_t *)buffer + bytes <= start + ranges[r].bytes)
+      return;
+  }
+
+  printf("%s doesn't lock %s\n", l->name, buffer_name);
+  exit(1);
+}
+#endif
+
+static void check(const char * from, elem_t result[FEATURES][BATCH_SIZE]) {
+  for (size_t i = 0; i < FEATURES; i++)
+    for (size_t b = 0; b < BATCH_SIZE; b++)
+      if (result[i][b] != gold[i][b]) {
+        printf("%s: mismatch at (%zu, %zu): %d (expected %d)\n",
+            from, i, b, result[i][b], gold[i][b]);
+        exit(1);
+      }
+}
+
+int main() {
+  gemmini_flush(0);
+
+  for (size_t i = 0; i < FEATURES; i++)
+    for (size_t b = 0; b < BATCH_SIZE; b++)
+      input[i][b] = (rand() % 61) - 30;
+
+  for (int l = 0; l < LAYERS; l++)
+    for (size_t i = 0; i < FEATURES; i++) {
+      for (size_t k = 0; k < FEATURES; k++)
+        weights[l][i][k] = (rand() % 9) - 4;
+      for (size_t b = 0; b < BATCH_SIZE; b++)
+        bias[l][i][b] = (rand() % 201) - 100;
+    }
+
+  run(false, false, gold);
+
+  for (size_t i = 0; i < CONV_I; i++)
+    for (size_t c = 0; c < CHANNELS; c++)
+      images[i][c] = (rand() % 61) - 30;
+
+  for (size_t c = 0; c < CHANNELS; c++) {
+    for (size_t t = 0; t < 9; t++)
+      dw_weights[c][t / 3][t % 3] = (rand() % 9) - 4;
+    dw_bias[c] = (rand() % 201) - 100;
+  }
+
+  memset(&dw_params, 0, sizeof(dw_params));
+  dw_params.batch_size = CONV_BATCH_SIZE;
+  dw_params.in_dim = IN_DIM;
+  dw_params.out_dim = IN_DIM;
+  dw_params.kernel_size = 3;
+  dw_params.in_channels = CHANNELS;
+  dw_params.out_channels = CHANNELS;
+  dw_params.stride = 1;
+  dw_params.padding = 1;
+  dw_params.bias = true;
+  dw_params.depthwise = true;
+  dw_params.output_scale = 4;
+  dw_params.out_dim_pooled = IN_DIM;
+  dw_params.n_patches = CONV_I;
+  dw_params.patch_size = CHANNELS * 9;
+  dw_params.I = CONV_I;
+  dw_params.J = CHANNELS;
+  dw_params.K = dw_params.patch_size;
+
+  res_params = dw_params;
+  res_params.res_scale = 1;
+
+  pool_params = dw_params;
+  pool_params.pool_size = 3;
+  pool_params.pool_stride = 2;
+  pool_params.pool_padding = 1;
+  pool_params.out_dim_pooled = POOLED_DIM;
+
+  run_conv(false, false, pooled_gold);
+
+  static struct model_writer_t w;
+  model_writer_init(&w, blob, sizeof(blob), 3 * LAYERS + 3);
+
+  const struct FcParams params = {BATCH_SIZE, FEATURES, FEATURES, 7, true,
+    FEATURES, BATCH_SIZE, FEATURES};
+
+  for (int l = 0; l < LAYERS; l++) {
+    char entry[MODEL_NAME_LEN];
+
+    model_layer_entry(entry, names[l], "_params");
+    model_write_fc_params(&w, entry, &params);
+    model_layer_entry(entry, names[l], "_w");
+    model_write_elems(&w, entry, FEATURES, FEATURES, weights[l], ELEM_T_BITS);
+    model_layer_entry(entry, names[l], "_b");
+    model_write_accs(&w, entry, FEATURES, BATCH_SIZE, &bias[l][0][0]);
+  }
+
+  const size_t dw_weights_dims[] = {CHANNELS, 3, 3};
+
+  model_write_conv_params(&w, "conv_dw_1_params", &dw_params);
+  model_write_entry(&w, "conv_dw_1_w", MODEL_ELEM, ELEM_T_BITS, 3, dw_weights_dims, dw_weights);
+  model_write_accs(&w, "conv_dw_1_b", 1, CHANNELS, dw_bias);
+
+  const size_t size = model_writer_finish(&w);
+
+  static elem_t result[FEATURES][BATCH_SIZE];
+  static elem_t conv_result[POOLED_I][CHANNELS];
+
+#ifdef BAREMETAL
+  model_open(&model, blob, size);
+  run(true, false, result);
+  check("memory", result);
+  run_conv(true, false, conv_result);
+  check_conv("memory", conv_result);
+#else
+  char path[] = "/tmp/gemmini_model_XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp failed");
+    exit(1);
+  }
+  close(fd);
+
+  model_save(path, blob, size);
+
+  for (int populate = 0; populate <= 1; populate++) {
+    const char * from = populate ? "populated file" : "file";
+
+    model_load(&model, path, populate);
+
+    memset(result, 0, sizeof(result));
+    run(true, true, result);
+    check(from, result);
+
+    printf("%s: at most %zu bytes locked, %llu bytes of weights prefaulted\n",
+        from, net.max_locked_bytes, (unsigned long long)net.prefaulted_bytes);
+
+    // Only one layer's weights, bias and activations were locked at a time,
+    // rounded out to pages, and everything was unlocked again afterwards
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t activations = 2 * FEATURES * BATCH_SIZE * sizeof(elem_t);
+    const size_t max_locked = WEIGHT_BYTES + BIAS_BYTES + activations + 4 * 2 * page;
+
+    if (net.max_locked_bytes < WEIGHT_BYTES || net.max_locked_bytes > max_locked ||
+        net.locked_bytes != 0) {
+      printf("%s: %zu bytes locked at most (expected %zu to %zu), %zu still locked\n",
+          from, net.max_locked_bytes, (size_t)WEIGHT_BYTES, max_locked, net.locked_bytes);
+      exit(1);
+    }
+
+    // Every layer but the first had its weights faulted in ahead of time
+    if (net.prefaulted_bytes != (LAYERS - 1) * (WEIGHT_BYTES + BIAS_BYTES)) {
+      printf("%s: %llu bytes prefaulted (expected %llu)\n", from,
+          (unsigned long long)net.prefaulted_bytes,
+          (unsigned long long)((LAYERS - 1) * (WEIGHT_BYTES + BIAS_BYTES)));
+      exit(1);
+    }
+
+    memset(conv_result, 0, sizeof(conv_result));
+    run_conv(true, true, conv_result);
+    check_conv(from, conv_result);
+
+    printf("%s: at most %zu bytes locked for the conv block\n", from, net.max_locked_bytes);
+
+    // conv_dw_1 locked the blocks of conv_dw_weights which it used, and the
+    // bounce buffer, but not the rest of conv_dw_weights. The largest layer,
+    // besides those, locked three activations and pool_diff.
+    const size_t dw_weights_used = (CHANNELS + DIM - 1) / DIM * sizeof(conv_dw_weights[0]);
+
+    check_locks(&net.layers[0], conv_dw_weights, dw_weights_used, "conv_dw_weights");
+    check_locks(&net.layers[0], conv_bounce, sizeof(conv_bounce), "conv_bounce");
+    check_locks(&net.layers[1], gemmini_identity, sizeof(gemmini_identity), "gemmini_identity");
+    check_locks(&net.layers[2], gemmini_identity, sizeof(gemmini_identity), "gemmini_identity");
+    check_locks(&net.layers[2], conv_bounce, sizeof(conv_bounce), "conv_bounce");
+    check_locks(&net.layers[2], pool_diff, sizeof(pool_diff), "pool_diff");
+
+    const size_t min_conv_locked = dw_weights_used + sizeof(conv_bounce);
+    const size_t max_conv_locked = min_conv_locked + sizeof(pool_diff) +
+      3 * CONV_I * CHANNELS * sizeof(elem_t) + NET_MAX_RANGES * 2 * page;
+
+    if (net.max_locked_bytes < min_conv_locked || net.max_locked_bytes > max_conv_locked ||
+        net.max_locked_bytes >= sizeof(conv_dw_weights) || net.locked_bytes != 0) {
+      printf("%s: %zu bytes locked at most for the conv block (expected %zu to %zu), %zu still locked\n",
+          from, net.max_locked_bytes, min_conv_locked, max_conv_locked, net.locked_bytes);
+      exit(1);
+    }
+
+    model_close(&model);
+  }
+
+  unlink(path);
+#endif
+
+  printf("MLP and conv block match when their layers are locked one at a time\n");
+  exit(0);
+}
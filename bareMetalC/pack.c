@@ -0,0 +1,73 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+
+// Checks pack_matrix and unpack_matrix against packed_set and packed_get,
+// on a matrix whose rows are strided, and whose length isn't a multiple of
+// the eight elements which are packed at a time
+#define ROWS 9
+#define COLS 61
+#define SRC_STRIDE 67
+#define DST_STRIDE 40 // Bytes, which leaves a gap after each packed row
+
+static elem_t in[ROWS][SRC_STRIDE];
+static uint8_t packed[ROWS][DST_STRIDE];
+static uint8_t gold[ROWS][DST_STRIDE];
+static elem_t out[ROWS][SRC_STRIDE];
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  for (int precision = 4; precision >= 2; precision -= 2) {
+    // Elements span the whole range of elem_t, so most of them saturate
+    for (size_t r = 0; r < ROWS; r++)
+      for (size_t c = 0; c < SRC_STRIDE; c++)
+        in[r][c] = rand() % 256;
+
+    memset(packed, 0x5A, sizeof(packed));
+    memset(gold, 0x5A, sizeof(gold));
+
+    for (size_t r = 0; r < ROWS; r++)
+      for (size_t c = 0; c < COLS; c++)
+        packed_set(gold[r], c, precision, in[r][c]);
+
+    pack_matrix(ROWS, COLS, &in[0][0], SRC_STRIDE, packed, DST_STRIDE, precision);
+
+    // The bytes after each row are left alone
+    if (memcmp(packed, gold, sizeof(packed)) != 0) {
+      printf("%d bits: pack_matrix doesn't match packed_set\n", precision);
+      exit(1);
+    }
+
+    memset(out, 0x5A, sizeof(out));
+    unpack_matrix(ROWS, COLS, packed, DST_STRIDE, &out[0][0], SRC_STRIDE, precision);
+
+    for (size_t r = 0; r < ROWS; r++)
+      for (size_t c = 0; c < SRC_STRIDE; c++) {
+        const elem_t expected = c < COLS ? packed_get(gold[r], c, precision) : 0x5A;
+
+        if (out[r][c] != expected) {
+          printf("%d bits: unpack_matrix gives %d at (%zu, %zu) (expected %d)\n",
+              precision, out[r][c], r, c, expected);
+          exit(1);
+        }
+      }
+  }
+
+  printf("pack_matrix and unpack_matrix match packed_set and packed_get\n");
+  exit(0);
+}
@@ -0,0 +1,162 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+#include "include/gemmini_pipeline.h"
+
+// Streams images through an im2col -> matmul -> pool pipeline, with the
+// matmul on its own hart when there are several
+
+#ifndef BAREMETAL
+#define N_IMAGES 6
+#define IN_DIM 16
+#define IN_CHANNELS 3
+#define OUT_CHANNELS 32
+#else
+#define N_IMAGES 3
+#define IN_DIM 6
+#define IN_CHANNELS 3
+#define OUT_CHANNELS 16
+#endif
+
+#define DEPTH 2
+#define KERNEL_SIZE 3
+#define OUT_DIM IN_DIM
+#define POOL_DIM (OUT_DIM / 2)
+#define I (OUT_DIM * OUT_DIM)
+#define K (IN_CHANNELS * KERNEL_SIZE * KERNEL_SIZE)
+
+static elem_t images[N_IMAGES][1][IN_DIM][IN_DIM][IN_CHANNELS];
+static elem_t weights[K][OUT_CHANNELS] row_align(1);
+static acc_t bias[OUT_CHANNELS] row_align_acc(1);
+
+static elem_t patches[DEPTH][I][K] row_align(1);
+static elem_t conv_out[DEPTH][I][OUT_CHANNELS] row_align(1);
+static elem_t pooled[N_IMAGES][1][POOL_DIM][POOL_DIM][OUT_CHANNELS];
+static elem_t gold[N_IMAGES][1][POOL_DIM][POOL_DIM][OUT_CHANNELS];
+
+static struct ConvParams params;
+static struct pipeline_t pipeline;
+
+static void init() {
+  for (size_t n = 0; n < N_IMAGES; n++)
+    for (size_t r = 0; r < IN_DIM; r++)
+      for (size_t c = 0; c < IN_DIM; c++)
+        for (size_t ch = 0; ch < IN_CHANNELS; ch++)
+          images[n][0][r][c][ch] = (rand() % 17) - 8;
+
+  for (size_t k = 0; k < K; k++)
+    for (size_t j = 0; j < OUT_CHANNELS; j++)
+      weights[k][j] = (rand() % 9) - 4;
+
+  for (size_t j = 0; j < OUT_CHANNELS; j++)
+    bias[j] = (rand() % 101) - 50;
+
+  memset(&params, 0, sizeof(params));
+  params.batch_size = 1;
+  params.in_dim = IN_DIM;
+  params.out_dim = OUT_DIM;
+  params.kernel_size = KERNEL_SIZE;
+  params.in_channels = IN_CHANNELS;
+  params.out_channels = OUT_CHANNELS;
+  params.stride = 1;
+  params.padding = 1;
+  params.output_scale = 3;
+  params.pool_size = 2;
+  params.pool_stride = 2;
+  params.pool_padding = 0;
+  params.out_dim_pooled = POOL_DIM;
+
+  // Run each image through the layers one at a time, on the CPU
+  for (size_t n = 0; n < N_IMAGES; n++) {
+    im2col(1, IN_CHANNELS, IN_DIM, I, K, images[n], patches[0], &params);
+    matmul_cpu(I, OUT_CHANNELS, K, patches[0], weights, bias, conv_out[0],
+        RELU, params.output_scale, 0, true);
+    pool_with_col2im(I, OUT_CHANNELS, 1, OUT_CHANNELS, POOL_DIM,
+        conv_out[0], gold[n], &params);
+  }
+}
+
+static void im2col_stage(size_t n, void * arg) {
+  im2col(1, IN_CHANNELS, IN_DIM, I, K, images[n], patches[n % DEPTH], &params);
+}
+
+static void matmul_stage(size_t n, void * arg) {
+  tiled_matmul_auto(I, OUT_CHANNELS, K,
+      patches[n % DEPTH], weights, bias, conv_out[n % DEPTH],
+      RELU, params.output_scale, 0, true,
+      WS);
+}
+
+static void pool_stage(size_t n, void * arg) {
+  pool_with_col2im(I, OUT_CHANNELS, 1, OUT_CHANNELS, POOL_DIM,
+      conv_out[n % DEPTH], pooled[n], &params);
+}
+
+static void build_pipeline() {
+  pipeline_init(&pipeline, N_IMAGES, DEPTH);
+
+  // With two harts, hart 0 runs im2col and pooling, and hart 1 the matmul
+  pipeline_add_stage(&pipeline, im2col_stage, NULL);
+  pipeline_add_stage(&pipeline, matmul_stage, NULL);
+  pipeline_add_stage(&pipeline, pool_stage, NULL);
+}
+
+static void check() {
+  for (size_t n = 0; n < N_IMAGES; n++)
+    for (size_t r = 0; r < POOL_DIM; r++)
+      for (size_t c = 0; c < POOL_DIM; c++)
+        for (size_t ch = 0; ch < OUT_CHANNELS; ch++)
+          if (pooled[n][0][r][c][ch] != gold[n][0][r][c][ch]) {
+            printf("Mismatch in image %zu at (%zu, %zu, %zu): %d (expected %d)\n",
+                n, r, c, ch, pooled[n][0][r][c][ch], gold[n][0][r][c][ch]);
+            exit(1);
+          }
+}
+
+#ifdef BAREMETAL
+// crt.S calls this on every hart before main, which only hart 0 runs
+void thread_entry(int cid, int nc) {
+  gemmini_flush(0);
+
+  if (cid == 0) {
+    init();
+    build_pipeline();
+  }
+
+  tiled_matmul_mc_barrier(nc);
+  pipeline_run(&pipeline, cid, nc);
+  tiled_matmul_mc_barrier(nc);
+
+  while (cid != 0);
+}
+#endif
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+
+  gemmini_flush(0);
+  init();
+  build_pipeline();
+
+  printf("Starting pipeline\n");
+  pipeline_run(&pipeline, 0, 1);
+#endif
+
+  check();
+
+  exit(0);
+}
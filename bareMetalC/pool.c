@@ -0,0 +1,83 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+
+#ifndef BAREMETAL
+#define BATCH_SIZE 2
+#define IN_DIM 17
+#define CHANNELS 40
+#else
+#define BATCH_SIZE 1
+#define IN_DIM 6
+#define CHANNELS 20
+#endif
+
+#define IN_I (BATCH_SIZE * IN_DIM * IN_DIM)
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  static elem_t input[IN_I][CHANNELS] row_align(1);
+  static elem_t output[IN_I][CHANNELS] row_align(1);
+  static elem_t gold[IN_I][CHANNELS];
+
+  // tiled_pool_with_col2im expects the output of a ReLU
+  for (size_t i = 0; i < IN_I; i++)
+    for (size_t c = 0; c < CHANNELS; c++)
+      input[i][c] = rand() % 128;
+
+  // Test ResNet's 3x3/2 pool with padding, and 2x2/2 and 3x3/1 pools without
+  const int pool_sizes[] = {3, 2, 3};
+  const int pool_strides[] = {2, 2, 1};
+  const int pool_paddings[] = {1, 0, 0};
+
+  for (int test = 0; test < 3; test++) {
+    struct ConvParams params;
+    memset(&params, 0, sizeof(params));
+    params.batch_size = BATCH_SIZE;
+    params.out_dim = IN_DIM;
+    params.out_channels = CHANNELS;
+    params.pool_size = pool_sizes[test];
+    params.pool_stride = pool_strides[test];
+    params.pool_padding = pool_paddings[test];
+    params.out_dim_pooled = (IN_DIM + 2*params.pool_padding - params.pool_size) / params.pool_stride + 1;
+
+    const size_t out_dim = params.out_dim_pooled;
+
+    pool_with_col2im(IN_I, CHANNELS, BATCH_SIZE, CHANNELS, out_dim,
+        input, (elem_t (*)[out_dim][out_dim][CHANNELS]) gold, &params);
+
+    printf("Starting pool (size %d, stride %d, padding %d)\n",
+        params.pool_size, params.pool_stride, params.pool_padding);
+    tiled_pool_with_col2im(IN_I, CHANNELS, BATCH_SIZE, CHANNELS, out_dim,
+        input, (elem_t (*)[out_dim][out_dim][CHANNELS]) output, &params,
+        WS);
+
+    for (size_t i = 0; i < BATCH_SIZE * out_dim * out_dim; i++)
+      for (size_t c = 0; c < CHANNELS; c++)
+        if (output[i][c] != gold[i][c]) {
+          printf("Mismatch at pixel %zu, channel %zu: %d (expected %d)\n",
+              i, c, output[i][c], gold[i][c]);
+          exit(1);
+        }
+  }
+
+  exit(0);
+}
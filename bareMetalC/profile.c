@@ -0,0 +1,115 @@
+// See LICENSE for license details.
+
+#define GEMMINI_PROFILE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+
+#ifndef BAREMETAL
+#define MAT_DIM_I 64
+#define MAT_DIM_J 48
+#define MAT_DIM_K 80
+#else
+#define MAT_DIM_I 32
+#define MAT_DIM_J 16
+#define MAT_DIM_K 48
+#endif
+
+static elem_t A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+static elem_t B[MAT_DIM_K][MAT_DIM_J] row_align(1);
+static elem_t C[MAT_DIM_I][MAT_DIM_J] row_align(1);
+
+static const struct gemmini_profile_counters_t * row(const char * name) {
+  for (size_t r = 1; r < gemmini_profile_state.n_rows; r++)
+    if (strcmp(gemmini_profile_state.names[r], name) == 0)
+      return &gemmini_profile_state.rows[r];
+
+  printf("%s wasn't profiled\n", name);
+  exit(1);
+}
+
+static void check_layer(const char * name, uint64_t calls) {
+  const struct gemmini_profile_counters_t * c = row(name);
+  const uint64_t macs = calls * MAT_DIM_I * MAT_DIM_J * MAT_DIM_K;
+  const uint64_t bytes_out = calls * MAT_DIM_I * MAT_DIM_J * sizeof(elem_t);
+  const uint64_t min_bytes_in = calls * (MAT_DIM_I * MAT_DIM_K + MAT_DIM_K * MAT_DIM_J) * sizeof(elem_t);
+
+  if (c->calls != calls || c->macs != macs || c->bytes_out != bytes_out ||
+      c->bytes_in < min_bytes_in || c->mvins == 0 || c->mvouts == 0 ||
+      c->computes + c->loops == 0 || c->cycles == 0) {
+    printf("%s: wrong counters (%llu calls, %llu macs, %llu bytes in, %llu bytes out)\n",
+        name, (unsigned long long)c->calls, (unsigned long long)c->macs,
+        (unsigned long long)c->bytes_in, (unsigned long long)c->bytes_out);
+    exit(1);
+  }
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  for (size_t i = 0; i < MAT_DIM_I; i++)
+    for (size_t k = 0; k < MAT_DIM_K; k++)
+      A[i][k] = (rand() % 9) - 4;
+
+  for (size_t k = 0; k < MAT_DIM_K; k++)
+    for (size_t j = 0; j < MAT_DIM_J; j++)
+      B[k][j] = (rand() % 9) - 4;
+
+  // Layers with the same name share a row
+  for (int i = 0; i < 2; i++)
+    tiled_matmul_nn_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K, A, B, NULL, C,
+        NO_ACTIVATION, 0, 0, false, WS, false, "ws");
+
+  tiled_matmul_nn_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K, A, B, NULL, C,
+      NO_ACTIVATION, 0, 0, false, OS, false, "os");
+
+  // Nested layers are counted as part of the outermost one
+  gemmini_profile_begin("outer");
+  tiled_matmul_nn_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K, A, B, NULL, C,
+      NO_ACTIVATION, 0, 0, false, WS, false, "inner");
+  gemmini_profile_end();
+
+  // The CPU doesn't issue any instructions
+  tiled_matmul_nn_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K, A, B, NULL, C,
+      NO_ACTIVATION, 0, 0, false, CPU, false, "cpu");
+
+  check_layer("ws", 2);
+  check_layer("os", 1);
+  check_layer("outer", 1);
+
+  for (size_t r = 1; r < gemmini_profile_state.n_rows; r++) {
+    if (strcmp(gemmini_profile_state.names[r], "inner") == 0) {
+      printf("A nested layer got its own row\n");
+      exit(1);
+    }
+  }
+
+  const struct gemmini_profile_counters_t * cpu = row("cpu");
+  if (cpu->mvins + cpu->mvouts + cpu->preloads + cpu->computes + cpu->loops != 0) {
+    printf("The CPU layer issued Gemmini instructions\n");
+    exit(1);
+  }
+
+  // On Linux, the profile is printed at exit
+#ifdef BAREMETAL
+  gemmini_profile_dump();
+#endif
+
+  exit(0);
+}
@@ -0,0 +1,120 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+
+#ifndef BAREMETAL
+#define BATCH_SIZE 2
+#define IN_DIM 17
+#define IN_CHANNELS 12
+#define OUT_CHANNELS 40
+#else
+#define BATCH_SIZE 1
+#define IN_DIM 7
+#define IN_CHANNELS 5
+#define OUT_CHANNELS 18
+#endif
+
+#define KERNEL_SIZE 3
+#define MAX_OUT_DIM IN_DIM
+#define MAX_I (BATCH_SIZE * MAX_OUT_DIM * MAX_OUT_DIM)
+#define IM2COL_K (IN_CHANNELS * KERNEL_SIZE * KERNEL_SIZE)
+#define MAX_K (KERNEL_SIZE * ((KERNEL_SIZE * IN_CHANNELS + DIM - 1) / DIM) * DIM)
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  static elem_t input[BATCH_SIZE][IN_DIM][IN_DIM][IN_CHANNELS] row_align(1);
+  static elem_t weights[IM2COL_K][OUT_CHANNELS] row_align(1);
+  static elem_t fused_weights[MAX_K][OUT_CHANNELS] row_align(1);
+  static acc_t bias[OUT_CHANNELS] row_align_acc(1);
+  static elem_t patches[MAX_I][IM2COL_K] row_align(1);
+  static elem_t output[MAX_I][OUT_CHANNELS] row_align(1);
+  static elem_t gold[MAX_I][OUT_CHANNELS];
+
+  for (size_t b = 0; b < BATCH_SIZE; b++)
+    for (size_t r = 0; r < IN_DIM; r++)
+      for (size_t c = 0; c < IN_DIM; c++)
+        for (size_t ch = 0; ch < IN_CHANNELS; ch++)
+          input[b][r][c][ch] = (rand() % 9) - 4;
+
+  for (size_t k = 0; k < IM2COL_K; k++)
+    for (size_t j = 0; j < OUT_CHANNELS; j++)
+      weights[k][j] = (rand() % 5) - 2;
+
+  for (size_t j = 0; j < OUT_CHANNELS; j++)
+    bias[j] = (rand() % 201) - 100;
+
+  // Test both a "same" and a strided convolution, with and without a bias
+  const int strides[] = {1, 2};
+  const int paddings[] = {1, 0};
+
+  for (int test = 0; test < 4; test++) {
+    struct ConvParams params;
+    memset(&params, 0, sizeof(params));
+    params.batch_size = BATCH_SIZE;
+    params.in_dim = IN_DIM;
+    params.kernel_size = KERNEL_SIZE;
+    params.in_channels = IN_CHANNELS;
+    params.out_channels = OUT_CHANNELS;
+    params.stride = strides[test % 2];
+    params.padding = paddings[test % 2];
+    params.bias = test < 2;
+    params.output_scale = 3;
+    params.out_dim = (IN_DIM + 2*params.padding - KERNEL_SIZE) / params.stride + 1;
+    params.n_patches = BATCH_SIZE * params.out_dim * params.out_dim;
+    params.patch_size = IM2COL_K;
+    params.I = params.n_patches;
+    params.J = OUT_CHANNELS;
+    params.K = IM2COL_K;
+
+    const size_t I = params.I;
+    const size_t K = tiled_conv_K(&params);
+    const acc_t * D = params.bias ? bias : NULL;
+
+    memset(patches, 0, sizeof(patches));
+    im2col(BATCH_SIZE, IN_CHANNELS, IN_DIM, I, IM2COL_K,
+        input, patches, &params);
+
+    matmul_cpu(I, OUT_CHANNELS, IM2COL_K,
+        patches, weights, D, gold,
+        RELU, params.output_scale, 0, true);
+
+    tiled_conv_weights(IM2COL_K, OUT_CHANNELS, K,
+        weights, fused_weights, &params);
+
+    printf("Starting fused conv (stride %d, padding %d, bias %d)\n",
+        params.stride, params.padding, params.bias);
+    tiled_conv(BATCH_SIZE, IN_DIM, IN_CHANNELS,
+        I, OUT_CHANNELS, K,
+        input, fused_weights, D, output,
+        RELU, params.output_scale, 0,
+        &params);
+
+    for (size_t i = 0; i < I; i++)
+      for (size_t j = 0; j < OUT_CHANNELS; j++)
+        if (output[i][j] != gold[i][j]) {
+          printf("Mismatch at patch %zu, channel %zu: %d (expected %d)\n",
+              i, j, output[i][j], gold[i][j]);
+          exit(1);
+        }
+  }
+
+  exit(0);
+}
@@ -0,0 +1,103 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+
+#ifndef BAREMETAL
+#define MAT_DIM_I 200
+#define MAT_DIM_K 180
+#define MAT_DIM_J 150
+#else
+#define MAT_DIM_I 33
+#define MAT_DIM_K 40
+#define MAT_DIM_J 35
+#endif
+
+void full_printMatrix(elem_t m[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i) {
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      printf("%d ", m[i][j]);
+    printf("\n");
+  }
+}
+
+int full_is_equal(elem_t x[MAT_DIM_I][MAT_DIM_J], elem_t y[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      if (x[i][j] != y[i][j])
+        return 0;
+  return 1;
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  static elem_t full_A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+  static elem_t full_B[MAT_DIM_K][MAT_DIM_J] row_align(1);
+  static elem_t full_B2[MAT_DIM_J][MAT_DIM_J] row_align(1);
+  static elem_t full_C[MAT_DIM_I][MAT_DIM_J] row_align(1);
+  static elem_t full_C2[MAT_DIM_I][MAT_DIM_J] row_align(1);
+  static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+  static elem_t gold2[MAT_DIM_I][MAT_DIM_J];
+
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t k = 0; k < MAT_DIM_K; ++k)
+      full_A[i][k] = (rand() % 5) - 2;
+
+  for (size_t k = 0; k < MAT_DIM_K; ++k)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      full_B[k][j] = (rand() % 5) - 2;
+
+  for (size_t k = 0; k < MAT_DIM_J; ++k)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      full_B2[k][j] = (rand() % 5) - 2;
+
+  printf("Starting async gemmini matmuls\n");
+  gemmini_token_t first = tiled_matmul_auto_async(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+      full_A, full_B, NULL, full_C,
+      RELU, 2, 0, false,
+      WS, GEMMINI_NO_TOKEN);
+
+  // The second matmul reads the first one's output
+  gemmini_token_t second = tiled_matmul_auto_async(MAT_DIM_I, MAT_DIM_J, MAT_DIM_J,
+      full_C, full_B2, NULL, full_C2,
+      NO_ACTIVATION, 3, 0, false,
+      WS, first);
+
+  // Meanwhile, compute the expected results on the CPU
+  matmul_cpu(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+      full_A, full_B, NULL, gold,
+      RELU, 2, 0, false);
+
+  matmul_cpu(MAT_DIM_I, MAT_DIM_J, MAT_DIM_J,
+      gold, full_B2, NULL, gold2,
+      NO_ACTIVATION, 3, 0, false);
+
+  gemmini_wait(second);
+
+  if (!full_is_equal(full_C, gold) || !full_is_equal(full_C2, gold2)) {
+    printf("C:\n");
+    full_printMatrix(full_C2);
+    printf("Gold:\n");
+    full_printMatrix(gold2);
+    printf("\n");
+
+    exit(1);
+  }
+
+  exit(0);
+}
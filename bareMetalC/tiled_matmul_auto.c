@@ -0,0 +1,192 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+
+// A tall, skinny matmul, like the early layers of a CNN
+#ifndef BAREMETAL
+#define MAT_DIM_I 784
+#define MAT_DIM_K 147
+#define MAT_DIM_J 64
+#else
+#define MAT_DIM_I 200
+#define MAT_DIM_K 50
+#define MAT_DIM_J 20
+#endif
+
+// A wide matmul, like mlp1's first layer, whose OS tiling is limited by the
+// scratchpad halves that A and B each get
+#ifndef BAREMETAL
+#define WIDE_DIM_I 64
+#define WIDE_DIM_K 832
+#define WIDE_DIM_J 2560
+#else
+#define WIDE_DIM_I 64
+#define WIDE_DIM_K 832
+#define WIDE_DIM_J 256
+#endif
+
+// Shapes whose tilings are checked, including some from mlp1 and resnet50
+static const size_t shapes[][3] = {
+  {1, 1, 1},
+  {MAT_DIM_I, MAT_DIM_J, MAT_DIM_K},
+  {64, 2560, 832},
+  {12544, 64, 147},
+  {49, 2048, 512},
+  {1000, 1000, 1000},
+};
+
+void full_printMatrix(elem_t m[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i) {
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      printf("%d ", m[i][j]);
+    printf("\n");
+  }
+}
+
+int full_is_equal(elem_t x[MAT_DIM_I][MAT_DIM_J], elem_t y[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      if (x[i][j] != y[i][j])
+        return 0;
+  return 1;
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  // Check that the chosen tiling factors fit in the scratchpad and
+  // accumulator, and that the plans are cached
+  for (size_t s = 0; s < sizeof(shapes)/sizeof(shapes[0]); s++) {
+    for (int dataflow = OS; dataflow <= WS; dataflow++) {
+      const size_t I = shapes[s][0] / DIM + (shapes[s][0] % DIM != 0);
+      const size_t J = shapes[s][1] / DIM + (shapes[s][1] % DIM != 0);
+      const size_t K = shapes[s][2] / DIM + (shapes[s][2] % DIM != 0);
+
+      const struct tiling_plan_t * t = tiled_matmul_plan(shapes[s][0],
+          shapes[s][1], shapes[s][2], dataflow);
+
+      printf("%zux%zux%zu (%s): tile_I = %zu, tile_J = %zu, tile_K = %zu\n",
+          shapes[s][0], shapes[s][1], shapes[s][2],
+          dataflow == OS ? "OS" : "WS", t->tile_I, t->tile_J, t->tile_K);
+
+      if (t->tile_I < 1 || t->tile_I > I || t->tile_J < 1 || t->tile_J > J ||
+          t->tile_K < 1 || t->tile_K > K) {
+        printf("Tiling factors are out of bounds\n");
+        exit(1);
+      }
+
+      // OS keeps A and B in separate halves of the scratchpad. WS puts them
+      // next to each other, or keeps a whole column of B tiles resident.
+      const size_t A_rows = t->tile_I * t->tile_K * DIM;
+      const size_t B_rows = (t->weights_resident ? K : t->tile_K) * t->tile_J * DIM;
+      const bool spad_fits = dataflow == OS ?
+        A_rows <= BANK_NUM * BANK_ROWS / 2 && B_rows <= BANK_NUM * BANK_ROWS / 2 :
+        A_rows + B_rows <= BANK_NUM * BANK_ROWS;
+
+      if (!spad_fits || t->tile_I * t->tile_J * DIM > ACC_ROWS) {
+        printf("Tiling factors don't fit in the scratchpad or accumulator\n");
+        exit(1);
+      }
+
+      if ((t->I0 - 1) * t->tile_I + t->last_I != I ||
+          (t->J0 - 1) * t->tile_J + t->last_J != J ||
+          (t->K0 - 1) * t->tile_K + t->last_K != K) {
+        printf("Tile counts don't cover the matrices\n");
+        exit(1);
+      }
+
+      if (tiled_matmul_plan(shapes[s][0], shapes[s][1], shapes[s][2], dataflow) != t) {
+        printf("Plan wasn't cached\n");
+        exit(1);
+      }
+    }
+  }
+
+  static elem_t full_A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+  static elem_t full_B[MAT_DIM_K][MAT_DIM_J] row_align(1);
+  static elem_t full_C[MAT_DIM_I][MAT_DIM_J] row_align(1);
+  static acc_t full_D[MAT_DIM_I][MAT_DIM_J] row_align_acc(1);
+  static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t k = 0; k < MAT_DIM_K; ++k)
+      full_A[i][k] = (rand() % 5) - 2;
+
+  for (size_t k = 0; k < MAT_DIM_K; ++k)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      full_B[k][j] = (rand() % 5) - 2;
+
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      full_D[i][j] = (rand() % 65) - 32;
+
+  matmul_cpu(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+      full_A, full_B, &full_D[0][0], gold,
+      NO_ACTIVATION, 0, 0, false);
+
+  for (int dataflow = OS; dataflow <= WS; dataflow++) {
+    printf("Starting gemmini matmul (%s)\n", dataflow == OS ? "OS" : "WS");
+    tiled_matmul_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+        full_A, full_B, &full_D[0][0], full_C,
+        NO_ACTIVATION, 0, 0, false,
+        dataflow);
+
+    if (!full_is_equal(full_C, gold)) {
+      printf("C:\n");
+      full_printMatrix(full_C);
+      printf("Gold:\n");
+      full_printMatrix(gold);
+      printf("\n");
+
+      exit(1);
+    }
+  }
+
+  static elem_t wide_A[WIDE_DIM_I][WIDE_DIM_K] row_align(1);
+  static elem_t wide_B[WIDE_DIM_K][WIDE_DIM_J] row_align(1);
+  static elem_t wide_C[WIDE_DIM_I][WIDE_DIM_J] row_align(1);
+  static elem_t wide_gold[WIDE_DIM_I][WIDE_DIM_J];
+
+  for (size_t i = 0; i < WIDE_DIM_I; ++i)
+    for (size_t k = 0; k < WIDE_DIM_K; ++k)
+      wide_A[i][k] = (rand() % 5) - 2;
+
+  for (size_t k = 0; k < WIDE_DIM_K; ++k)
+    for (size_t j = 0; j < WIDE_DIM_J; ++j)
+      wide_B[k][j] = (rand() % 5) - 2;
+
+  matmul_cpu(WIDE_DIM_I, WIDE_DIM_J, WIDE_DIM_K,
+      wide_A, wide_B, NULL, wide_gold,
+      RELU, 2, 0, false);
+
+  printf("Starting wide gemmini matmul (OS)\n");
+  tiled_matmul_auto(WIDE_DIM_I, WIDE_DIM_J, WIDE_DIM_K,
+      wide_A, wide_B, NULL, wide_C,
+      RELU, 2, 0, false,
+      OS);
+
+  for (size_t i = 0; i < WIDE_DIM_I; ++i)
+    for (size_t j = 0; j < WIDE_DIM_J; ++j)
+      if (wide_C[i][j] != wide_gold[i][j]) {
+        printf("Wide matmul mismatch at (%zu, %zu): %d (expected %d)\n",
+            i, j, wide_C[i][j], wide_gold[i][j]);
+        exit(1);
+      }
+
+  exit(0);
+}
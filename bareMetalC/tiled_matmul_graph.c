@@ -0,0 +1,125 @@
+// See LICENSE for license details.
+
+#define GEMMINI_GRAPHS
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+
+#ifndef BAREMETAL
+#define MAT_DIM_I 100
+#define MAT_DIM_K 90
+#define MAT_DIM_J 70
+#define MAX_CMDS 16384
+#else
+#define MAT_DIM_I 35
+#define MAT_DIM_K 40
+#define MAT_DIM_J 30
+#define MAX_CMDS 1024
+#endif
+
+void full_printMatrix(elem_t m[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i) {
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      printf("%d ", m[i][j]);
+    printf("\n");
+  }
+}
+
+int full_is_equal(elem_t x[MAT_DIM_I][MAT_DIM_J], elem_t y[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      if (x[i][j] != y[i][j])
+        return 0;
+  return 1;
+}
+
+void check(elem_t C[MAT_DIM_I][MAT_DIM_J], elem_t gold[MAT_DIM_I][MAT_DIM_J]) {
+  if (!full_is_equal(C, gold)) {
+    printf("C:\n");
+    full_printMatrix(C);
+    printf("Gold:\n");
+    full_printMatrix(gold);
+    printf("\n");
+
+    exit(1);
+  }
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  static elem_t full_A[2][MAT_DIM_I][MAT_DIM_K] row_align(1);
+  static elem_t full_B[2][MAT_DIM_K][MAT_DIM_J] row_align(1);
+  static elem_t full_C[2][MAT_DIM_I][MAT_DIM_J] row_align(1);
+  static acc_t full_D[MAT_DIM_I][MAT_DIM_J] row_align_acc(1);
+  static elem_t gold[2][MAT_DIM_I][MAT_DIM_J];
+
+  for (int m = 0; m < 2; m++) {
+    for (size_t i = 0; i < MAT_DIM_I; ++i)
+      for (size_t k = 0; k < MAT_DIM_K; ++k)
+        full_A[m][i][k] = (rand() % 5) - 2;
+
+    for (size_t k = 0; k < MAT_DIM_K; ++k)
+      for (size_t j = 0; j < MAT_DIM_J; ++j)
+        full_B[m][k][j] = (rand() % 5) - 2;
+  }
+
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      full_D[i][j] = (rand() % 65) - 32;
+
+  for (int m = 0; m < 2; m++)
+    matmul_cpu(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+        full_A[m], full_B[m], &full_D[0][0], gold[m],
+        RELU, 1, 0, false);
+
+  static struct gemmini_cmd_t cmds[MAX_CMDS];
+  struct gemmini_graph_t graph;
+  gemmini_graph_init(&graph, cmds, MAX_CMDS);
+  gemmini_graph_buffer(&graph, full_A[0], sizeof(full_A[0]));
+  gemmini_graph_buffer(&graph, full_B[0], sizeof(full_B[0]));
+  gemmini_graph_buffer(&graph, full_C[0], sizeof(full_C[0]));
+
+  printf("Recording graph\n");
+  gemmini_graph_begin(&graph);
+  tiled_matmul_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+      full_A[0], full_B[0], &full_D[0][0], full_C[0],
+      RELU, 1, 0, false,
+      WS);
+  gemmini_graph_end();
+  printf("Recorded %zu commands\n", graph.len);
+
+  // Nothing should have run while recording
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      if (full_C[0][i][j] != 0) {
+        printf("Commands ran while they were being recorded\n");
+        exit(1);
+      }
+
+  printf("Replaying graph\n");
+  gemmini_graph_replay(&graph, NULL);
+  check(full_C[0], gold[0]);
+
+  printf("Replaying graph on relocated matrices\n");
+  const void * bases[] = {full_A[1], full_B[1], full_C[1]};
+  gemmini_graph_replay(&graph, bases);
+  check(full_C[1], gold[1]);
+
+  exit(0);
+}
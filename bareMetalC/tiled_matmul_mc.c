@@ -0,0 +1,126 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+
+#ifndef BAREMETAL
+#define MAT_DIM_I 64
+#define MAT_DIM_K 832
+#define MAT_DIM_J 2560
+#else
+#define MAT_DIM_I 30
+#define MAT_DIM_K 40
+#define MAT_DIM_J 70
+#endif
+
+static elem_t full_A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+static elem_t full_B[MAT_DIM_K][MAT_DIM_J] row_align(1);
+static elem_t full_C[MAT_DIM_I][MAT_DIM_J] row_align(1);
+static acc_t full_D[MAT_DIM_I][MAT_DIM_J] row_align_acc(1);
+static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+
+static void init() {
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t k = 0; k < MAT_DIM_K; ++k)
+      full_A[i][k] = (rand() % 5) - 2;
+
+  for (size_t k = 0; k < MAT_DIM_K; ++k)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      full_B[k][j] = (rand() % 5) - 2;
+
+  for (size_t j = 0; j < MAT_DIM_J; ++j)
+    full_D[0][j] = (rand() % 65) - 32;
+
+  matmul_cpu(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+      full_A, full_B, &full_D[0][0], gold,
+      RELU, 3, 0, true);
+}
+
+static void check(size_t nc) {
+  for (size_t i = 0; i < MAT_DIM_I; i++)
+    for (size_t j = 0; j < MAT_DIM_J; j++)
+      if (full_C[i][j] != gold[i][j]) {
+        printf("Mismatch at (%zu, %zu) with %zu harts: %d (expected %d)\n",
+            i, j, nc, full_C[i][j], gold[i][j]);
+        exit(1);
+      }
+}
+
+#ifdef BAREMETAL
+static size_t harts = 1;
+
+// crt.S calls this on every hart before main, which only hart 0 runs
+void thread_entry(int cid, int nc) {
+  gemmini_flush(0);
+
+  if (cid == 0) {
+    init();
+    harts = nc;
+  }
+
+  tiled_matmul_mc_barrier(nc);
+
+  tiled_matmul_mc(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+      full_A, full_B, &full_D[0][0], full_C,
+      RELU, 3, 0, true,
+      WS, cid, nc);
+
+  while (cid != 0);
+}
+#endif
+
+int main() {
+#ifdef BAREMETAL
+  printf("Checking matmul split across %zu harts\n", harts);
+  check(harts);
+#else
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+
+  gemmini_flush(0);
+  init();
+
+#ifdef GEMMINI_HOST_EMU
+  // The emulator only has one hart, so run each hart's share in turn
+  for (size_t nc = 1; nc <= 4; nc++) {
+    struct tiling_plan_t plan;
+    tiled_matmul_mc_plan(&plan, MAT_DIM_I, MAT_DIM_J, MAT_DIM_K, WS, nc);
+
+    printf("Starting matmul split across %zu harts (%zu tiles)\n",
+        nc, plan.I0 * plan.J0);
+
+    for (size_t j = 0; j < MAT_DIM_J; j++)
+      for (size_t i = 0; i < MAT_DIM_I; i++)
+        full_C[i][j] = 0;
+
+    for (size_t cid = 0; cid < nc; cid++) {
+      tiled_matmul_mc_part(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+          full_A, full_B, &full_D[0][0], full_C,
+          &plan,
+          RELU, 3, 0, true,
+          cid, nc);
+    }
+
+    check(nc);
+  }
+#else
+  tiled_matmul_mc(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+      full_A, full_B, &full_D[0][0], full_C,
+      RELU, 3, 0, true,
+      WS, 0, 1);
+
+  check(1);
+#endif
+#endif
+
+  exit(0);
+}
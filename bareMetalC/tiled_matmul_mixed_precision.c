@@ -0,0 +1,166 @@
+// See LICENSE for license details.
+
+#define GEMMINI_PROFILE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+
+// An FC layer whose activations (A), weights (B) and outputs (C) are packed
+// at different precisions, such as 8-bit activations with 4-bit weights. It's
+// run with every dataflow, and checked against matmul_cpu on the unpacked
+// matrices.
+#define MAT_DIM_I 64
+#define MAT_DIM_J 72
+#define MAT_DIM_K 200
+
+static elem_t A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+static elem_t B[MAT_DIM_K][MAT_DIM_J] row_align(1);
+static acc_t D[MAT_DIM_J] row_align_acc(1);
+static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+
+// Large enough for the matrices packed at any precision
+static elem_t A_packed[MAT_DIM_I][MAT_DIM_K] row_align(1);
+static elem_t B_packed[MAT_DIM_K][MAT_DIM_J] row_align(1);
+static elem_t C_packed[MAT_DIM_I][MAT_DIM_J] row_align(1);
+
+// A, B and C precisions
+static const int precisions[][3] = {
+  {8, 4, 8},
+  {8, 2, 8},
+  {4, 4, 8},
+  {8, 4, 4},
+};
+
+#define N_PRECISIONS (sizeof(precisions) / sizeof(precisions[0]))
+
+static const char * names[] = {"ws", "os", "cpu", "auto"};
+
+static elem_t random_elem(int precision) {
+  const int range = 1 << (precision < 8 ? precision : 4);
+  return (rand() % range) - range / 2;
+}
+
+static uint64_t bytes_in(const char * name) {
+  for (size_t r = 1; r < gemmini_profile_state.n_rows; r++)
+    if (strcmp(gemmini_profile_state.names[r], name) == 0)
+      return gemmini_profile_state.rows[r].bytes_in;
+
+  printf("%s wasn't profiled\n", name);
+  exit(1);
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  for (size_t j = 0; j < MAT_DIM_J; j++)
+    D[j] = (rand() % 201) - 100;
+
+  for (size_t p = 0; p < N_PRECISIONS; p++) {
+    const int A_precision = precisions[p][0];
+    const int B_precision = precisions[p][1];
+    const int C_precision = precisions[p][2];
+    const int C_max = C_precision < 8 ? (1 << (C_precision - 1)) - 1 : elem_t_max;
+    const int C_min = C_precision < 8 ? -(1 << (C_precision - 1)) : elem_t_min;
+    const size_t shift = 4;
+
+    for (size_t i = 0; i < MAT_DIM_I; i++)
+      for (size_t k = 0; k < MAT_DIM_K; k++)
+        A[i][k] = random_elem(A_precision);
+
+    for (size_t k = 0; k < MAT_DIM_K; k++)
+      for (size_t j = 0; j < MAT_DIM_J; j++)
+        B[k][j] = random_elem(B_precision);
+
+    matmul_cpu(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K, A, B, D, gold,
+        RELU, shift, 0, true);
+
+    for (size_t i = 0; i < MAT_DIM_I; i++)
+      for (size_t j = 0; j < MAT_DIM_J; j++)
+        gold[i][j] = gold[i][j] > C_max ? C_max : (gold[i][j] < C_min ? C_min : gold[i][j]);
+
+    pack_matrix(MAT_DIM_I, MAT_DIM_K, &A[0][0], MAT_DIM_K,
+        A_packed, packed_bytes(MAT_DIM_K, A_precision), A_precision);
+    pack_matrix(MAT_DIM_K, MAT_DIM_J, &B[0][0], MAT_DIM_J,
+        B_packed, packed_bytes(MAT_DIM_J, B_precision), B_precision);
+
+    for (int run = 0; run < 4; run++) {
+      memset(C_packed, 0, sizeof(C_packed));
+
+      gemmini_profile_begin(names[run]);
+
+      if (run == 3) {
+        tiled_matmul_auto_mixed_precision(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+            A_packed, B_packed, D, C_packed,
+            RELU, shift, 0, true, WS,
+            A_precision, B_precision, C_precision);
+      } else {
+        const enum tiled_matmul_type_t types[] = {WS, OS, CPU};
+
+        tiled_matmul_mixed_precision(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+            A_packed, B_packed, D, C_packed,
+            RELU, shift, 0, true,
+            2, 2, 4, types[run], false,
+            A_precision, B_precision, C_precision);
+      }
+
+      gemmini_profile_end();
+
+      const size_t C_row_bytes = packed_bytes(MAT_DIM_J, C_precision);
+
+      for (size_t i = 0; i < MAT_DIM_I; i++)
+        for (size_t j = 0; j < MAT_DIM_J; j++) {
+          const elem_t c = packed_get((uint8_t *)C_packed + i * C_row_bytes, j, C_precision);
+
+          if (c != gold[i][j]) {
+            printf("%d/%d/%d bits, %s: mismatch at (%zu, %zu): %d (expected %d)\n",
+                A_precision, B_precision, C_precision, names[run],
+                i, j, c, gold[i][j]);
+            exit(1);
+          }
+        }
+    }
+  }
+
+  // Packing only the weights moves fewer bytes in than running the same
+  // layer with 8-bit weights
+  memset(gemmini_profile_state.rows, 0, sizeof(gemmini_profile_state.rows));
+
+  gemmini_profile_begin("weights_8bit");
+  tiled_matmul_auto_mixed_precision(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+      A, B, D, C_packed, RELU, 4, 0, true, WS, 8, 8, 8);
+  gemmini_profile_end();
+
+  pack_matrix(MAT_DIM_K, MAT_DIM_J, &B[0][0], MAT_DIM_J,
+      B_packed, packed_bytes(MAT_DIM_J, 4), 4);
+
+  gemmini_profile_begin("weights_4bit");
+  tiled_matmul_auto_mixed_precision(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+      A, B_packed, D, C_packed, RELU, 4, 0, true, WS, 8, 4, 8);
+  gemmini_profile_end();
+
+  printf("Bytes moved in: %llu with 8-bit weights, %llu with 4-bit weights\n",
+      (unsigned long long)bytes_in("weights_8bit"),
+      (unsigned long long)bytes_in("weights_4bit"));
+
+  if (bytes_in("weights_4bit") + MAT_DIM_K * MAT_DIM_J / 2 > bytes_in("weights_8bit")) {
+    printf("4-bit weights didn't halve the weight bytes moved in\n");
+    exit(1);
+  }
+
+  exit(0);
+}
@@ -0,0 +1,165 @@
+// See LICENSE for license details.
+
+#define GEMMINI_PROFILE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+
+// Compares the two output-stationary kernels on a single tile of I x J
+// blocks, for a range of K: one which preloads before every compute, and one
+// which only preloads at the start and end of each output block. Then checks
+// that tiled matmuls use the first one, unless GEMMINI_OS_STREAM_K is defined.
+
+#define TILE_I 4
+#define TILE_J 4
+#define MAX_TILE_K 64
+
+static elem_t A[TILE_I * DIM][MAX_TILE_K * DIM] row_align(1);
+static elem_t B[MAX_TILE_K * DIM][TILE_J * DIM] row_align(1);
+static acc_t D[TILE_J * DIM] row_align_acc(1);
+static elem_t C[TILE_I * DIM][TILE_J * DIM] row_align(1);
+static elem_t gold[TILE_I * DIM][TILE_J * DIM];
+
+static const char * names[] = {"preload_every_k", "stream_k", "tiled"};
+
+static const struct gemmini_profile_counters_t * row(const char * name) {
+  for (size_t r = 1; r < gemmini_profile_state.n_rows; r++)
+    if (strcmp(gemmini_profile_state.names[r], name) == 0)
+      return &gemmini_profile_state.rows[r];
+
+  printf("%s wasn't profiled\n", name);
+  exit(1);
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  for (size_t i = 0; i < TILE_I * DIM; i++)
+    for (size_t k = 0; k < MAX_TILE_K * DIM; k++)
+      A[i][k] = (rand() % 5) - 2;
+
+  for (size_t k = 0; k < MAX_TILE_K * DIM; k++)
+    for (size_t j = 0; j < TILE_J * DIM; j++)
+      B[k][j] = (rand() % 5) - 2;
+
+  for (size_t j = 0; j < TILE_J * DIM; j++)
+    D[j] = (rand() % 201) - 100;
+
+  printf("K, preloads, preloads (streamed), computes, cycles, cycles (streamed)\n");
+
+  for (size_t K = 1; K <= MAX_TILE_K; K *= 4) {
+    const size_t dim_K = K * DIM;
+
+    // matmul_cpu_rows reads A with a row length of dim_K, so the gold results
+    // are computed on a packed copy
+    static elem_t A_packed[TILE_I * DIM * MAX_TILE_K * DIM];
+    for (size_t i = 0; i < TILE_I * DIM; i++)
+      memcpy(&A_packed[i * dim_K], A[i], dim_K * sizeof(elem_t));
+
+    matmul_cpu_rows(0, TILE_I * DIM, TILE_J * DIM, dim_K,
+        A_packed, &B[0][0], D, &gold[0][0],
+        NO_ACTIVATION, 0, 0, true);
+
+    memset(gemmini_profile_state.rows, 0, sizeof(gemmini_profile_state.rows));
+
+    for (int stream_k = 0; stream_k <= 1; stream_k++) {
+      memset(C, 0, sizeof(C));
+
+#ifdef GEMMINI_PERF_MODEL
+      gemmini_perf_begin(names[stream_k]);
+#endif
+      gemmini_profile_begin(names[stream_k]);
+
+      gemmini_config_ex(OUTPUT_STATIONARY, NO_ACTIVATION, 0, 0, 0);
+      gemmini_config_st(TILE_J * DIM * sizeof(elem_t));
+
+      sp_tiled_matmul_os(&A[0][0], &B[0][0], D, &C[0][0],
+          TILE_I, TILE_J, K, 0, 0, 0,
+          MAX_TILE_K * DIM, TILE_J * DIM, TILE_J * DIM, TILE_J * DIM,
+          false, true, stream_k, ELEM_T_BITS, ELEM_T_BITS, ELEM_T_BITS);
+
+      gemmini_profile_end();
+#ifdef GEMMINI_PERF_MODEL
+      gemmini_perf_end();
+#endif
+
+      for (size_t i = 0; i < TILE_I * DIM; i++)
+        for (size_t j = 0; j < TILE_J * DIM; j++)
+          if (C[i][j] != gold[i][j]) {
+            printf("%s, K = %zu: mismatch at (%zu, %zu): %d (expected %d)\n",
+                names[stream_k], K, i, j, C[i][j], gold[i][j]);
+            exit(1);
+          }
+    }
+
+    const struct gemmini_profile_counters_t * every = row(names[0]);
+    const struct gemmini_profile_counters_t * streamed = row(names[1]);
+    const uint64_t blocks = TILE_I * TILE_J;
+
+    printf("%zu, %llu, %llu, %llu, %llu, %llu\n", K,
+        (unsigned long long)every->preloads, (unsigned long long)streamed->preloads,
+        (unsigned long long)streamed->computes,
+        (unsigned long long)every->cycles, (unsigned long long)streamed->cycles);
+
+    if (every->preloads != blocks * K || streamed->preloads != blocks * (K > 1 ? 2 : 1) ||
+        every->computes != blocks * K || streamed->computes != blocks * K) {
+      printf("Unexpected number of preloads or computes\n");
+      exit(1);
+    }
+  }
+
+  // The gold results are still those of the largest K
+  memset(C, 0, sizeof(C));
+  gemmini_profile_begin(names[2]);
+  tiled_matmul_auto(TILE_I * DIM, TILE_J * DIM, MAX_TILE_K * DIM,
+      A, B, D, C,
+      NO_ACTIVATION, 0, 0, true,
+      OS);
+  gemmini_profile_end();
+
+  for (size_t i = 0; i < TILE_I * DIM; i++)
+    for (size_t j = 0; j < TILE_J * DIM; j++)
+      if (C[i][j] != gold[i][j]) {
+        printf("%s: mismatch at (%zu, %zu): %d (expected %d)\n",
+            names[2], i, j, C[i][j], gold[i][j]);
+        exit(1);
+      }
+
+  const struct tiling_plan_t * plan = tiled_matmul_plan(TILE_I * DIM, TILE_J * DIM,
+      MAX_TILE_K * DIM, OS);
+  const uint64_t blocks = TILE_I * TILE_J;
+
+#ifdef GEMMINI_OS_STREAM_K
+  // Each tile of K streams its computes separately
+  const uint64_t expected = blocks * ((plan->K0 - 1) * (plan->tile_K > 1 ? 2 : 1) +
+      (plan->last_K > 1 ? 2 : 1));
+#else
+  const uint64_t expected = blocks * MAX_TILE_K;
+#endif
+
+  printf("%s: %llu preloads (expected %llu, tile_K = %zu)\n", names[2],
+      (unsigned long long)row(names[2])->preloads, (unsigned long long)expected,
+      plan->tile_K);
+
+  if (row(names[2])->preloads != expected) {
+    printf("Tiled matmul used the wrong OS kernel\n");
+    exit(1);
+  }
+
+  exit(0);
+}
@@ -0,0 +1,133 @@
+// See LICENSE for license details.
+
+#define GEMMINI_PROFILE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+
+// Runs matmuls on 4-bit and 2-bit packed matrices, whose dimensions aren't
+// multiples of DIM, with every dataflow, and checks them against matmul_cpu
+// on the unpacked matrices
+#define MAT_DIM_I 40
+#define MAT_DIM_J 36
+#define MAT_DIM_K 52
+
+static elem_t A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+static elem_t B[MAT_DIM_K][MAT_DIM_J] row_align(1);
+static acc_t D[MAT_DIM_J] row_align_acc(1);
+static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+
+// Large enough for the matrices packed at any precision
+static elem_t A_packed[MAT_DIM_I][MAT_DIM_K] row_align(1);
+static elem_t B_packed[MAT_DIM_K][MAT_DIM_J] row_align(1);
+static elem_t C_packed[MAT_DIM_I][MAT_DIM_J] row_align(1);
+
+static const char * names[] = {"ws", "ws_double_buffered", "os", "cpu", "auto"};
+
+static const struct gemmini_profile_counters_t * row(const char * name) {
+  for (size_t r = 1; r < gemmini_profile_state.n_rows; r++)
+    if (strcmp(gemmini_profile_state.names[r], name) == 0)
+      return &gemmini_profile_state.rows[r];
+
+  printf("%s wasn't profiled\n", name);
+  exit(1);
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  for (int precision = 4; precision >= 2; precision -= 2) {
+    const int range = 1 << precision;
+    const int min = -(range / 2), max = range / 2 - 1;
+    const size_t shift = precision == 4 ? 5 : 1;
+
+    for (size_t i = 0; i < MAT_DIM_I; i++)
+      for (size_t k = 0; k < MAT_DIM_K; k++)
+        A[i][k] = (rand() % range) + min;
+
+    for (size_t k = 0; k < MAT_DIM_K; k++)
+      for (size_t j = 0; j < MAT_DIM_J; j++)
+        B[k][j] = (rand() % range) + min;
+
+    for (size_t j = 0; j < MAT_DIM_J; j++)
+      D[j] = (rand() % 65) - 32;
+
+    // The results are saturated to the precision when they're moved out
+    matmul_cpu(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K, A, B, D, gold,
+        NO_ACTIVATION, shift, 0, true);
+
+    for (size_t i = 0; i < MAT_DIM_I; i++)
+      for (size_t j = 0; j < MAT_DIM_J; j++)
+        gold[i][j] = gold[i][j] > max ? max : (gold[i][j] < min ? min : gold[i][j]);
+
+    pack_matrix(MAT_DIM_I, MAT_DIM_K, &A[0][0], MAT_DIM_K,
+        A_packed, packed_bytes(MAT_DIM_K, precision), precision);
+    pack_matrix(MAT_DIM_K, MAT_DIM_J, &B[0][0], MAT_DIM_J,
+        B_packed, packed_bytes(MAT_DIM_J, precision), precision);
+
+    memset(gemmini_profile_state.rows, 0, sizeof(gemmini_profile_state.rows));
+
+    for (int run = 0; run < 5; run++) {
+      memset(C_packed, 0, sizeof(C_packed));
+
+      gemmini_profile_begin(names[run]);
+
+      if (run == 4) {
+        tiled_matmul_auto_precision(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+            A_packed, B_packed, D, C_packed,
+            NO_ACTIVATION, shift, 0, true, WS, precision);
+      } else {
+        const enum tiled_matmul_type_t types[] = {WS, WS, OS, CPU};
+
+        tiled_matmul_precision(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+            A_packed, B_packed, D, C_packed,
+            NO_ACTIVATION, shift, 0, true,
+            2, 2, 2, types[run], run == 1, precision);
+      }
+
+      gemmini_profile_end();
+
+      const size_t C_row_bytes = packed_bytes(MAT_DIM_J, precision);
+
+      for (size_t i = 0; i < MAT_DIM_I; i++)
+        for (size_t j = 0; j < MAT_DIM_J; j++) {
+          const elem_t c = packed_get((uint8_t *)C_packed + i * C_row_bytes, j, precision);
+
+          if (c != gold[i][j]) {
+            printf("%d bits, %s: mismatch at (%zu, %zu): %d (expected %d)\n",
+                precision, names[run], i, j, c, gold[i][j]);
+            exit(1);
+          }
+        }
+
+      // Only the packed bytes of C are moved out
+      if (run != 3 && row(names[run])->bytes_out != MAT_DIM_I * C_row_bytes) {
+        printf("%d bits, %s: %llu bytes moved out (expected %llu)\n",
+            precision, names[run],
+            (unsigned long long)row(names[run])->bytes_out,
+            (unsigned long long)(MAT_DIM_I * C_row_bytes));
+        exit(1);
+      }
+    }
+
+    printf("%d bits: %llu bytes moved in\n", precision,
+        (unsigned long long)row("auto")->bytes_in);
+  }
+
+  exit(0);
+}
@@ -0,0 +1,115 @@
+// See LICENSE for license details.
+
+#define GEMMINI_PROFILE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+
+// A tall matmul, like a convolution with many patches, whose dimensions
+// aren't multiples of DIM
+#define MAT_DIM_I 500
+#define MAT_DIM_J 40
+#define MAT_DIM_K 72
+
+static elem_t A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+static elem_t B[MAT_DIM_K][MAT_DIM_J] row_align(1);
+static acc_t D[MAT_DIM_J] row_align_acc(1);
+static elem_t C[MAT_DIM_I][MAT_DIM_J] row_align(1);
+static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+
+static const char * names[] = {"auto", "none", "weights"};
+
+static uint64_t bytes_in(const char * name) {
+  for (size_t r = 1; r < gemmini_profile_state.n_rows; r++)
+    if (strcmp(gemmini_profile_state.names[r], name) == 0)
+      return gemmini_profile_state.rows[r].bytes_in;
+
+  printf("%s wasn't profiled\n", name);
+  exit(1);
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  for (size_t i = 0; i < MAT_DIM_I; i++)
+    for (size_t k = 0; k < MAT_DIM_K; k++)
+      A[i][k] = (rand() % 9) - 4;
+
+  for (size_t k = 0; k < MAT_DIM_K; k++)
+    for (size_t j = 0; j < MAT_DIM_J; j++)
+      B[k][j] = (rand() % 9) - 4;
+
+  for (size_t j = 0; j < MAT_DIM_J; j++)
+    D[j] = (rand() % 201) - 100;
+
+  matmul_cpu(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K, A, B, D, gold,
+      RELU, 2, 0, true);
+
+  // Forcing the residency must be honoured, since a column of B easily fits
+  const struct tiling_plan_t * none = tiled_matmul_plan_residency(MAT_DIM_I,
+      MAT_DIM_J, MAT_DIM_K, WS, TILING_RESIDENCY_NONE);
+  const struct tiling_plan_t * weights = tiled_matmul_plan_residency(MAT_DIM_I,
+      MAT_DIM_J, MAT_DIM_K, WS, TILING_RESIDENCY_WEIGHTS);
+
+  printf("Without residency: tile_I = %zu, tile_J = %zu, tile_K = %zu\n",
+      none->tile_I, none->tile_J, none->tile_K);
+  printf("With residency: tile_I = %zu, tile_J = %zu, tile_K = %zu\n",
+      weights->tile_I, weights->tile_J, weights->tile_K);
+
+  if (none->weights_resident || !weights->weights_resident || weights->I0 < 2) {
+    printf("The residency wasn't honoured\n");
+    exit(1);
+  }
+
+  // The output stationary dataflow never keeps B resident
+  if (tiled_matmul_plan_residency(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K, OS,
+        TILING_RESIDENCY_WEIGHTS)->weights_resident) {
+    printf("An OS plan has resident weights\n");
+    exit(1);
+  }
+
+  for (int r = TILING_RESIDENCY_AUTO; r <= TILING_RESIDENCY_WEIGHTS; r++) {
+    memset(C, 0, sizeof(C));
+
+    gemmini_profile_begin(names[r]);
+    tiled_matmul_auto_residency(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K, A, B, D, C,
+        RELU, 2, 0, true, WS, r);
+    gemmini_profile_end();
+
+    for (size_t i = 0; i < MAT_DIM_I; i++)
+      for (size_t j = 0; j < MAT_DIM_J; j++)
+        if (C[i][j] != gold[i][j]) {
+          printf("%s: mismatch at (%zu, %zu): %d (expected %d)\n",
+              names[r], i, j, C[i][j], gold[i][j]);
+          exit(1);
+        }
+  }
+
+  // With resident weights, B is only moved in once
+  const uint64_t B_bytes = MAT_DIM_K * MAT_DIM_J * sizeof(elem_t);
+  printf("Bytes moved in: %llu without residency, %llu with it\n",
+      (unsigned long long)bytes_in("none"), (unsigned long long)bytes_in("weights"));
+
+  if (bytes_in("weights") > bytes_in("none") - B_bytes) {
+    printf("Resident weights didn't save any mvins\n");
+    exit(1);
+  }
+
+  exit(0);
+}
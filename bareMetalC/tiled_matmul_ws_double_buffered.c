@@ -0,0 +1,102 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+
+#ifndef BAREMETAL
+#define MAT_DIM_I 200
+#define MAT_DIM_K 180
+#define MAT_DIM_J 150
+#define TILE_I 2
+#define TILE_J 3
+#define TILE_K 4
+#else
+#define MAT_DIM_I 33
+#define MAT_DIM_K 40
+#define MAT_DIM_J 35
+#define TILE_I 1
+#define TILE_J 2
+#define TILE_K 2
+#endif
+
+void full_printMatrix(elem_t m[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i) {
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      printf("%d ", m[i][j]);
+    printf("\n");
+  }
+}
+
+int full_is_equal(elem_t x[MAT_DIM_I][MAT_DIM_J], elem_t y[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      if (x[i][j] != y[i][j])
+        return 0;
+  return 1;
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  static elem_t full_A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+  static elem_t full_B[MAT_DIM_K][MAT_DIM_J] row_align(1);
+  static elem_t full_C[MAT_DIM_I][MAT_DIM_J] row_align(1);
+  static acc_t full_D[MAT_DIM_I][MAT_DIM_J] row_align_acc(1);
+  static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t k = 0; k < MAT_DIM_K; ++k)
+      full_A[i][k] = (rand() % 5) - 2;
+
+  for (size_t k = 0; k < MAT_DIM_K; ++k)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      full_B[k][j] = (rand() % 5) - 2;
+
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      full_D[i][j] = (rand() % 65) - 32;
+
+  for (int bias = 0; bias <= 2; bias++) {
+    // bias == 0: no bias, bias == 1: repeating bias, bias == 2: full bias
+    const acc_t * D = bias == 0 ? NULL : &full_D[0][0];
+    const bool repeating_bias = bias == 1;
+    const int shift = 2;
+
+    matmul_cpu(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+        full_A, full_B, D, gold,
+        RELU, shift, 0, repeating_bias);
+
+    printf("Starting double-buffered gemmini matmul (bias mode %d)\n", bias);
+    tiled_matmul(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+        full_A, full_B, D, full_C,
+        RELU, shift, 0, repeating_bias,
+        TILE_I, TILE_J, TILE_K,
+        WS, true);
+
+    if (!full_is_equal(full_C, gold)) {
+      printf("C:\n");
+      full_printMatrix(full_C);
+      printf("Gold:\n");
+      full_printMatrix(gold);
+      printf("\n");
+
+      exit(1);
+    }
+  }
+
+  exit(0);
+}
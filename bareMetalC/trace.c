@@ -0,0 +1,105 @@
+// See LICENSE for license details.
+
+#define GEMMINI_TRACE
+#define GEMMINI_TRACE_ENTRIES 2048
+#define GEMMINI_PROFILE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+
+#define MAT_DIM_I 32
+#define MAT_DIM_J 32
+#define MAT_DIM_K 48
+
+static elem_t A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+static elem_t B[MAT_DIM_K][MAT_DIM_J] row_align(1);
+static acc_t D[MAT_DIM_J] row_align_acc(1);
+static elem_t C[MAT_DIM_I][MAT_DIM_J] row_align(1);
+
+static bool in(uint64_t addr, const void * base, size_t bytes) {
+  return addr >= (uintptr_t)base && addr < (uintptr_t)base + bytes;
+}
+
+int main() {
+#ifndef BAREMETAL
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("mlockall failed");
+    exit(1);
+  }
+#endif
+
+  gemmini_flush(0);
+
+  const enum tiled_matmul_type_t types[] = {WS, OS};
+
+  for (int type = 0; type < 2; type++) {
+    gemmini_trace_state.n_entries = 0;
+    memset(gemmini_profile_state.rows, 0, sizeof(gemmini_profile_state.rows));
+
+    tiled_matmul_nn_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K, A, B, D, C,
+        NO_ACTIVATION, 0, 0, true, types[type], false, "matmul");
+
+    const struct gemmini_trace_state_t * s = &gemmini_trace_state;
+    if (s->n_entries > GEMMINI_TRACE_ENTRIES) {
+      printf("The trace overflowed\n");
+      exit(1);
+    }
+
+    // Each matrix is named before it's used, and every mvin and mvout falls
+    // inside one of them
+    size_t named = 0, mvins = 0, mvouts = 0, preloads = 0, computes = 0;
+
+    for (size_t i = 0; i < s->n_entries; i++) {
+      const struct gemmini_trace_entry_t * e = &s->entries[i];
+
+      switch (e->funct) {
+        case GEMMINI_TRACE_MATRIX:
+          named++;
+          break;
+        case k_MVIN:
+          mvins++;
+          if (named < 4 || !(in(e->rs1, A, sizeof(A)) || in(e->rs1, B, sizeof(B)) ||
+                in(e->rs1, D, sizeof(D)))) {
+            printf("mvin %zu reads an unnamed matrix\n", i);
+            exit(1);
+          }
+          break;
+        case k_MVOUT:
+          mvouts++;
+          if (!in(e->rs1, C, sizeof(C))) {
+            printf("mvout %zu doesn't write C\n", i);
+            exit(1);
+          }
+          break;
+        case k_PRELOAD:
+          preloads++;
+          break;
+        case k_COMPUTE_PRELOADED:
+        case k_COMPUTE_ACCUMULATE:
+          computes++;
+          break;
+      }
+    }
+
+    // The profile counts the same instructions
+    const struct gemmini_profile_counters_t * c = &gemmini_profile_state.rows[1];
+    if (named != 4 || mvins != c->mvins || mvouts != c->mvouts ||
+        preloads != c->preloads || computes != c->computes) {
+      printf("The trace doesn't match the profile\n");
+      exit(1);
+    }
+  }
+
+  gemmini_trace_dump();
+
+  exit(0);
+}
@@ -6,10 +6,34 @@
 #endif
 #include "include/gemmini.h"
 #include "include/gemmini_nn.h"
+#include "include/gemmini_net.h"
 
 #include "mobilenet_params.h"
 #include "images.h"
 
+// Every activation and im2col output is carved out of a single arena. If it
+// is too small for a network, net_compile prints how large it must be.
+#ifndef ARENA_BYTES
+// Enough for conv_4's and conv_dw_5's outputs, which are the most MobileNet ever
+// has live at once
+#define ARENA_BYTES (sizeof(conv_4_out) + sizeof(conv_dw_5_out))
+#endif
+
+// The "pipeline" option streams PIPELINE_ITEMS copies of the batch through
+// the network, split into PIPELINE_STAGES groups of layers, with
+// PIPELINE_DEPTH items between each pair of them (see net_pipeline_run)
+#ifndef PIPELINE_ITEMS
+#define PIPELINE_ITEMS 4
+#endif
+
+#ifndef PIPELINE_STAGES
+#define PIPELINE_STAGES 2
+#endif
+
+#ifndef PIPELINE_DEPTH
+#define PIPELINE_DEPTH 1
+#endif
+
 int main (int argc, char * argv[]) {
 #ifndef BAREMETAL
     if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
@@ -30,766 +54,359 @@ int main (int argc, char * argv[]) {
     } else if (strcmp(argv[1], "ws") == 0) {
         tiled_matmul_type = WS;
     } else if (strcmp(argv[1], "-h") == 0) {
-        printf("usage: %s [-h] matmul_option [check]\n  matmul_option may be 'os', 'ws', or cpu'\n", argv[0]);
+        printf("usage: %s [-h] matmul_option [check] [pipeline]\n  matmul_option may be 'os', 'ws', or cpu'\n", argv[0]);
         exit(0);
     } else {
         printf("Unknown command-line argument\n");
-        printf("usage: %s [-h] matmul_option [check]\n  matmul_option may be 'os', 'ws', or cpu'\n", argv[0]);
+        printf("usage: %s [-h] matmul_option [check] [pipeline]\n  matmul_option may be 'os', 'ws', or cpu'\n", argv[0]);
         exit(1);
     }
 
-    bool check;
-    if (argc < 3) {
-        check = false;
-    } else if (strcmp(argv[2], "check") == 0) {
-        check = true;
-    } else {
-        printf("Unknown command-line argument\n");
-        printf("usage: %s [-h] matmul_option [check]\n  matmul_option may be 'os', 'ws', or cpu'\n", argv[0]);
-        exit(1);
+    bool check = false;
+    bool pipelined = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "check") == 0) {
+            check = true;
+        } else if (strcmp(argv[i], "pipeline") == 0) {
+            pipelined = true;
+        } else {
+            printf("Unknown command-line argument\n");
+            printf("usage: %s [-h] matmul_option [check] [pipeline]\n  matmul_option may be 'os', 'ws', or cpu'\n", argv[0]);
+            exit(1);
+        }
     }
 
-    uint64_t start, end;
-    uint64_t im2col_cycles = 0, matmul_cycles = 0, pool_cycles = 0, conv_dw_cycles = 0, res_add_cycles = 0, other_cycles = 0;
-
-    // conv_1
-    start = read_cycles();
-    
-    im2col(conv_1_params.batch_size, conv_1_params.in_channels, conv_1_params.in_dim,
-        conv_1_params.I, conv_1_params.K,
-        images, conv_1_in, &conv_1_params);
-    
-    end = read_cycles();
-    im2col_cycles += end - start;
+    // A pipelined run needs a copy of the arena for every item in flight
+    static elem_t arena[NET_PIPELINE_COPIES(PIPELINE_STAGES, PIPELINE_DEPTH) * ARENA_BYTES / sizeof(elem_t)] row_align(1);
 
-    start = read_cycles();
+    static struct net_t net;
+    net_init(&net);
+    net_arena(&net, arena, sizeof(arena));
 
-    tiled_matmul_nn_auto(conv_1_params.I, conv_1_params.J, conv_1_params.K,
-        conv_1_in, conv_1_w, conv_1_b, conv_1_out,
-        RELU, conv_1_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_1");
+    // The network. Only its input and output have buffers of their own.
+    const int input = net_tensor(&net,
+        conv_1_params.batch_size * conv_1_params.in_dim * conv_1_params.in_dim,
+        conv_1_params.in_channels, (elem_t *) images);
 
-    end = read_cycles();
-    matmul_cycles += end - start;
+    // conv_1
+    const int conv_1 = net_tensor(&net, conv_1_params.I, conv_1_params.J, NULL);
+    net_conv(&net, "conv_1", input, conv_1, (elem_t *) conv_1_w, (acc_t *) conv_1_b, RELU,
+        &conv_1_params, NULL);
 
     // conv_dw_2
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_1_params.I, conv_1_params.J, conv_dw_2_params.I, conv_dw_2_params.J,
-        conv_dw_2_params.batch_size, conv_dw_2_params.in_channels, conv_dw_2_params.out_dim, conv_dw_2_params.kernel_size,
-        conv_1_out, conv_dw_2_w, conv_dw_2_b, conv_dw_2_out, &conv_dw_2_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_2 = net_tensor(&net, conv_dw_2_params.I, conv_dw_2_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_2", conv_1, conv_dw_2, (elem_t *) conv_dw_2_w, (acc_t *) conv_dw_2_b,
+        &conv_dw_2_params);
 
     // conv_3
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_3_params.I, conv_3_params.J, conv_3_params.K,
-        conv_dw_2_out, conv_3_w, conv_3_b, conv_3_out,
-        NO_ACTIVATION, conv_3_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_3");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_3 = net_tensor(&net, conv_3_params.I, conv_3_params.J, NULL);
+    net_conv(&net, "conv_3", conv_dw_2, conv_3, (elem_t *) conv_3_w, (acc_t *) conv_3_b, NO_ACTIVATION,
+        &conv_3_params, NULL);
 
     // conv_4
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_4_params.I, conv_4_params.J, conv_4_params.K,
-        conv_3_out, conv_4_w, conv_4_b, conv_4_out,
-        RELU, conv_4_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_4");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_4 = net_tensor(&net, conv_4_params.I, conv_4_params.J, NULL);
+    net_conv(&net, "conv_4", conv_3, conv_4, (elem_t *) conv_4_w, (acc_t *) conv_4_b, RELU,
+        &conv_4_params, NULL);
 
     // conv_dw_5
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_4_params.I, conv_4_params.J, conv_dw_5_params.I, conv_dw_5_params.J,
-        conv_dw_5_params.batch_size, conv_dw_5_params.in_channels, conv_dw_5_params.out_dim, conv_dw_5_params.kernel_size,
-        conv_4_out, conv_dw_5_w, conv_dw_5_b, conv_dw_5_out, &conv_dw_5_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_5 = net_tensor(&net, conv_dw_5_params.I, conv_dw_5_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_5", conv_4, conv_dw_5, (elem_t *) conv_dw_5_w, (acc_t *) conv_dw_5_b,
+        &conv_dw_5_params);
 
     // conv_6
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_6_params.I, conv_6_params.J, conv_6_params.K,
-        conv_dw_5_out, conv_6_w, conv_6_b, conv_6_out,
-        NO_ACTIVATION, conv_6_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_6");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_6 = net_tensor(&net, conv_6_params.I, conv_6_params.J, NULL);
+    net_conv(&net, "conv_6", conv_dw_5, conv_6, (elem_t *) conv_6_w, (acc_t *) conv_6_b, NO_ACTIVATION,
+        &conv_6_params, NULL);
 
     // conv_7
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_7_params.I, conv_7_params.J, conv_7_params.K,
-        conv_6_out, conv_7_w, conv_7_b, conv_7_out,
-        RELU, conv_7_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_7");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_7 = net_tensor(&net, conv_7_params.I, conv_7_params.J, NULL);
+    net_conv(&net, "conv_7", conv_6, conv_7, (elem_t *) conv_7_w, (acc_t *) conv_7_b, RELU,
+        &conv_7_params, NULL);
 
     // conv_dw_8
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_7_params.I, conv_7_params.J, conv_dw_8_params.I, conv_dw_8_params.J,
-        conv_dw_8_params.batch_size, conv_dw_8_params.in_channels, conv_dw_8_params.out_dim, conv_dw_8_params.kernel_size,
-        conv_7_out, conv_dw_8_w, conv_dw_8_b, conv_dw_8_out, &conv_dw_8_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_8 = net_tensor(&net, conv_dw_8_params.I, conv_dw_8_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_8", conv_7, conv_dw_8, (elem_t *) conv_dw_8_w, (acc_t *) conv_dw_8_b,
+        &conv_dw_8_params);
 
     // conv_9
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_9_params.I, conv_9_params.J, conv_9_params.K,
-        conv_dw_8_out, conv_9_w, conv_9_b, conv_9_out,
-        NO_ACTIVATION, conv_9_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_9");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
-
-    // Add residuals
-    start = read_cycles();
-
-    resadd3(conv_9_params.I, conv_9_params.J,
-        conv_6_out,
-        conv_9_out,
-        conv_9_out,
-        false,
-        &conv_9_params
-    );
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
-    // conv_10
-    start = read_cycles();
+    const int conv_9 = net_tensor(&net, conv_9_params.I, conv_9_params.J, NULL);
+    net_conv(&net, "conv_9", conv_dw_8, conv_9, (elem_t *) conv_9_w, (acc_t *) conv_9_b, NO_ACTIVATION,
+        &conv_9_params, NULL);
 
-    tiled_matmul_nn_auto(conv_10_params.I, conv_10_params.J, conv_10_params.K,
-        conv_9_out, conv_10_w, conv_10_b, conv_10_out,
-        RELU, conv_10_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_10");
+    // Add residuals, in place
+    const int res_9 = net_tensor(&net, conv_9_params.I, conv_9_params.J, NULL);
+    net_resadd(&net, "res_9", conv_6, conv_9, res_9, false, &conv_9_params);
 
-    end = read_cycles();
-    matmul_cycles += end - start;
+    // conv_10
+    const int conv_10 = net_tensor(&net, conv_10_params.I, conv_10_params.J, NULL);
+    net_conv(&net, "conv_10", res_9, conv_10, (elem_t *) conv_10_w, (acc_t *) conv_10_b, RELU,
+        &conv_10_params, NULL);
 
     // conv_dw_11
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_10_params.I, conv_10_params.J, conv_dw_11_params.I, conv_dw_11_params.J,
-        conv_dw_11_params.batch_size, conv_dw_11_params.in_channels, conv_dw_11_params.out_dim, conv_dw_11_params.kernel_size,
-        conv_10_out, conv_dw_11_w, conv_dw_11_b, conv_dw_11_out, &conv_dw_11_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_11 = net_tensor(&net, conv_dw_11_params.I, conv_dw_11_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_11", conv_10, conv_dw_11, (elem_t *) conv_dw_11_w, (acc_t *) conv_dw_11_b,
+        &conv_dw_11_params);
 
     // conv_12
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_12_params.I, conv_12_params.J, conv_12_params.K,
-        conv_dw_11_out, conv_12_w, conv_12_b, conv_12_out,
-        NO_ACTIVATION, conv_12_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_12");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_12 = net_tensor(&net, conv_12_params.I, conv_12_params.J, NULL);
+    net_conv(&net, "conv_12", conv_dw_11, conv_12, (elem_t *) conv_12_w, (acc_t *) conv_12_b, NO_ACTIVATION,
+        &conv_12_params, NULL);
 
     // conv_13
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_13_params.I, conv_13_params.J, conv_13_params.K,
-        conv_12_out, conv_13_w, conv_13_b, conv_13_out,
-        RELU, conv_13_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_13");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_13 = net_tensor(&net, conv_13_params.I, conv_13_params.J, NULL);
+    net_conv(&net, "conv_13", conv_12, conv_13, (elem_t *) conv_13_w, (acc_t *) conv_13_b, RELU,
+        &conv_13_params, NULL);
 
     // conv_dw_14
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_13_params.I, conv_13_params.J, conv_dw_14_params.I, conv_dw_14_params.J,
-        conv_dw_14_params.batch_size, conv_dw_14_params.in_channels, conv_dw_14_params.out_dim, conv_dw_14_params.kernel_size,
-        conv_13_out, conv_dw_14_w, conv_dw_14_b, conv_dw_14_out, &conv_dw_14_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_14 = net_tensor(&net, conv_dw_14_params.I, conv_dw_14_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_14", conv_13, conv_dw_14, (elem_t *) conv_dw_14_w, (acc_t *) conv_dw_14_b,
+        &conv_dw_14_params);
 
     // conv_15
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_15_params.I, conv_15_params.J, conv_15_params.K,
-        conv_dw_14_out, conv_15_w, conv_15_b, conv_15_out,
-        NO_ACTIVATION, conv_15_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_15");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
-
-    // Add residuals
-    start = read_cycles();
-
-    resadd3(conv_15_params.I, conv_15_params.J,
-        conv_12_out,
-        conv_15_out,
-        conv_15_out,
-        false,
-        &conv_15_params
-    );
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
-    // conv_16
-    start = read_cycles();
+    const int conv_15 = net_tensor(&net, conv_15_params.I, conv_15_params.J, NULL);
+    net_conv(&net, "conv_15", conv_dw_14, conv_15, (elem_t *) conv_15_w, (acc_t *) conv_15_b, NO_ACTIVATION,
+        &conv_15_params, NULL);
 
-    tiled_matmul_nn_auto(conv_16_params.I, conv_16_params.J, conv_16_params.K,
-        conv_15_out, conv_16_w, conv_16_b, conv_16_out,
-        RELU, conv_16_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_16");
+    // Add residuals, in place
+    const int res_15 = net_tensor(&net, conv_15_params.I, conv_15_params.J, NULL);
+    net_resadd(&net, "res_15", conv_12, conv_15, res_15, false, &conv_15_params);
 
-    end = read_cycles();
-    matmul_cycles += end - start;
+    // conv_16
+    const int conv_16 = net_tensor(&net, conv_16_params.I, conv_16_params.J, NULL);
+    net_conv(&net, "conv_16", res_15, conv_16, (elem_t *) conv_16_w, (acc_t *) conv_16_b, RELU,
+        &conv_16_params, NULL);
 
     // conv_dw_17
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_16_params.I, conv_16_params.J, conv_dw_17_params.I, conv_dw_17_params.J,
-        conv_dw_17_params.batch_size, conv_dw_17_params.in_channels, conv_dw_17_params.out_dim, conv_dw_17_params.kernel_size,
-        conv_16_out, conv_dw_17_w, conv_dw_17_b, conv_dw_17_out, &conv_dw_17_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_17 = net_tensor(&net, conv_dw_17_params.I, conv_dw_17_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_17", conv_16, conv_dw_17, (elem_t *) conv_dw_17_w, (acc_t *) conv_dw_17_b,
+        &conv_dw_17_params);
 
     // conv_18
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_18_params.I, conv_18_params.J, conv_18_params.K,
-        conv_dw_17_out, conv_18_w, conv_18_b, conv_18_out,
-        NO_ACTIVATION, conv_18_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_18");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
-
-    // Add residuals
-    start = read_cycles();
-
-    resadd3(conv_18_params.I, conv_18_params.J,
-        conv_15_out,
-        conv_18_out,
-        conv_18_out,
-        false,
-        &conv_18_params
-    );
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
-    // conv_19
-    start = read_cycles();
+    const int conv_18 = net_tensor(&net, conv_18_params.I, conv_18_params.J, NULL);
+    net_conv(&net, "conv_18", conv_dw_17, conv_18, (elem_t *) conv_18_w, (acc_t *) conv_18_b, NO_ACTIVATION,
+        &conv_18_params, NULL);
 
-    tiled_matmul_nn_auto(conv_19_params.I, conv_19_params.J, conv_19_params.K,
-        conv_18_out, conv_19_w, conv_19_b, conv_19_out,
-        RELU, conv_19_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_19");
+    // Add residuals, in place
+    const int res_18 = net_tensor(&net, conv_18_params.I, conv_18_params.J, NULL);
+    net_resadd(&net, "res_18", res_15, conv_18, res_18, false, &conv_18_params);
 
-    end = read_cycles();
-    matmul_cycles += end - start;
+    // conv_19
+    const int conv_19 = net_tensor(&net, conv_19_params.I, conv_19_params.J, NULL);
+    net_conv(&net, "conv_19", res_18, conv_19, (elem_t *) conv_19_w, (acc_t *) conv_19_b, RELU,
+        &conv_19_params, NULL);
 
     // conv_dw_20
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_19_params.I, conv_19_params.J, conv_dw_20_params.I, conv_dw_20_params.J,
-        conv_dw_20_params.batch_size, conv_dw_20_params.in_channels, conv_dw_20_params.out_dim, conv_dw_20_params.kernel_size,
-        conv_19_out, conv_dw_20_w, conv_dw_20_b, conv_dw_20_out, &conv_dw_20_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_20 = net_tensor(&net, conv_dw_20_params.I, conv_dw_20_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_20", conv_19, conv_dw_20, (elem_t *) conv_dw_20_w, (acc_t *) conv_dw_20_b,
+        &conv_dw_20_params);
 
     // conv_21
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_21_params.I, conv_21_params.J, conv_21_params.K,
-        conv_dw_20_out, conv_21_w, conv_21_b, conv_21_out,
-        NO_ACTIVATION, conv_21_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_21");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_21 = net_tensor(&net, conv_21_params.I, conv_21_params.J, NULL);
+    net_conv(&net, "conv_21", conv_dw_20, conv_21, (elem_t *) conv_21_w, (acc_t *) conv_21_b, NO_ACTIVATION,
+        &conv_21_params, NULL);
 
     // conv_22
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_22_params.I, conv_22_params.J, conv_22_params.K,
-        conv_21_out, conv_22_w, conv_22_b, conv_22_out,
-        RELU, conv_22_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_22");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_22 = net_tensor(&net, conv_22_params.I, conv_22_params.J, NULL);
+    net_conv(&net, "conv_22", conv_21, conv_22, (elem_t *) conv_22_w, (acc_t *) conv_22_b, RELU,
+        &conv_22_params, NULL);
 
     // conv_dw_23
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_22_params.I, conv_22_params.J, conv_dw_23_params.I, conv_dw_23_params.J,
-        conv_dw_23_params.batch_size, conv_dw_23_params.in_channels, conv_dw_23_params.out_dim, conv_dw_23_params.kernel_size,
-        conv_22_out, conv_dw_23_w, conv_dw_23_b, conv_dw_23_out, &conv_dw_23_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_23 = net_tensor(&net, conv_dw_23_params.I, conv_dw_23_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_23", conv_22, conv_dw_23, (elem_t *) conv_dw_23_w, (acc_t *) conv_dw_23_b,
+        &conv_dw_23_params);
 
     // conv_24
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_24_params.I, conv_24_params.J, conv_24_params.K,
-        conv_dw_23_out, conv_24_w, conv_24_b, conv_24_out,
-        NO_ACTIVATION, conv_24_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_24");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
-
-    // Add residuals
-    start = read_cycles();
-
-    resadd3(conv_24_params.I, conv_24_params.J,
-        conv_21_out,
-        conv_24_out,
-        conv_24_out,
-        false,
-        &conv_24_params
-    );
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
-    // conv_25
-    start = read_cycles();
+    const int conv_24 = net_tensor(&net, conv_24_params.I, conv_24_params.J, NULL);
+    net_conv(&net, "conv_24", conv_dw_23, conv_24, (elem_t *) conv_24_w, (acc_t *) conv_24_b, NO_ACTIVATION,
+        &conv_24_params, NULL);
 
-    tiled_matmul_nn_auto(conv_25_params.I, conv_25_params.J, conv_25_params.K,
-        conv_24_out, conv_25_w, conv_25_b, conv_25_out,
-        RELU, conv_25_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_25");
+    // Add residuals, in place
+    const int res_24 = net_tensor(&net, conv_24_params.I, conv_24_params.J, NULL);
+    net_resadd(&net, "res_24", conv_21, conv_24, res_24, false, &conv_24_params);
 
-    end = read_cycles();
-    matmul_cycles += end - start;
+    // conv_25
+    const int conv_25 = net_tensor(&net, conv_25_params.I, conv_25_params.J, NULL);
+    net_conv(&net, "conv_25", res_24, conv_25, (elem_t *) conv_25_w, (acc_t *) conv_25_b, RELU,
+        &conv_25_params, NULL);
 
     // conv_dw_26
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_25_params.I, conv_25_params.J, conv_dw_26_params.I, conv_dw_26_params.J,
-        conv_dw_26_params.batch_size, conv_dw_26_params.in_channels, conv_dw_26_params.out_dim, conv_dw_26_params.kernel_size,
-        conv_25_out, conv_dw_26_w, conv_dw_26_b, conv_dw_26_out, &conv_dw_26_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_26 = net_tensor(&net, conv_dw_26_params.I, conv_dw_26_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_26", conv_25, conv_dw_26, (elem_t *) conv_dw_26_w, (acc_t *) conv_dw_26_b,
+        &conv_dw_26_params);
 
     // conv_27
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_27_params.I, conv_27_params.J, conv_27_params.K,
-        conv_dw_26_out, conv_27_w, conv_27_b, conv_27_out,
-        NO_ACTIVATION, conv_27_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_27");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
-
-    // Add residuals
-    start = read_cycles();
-
-    resadd3(conv_27_params.I, conv_27_params.J,
-        conv_24_out,
-        conv_27_out,
-        conv_27_out,
-        false,
-        &conv_27_params
-    );
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
-    // conv_28
-    start = read_cycles();
+    const int conv_27 = net_tensor(&net, conv_27_params.I, conv_27_params.J, NULL);
+    net_conv(&net, "conv_27", conv_dw_26, conv_27, (elem_t *) conv_27_w, (acc_t *) conv_27_b, NO_ACTIVATION,
+        &conv_27_params, NULL);
 
-    tiled_matmul_nn_auto(conv_28_params.I, conv_28_params.J, conv_28_params.K,
-        conv_27_out, conv_28_w, conv_28_b, conv_28_out,
-        RELU, conv_28_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_28");
+    // Add residuals, in place
+    const int res_27 = net_tensor(&net, conv_27_params.I, conv_27_params.J, NULL);
+    net_resadd(&net, "res_27", res_24, conv_27, res_27, false, &conv_27_params);
 
-    end = read_cycles();
-    matmul_cycles += end - start;
+    // conv_28
+    const int conv_28 = net_tensor(&net, conv_28_params.I, conv_28_params.J, NULL);
+    net_conv(&net, "conv_28", res_27, conv_28, (elem_t *) conv_28_w, (acc_t *) conv_28_b, RELU,
+        &conv_28_params, NULL);
 
     // conv_dw_29
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_28_params.I, conv_28_params.J, conv_dw_29_params.I, conv_dw_29_params.J,
-        conv_dw_29_params.batch_size, conv_dw_29_params.in_channels, conv_dw_29_params.out_dim, conv_dw_29_params.kernel_size,
-        conv_28_out, conv_dw_29_w, conv_dw_29_b, conv_dw_29_out, &conv_dw_29_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_29 = net_tensor(&net, conv_dw_29_params.I, conv_dw_29_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_29", conv_28, conv_dw_29, (elem_t *) conv_dw_29_w, (acc_t *) conv_dw_29_b,
+        &conv_dw_29_params);
 
     // conv_30
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_30_params.I, conv_30_params.J, conv_30_params.K,
-        conv_dw_29_out, conv_30_w, conv_30_b, conv_30_out,
-        NO_ACTIVATION, conv_30_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_30");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
-
-    // Add residuals
-    start = read_cycles();
-
-    resadd3(conv_30_params.I, conv_30_params.J,
-        conv_27_out,
-        conv_30_out,
-        conv_30_out,
-        false,
-        &conv_30_params
-    );
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
-    // conv_31
-    start = read_cycles();
+    const int conv_30 = net_tensor(&net, conv_30_params.I, conv_30_params.J, NULL);
+    net_conv(&net, "conv_30", conv_dw_29, conv_30, (elem_t *) conv_30_w, (acc_t *) conv_30_b, NO_ACTIVATION,
+        &conv_30_params, NULL);
 
-    tiled_matmul_nn_auto(conv_31_params.I, conv_31_params.J, conv_31_params.K,
-        conv_30_out, conv_31_w, conv_31_b, conv_31_out,
-        RELU, conv_31_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_31");
+    // Add residuals, in place
+    const int res_30 = net_tensor(&net, conv_30_params.I, conv_30_params.J, NULL);
+    net_resadd(&net, "res_30", res_27, conv_30, res_30, false, &conv_30_params);
 
-    end = read_cycles();
-    matmul_cycles += end - start;
+    // conv_31
+    const int conv_31 = net_tensor(&net, conv_31_params.I, conv_31_params.J, NULL);
+    net_conv(&net, "conv_31", res_30, conv_31, (elem_t *) conv_31_w, (acc_t *) conv_31_b, RELU,
+        &conv_31_params, NULL);
 
     // conv_dw_32
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_31_params.I, conv_31_params.J, conv_dw_32_params.I, conv_dw_32_params.J,
-        conv_dw_32_params.batch_size, conv_dw_32_params.in_channels, conv_dw_32_params.out_dim, conv_dw_32_params.kernel_size,
-        conv_31_out, conv_dw_32_w, conv_dw_32_b, conv_dw_32_out, &conv_dw_32_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_32 = net_tensor(&net, conv_dw_32_params.I, conv_dw_32_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_32", conv_31, conv_dw_32, (elem_t *) conv_dw_32_w, (acc_t *) conv_dw_32_b,
+        &conv_dw_32_params);
 
     // conv_33
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_33_params.I, conv_33_params.J, conv_33_params.K,
-        conv_dw_32_out, conv_33_w, conv_33_b, conv_33_out,
-        NO_ACTIVATION, conv_33_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_33");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_33 = net_tensor(&net, conv_33_params.I, conv_33_params.J, NULL);
+    net_conv(&net, "conv_33", conv_dw_32, conv_33, (elem_t *) conv_33_w, (acc_t *) conv_33_b, NO_ACTIVATION,
+        &conv_33_params, NULL);
 
     // conv_34
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_34_params.I, conv_34_params.J, conv_34_params.K,
-        conv_33_out, conv_34_w, conv_34_b, conv_34_out,
-        RELU, conv_34_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_34");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_34 = net_tensor(&net, conv_34_params.I, conv_34_params.J, NULL);
+    net_conv(&net, "conv_34", conv_33, conv_34, (elem_t *) conv_34_w, (acc_t *) conv_34_b, RELU,
+        &conv_34_params, NULL);
 
     // conv_dw_35
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_34_params.I, conv_34_params.J, conv_dw_35_params.I, conv_dw_35_params.J,
-        conv_dw_35_params.batch_size, conv_dw_35_params.in_channels, conv_dw_35_params.out_dim, conv_dw_35_params.kernel_size,
-        conv_34_out, conv_dw_35_w, conv_dw_35_b, conv_dw_35_out, &conv_dw_35_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_35 = net_tensor(&net, conv_dw_35_params.I, conv_dw_35_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_35", conv_34, conv_dw_35, (elem_t *) conv_dw_35_w, (acc_t *) conv_dw_35_b,
+        &conv_dw_35_params);
 
     // conv_36
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_36_params.I, conv_36_params.J, conv_36_params.K,
-        conv_dw_35_out, conv_36_w, conv_36_b, conv_36_out,
-        NO_ACTIVATION, conv_36_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_36");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
-
-    // Add residuals
-    start = read_cycles();
-
-    resadd3(conv_36_params.I, conv_36_params.J,
-        conv_33_out,
-        conv_36_out,
-        conv_36_out,
-        false,
-        &conv_36_params
-    );
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
-    // conv_37
-    start = read_cycles();
+    const int conv_36 = net_tensor(&net, conv_36_params.I, conv_36_params.J, NULL);
+    net_conv(&net, "conv_36", conv_dw_35, conv_36, (elem_t *) conv_36_w, (acc_t *) conv_36_b, NO_ACTIVATION,
+        &conv_36_params, NULL);
 
-    tiled_matmul_nn_auto(conv_37_params.I, conv_37_params.J, conv_37_params.K,
-        conv_36_out, conv_37_w, conv_37_b, conv_37_out,
-        RELU, conv_37_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_37");
+    // Add residuals, in place
+    const int res_36 = net_tensor(&net, conv_36_params.I, conv_36_params.J, NULL);
+    net_resadd(&net, "res_36", conv_33, conv_36, res_36, false, &conv_36_params);
 
-    end = read_cycles();
-    matmul_cycles += end - start;
+    // conv_37
+    const int conv_37 = net_tensor(&net, conv_37_params.I, conv_37_params.J, NULL);
+    net_conv(&net, "conv_37", res_36, conv_37, (elem_t *) conv_37_w, (acc_t *) conv_37_b, RELU,
+        &conv_37_params, NULL);
 
     // conv_dw_38
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_37_params.I, conv_37_params.J, conv_dw_38_params.I, conv_dw_38_params.J,
-        conv_dw_38_params.batch_size, conv_dw_38_params.in_channels, conv_dw_38_params.out_dim, conv_dw_38_params.kernel_size,
-        conv_37_out, conv_dw_38_w, conv_dw_38_b, conv_dw_38_out, &conv_dw_38_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_38 = net_tensor(&net, conv_dw_38_params.I, conv_dw_38_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_38", conv_37, conv_dw_38, (elem_t *) conv_dw_38_w, (acc_t *) conv_dw_38_b,
+        &conv_dw_38_params);
 
     // conv_39
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_39_params.I, conv_39_params.J, conv_39_params.K,
-        conv_dw_38_out, conv_39_w, conv_39_b, conv_39_out,
-        NO_ACTIVATION, conv_39_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_39");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
-
-    // Add residuals
-    start = read_cycles();
-
-    resadd3(conv_39_params.I, conv_39_params.J,
-        conv_36_out,
-        conv_39_out,
-        conv_39_out,
-        false,
-        &conv_39_params
-    );
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
-    // conv_40
-    start = read_cycles();
+    const int conv_39 = net_tensor(&net, conv_39_params.I, conv_39_params.J, NULL);
+    net_conv(&net, "conv_39", conv_dw_38, conv_39, (elem_t *) conv_39_w, (acc_t *) conv_39_b, NO_ACTIVATION,
+        &conv_39_params, NULL);
 
-    tiled_matmul_nn_auto(conv_40_params.I, conv_40_params.J, conv_40_params.K,
-        conv_39_out, conv_40_w, conv_40_b, conv_40_out,
-        RELU, conv_40_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_40");
+    // Add residuals, in place
+    const int res_39 = net_tensor(&net, conv_39_params.I, conv_39_params.J, NULL);
+    net_resadd(&net, "res_39", res_36, conv_39, res_39, false, &conv_39_params);
 
-    end = read_cycles();
-    matmul_cycles += end - start;
+    // conv_40
+    const int conv_40 = net_tensor(&net, conv_40_params.I, conv_40_params.J, NULL);
+    net_conv(&net, "conv_40", res_39, conv_40, (elem_t *) conv_40_w, (acc_t *) conv_40_b, RELU,
+        &conv_40_params, NULL);
 
     // conv_dw_41
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_40_params.I, conv_40_params.J, conv_dw_41_params.I, conv_dw_41_params.J,
-        conv_dw_41_params.batch_size, conv_dw_41_params.in_channels, conv_dw_41_params.out_dim, conv_dw_41_params.kernel_size,
-        conv_40_out, conv_dw_41_w, conv_dw_41_b, conv_dw_41_out, &conv_dw_41_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_41 = net_tensor(&net, conv_dw_41_params.I, conv_dw_41_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_41", conv_40, conv_dw_41, (elem_t *) conv_dw_41_w, (acc_t *) conv_dw_41_b,
+        &conv_dw_41_params);
 
     // conv_42
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_42_params.I, conv_42_params.J, conv_42_params.K,
-        conv_dw_41_out, conv_42_w, conv_42_b, conv_42_out,
-        NO_ACTIVATION, conv_42_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_42");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_42 = net_tensor(&net, conv_42_params.I, conv_42_params.J, NULL);
+    net_conv(&net, "conv_42", conv_dw_41, conv_42, (elem_t *) conv_42_w, (acc_t *) conv_42_b, NO_ACTIVATION,
+        &conv_42_params, NULL);
 
     // conv_43
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_43_params.I, conv_43_params.J, conv_43_params.K,
-        conv_42_out, conv_43_w, conv_43_b, conv_43_out,
-        RELU, conv_43_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_43");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_43 = net_tensor(&net, conv_43_params.I, conv_43_params.J, NULL);
+    net_conv(&net, "conv_43", conv_42, conv_43, (elem_t *) conv_43_w, (acc_t *) conv_43_b, RELU,
+        &conv_43_params, NULL);
 
     // conv_dw_44
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_43_params.I, conv_43_params.J, conv_dw_44_params.I, conv_dw_44_params.J,
-        conv_dw_44_params.batch_size, conv_dw_44_params.in_channels, conv_dw_44_params.out_dim, conv_dw_44_params.kernel_size,
-        conv_43_out, conv_dw_44_w, conv_dw_44_b, conv_dw_44_out, &conv_dw_44_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_44 = net_tensor(&net, conv_dw_44_params.I, conv_dw_44_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_44", conv_43, conv_dw_44, (elem_t *) conv_dw_44_w, (acc_t *) conv_dw_44_b,
+        &conv_dw_44_params);
 
     // conv_45
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_45_params.I, conv_45_params.J, conv_45_params.K,
-        conv_dw_44_out, conv_45_w, conv_45_b, conv_45_out,
-        NO_ACTIVATION, conv_45_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_45");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
-
-    // Add residuals
-    start = read_cycles();
-
-    resadd3(conv_45_params.I, conv_45_params.J,
-        conv_42_out,
-        conv_45_out,
-        conv_45_out,
-        false,
-        &conv_45_params
-    );
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
-    // conv_46
-    start = read_cycles();
+    const int conv_45 = net_tensor(&net, conv_45_params.I, conv_45_params.J, NULL);
+    net_conv(&net, "conv_45", conv_dw_44, conv_45, (elem_t *) conv_45_w, (acc_t *) conv_45_b, NO_ACTIVATION,
+        &conv_45_params, NULL);
 
-    tiled_matmul_nn_auto(conv_46_params.I, conv_46_params.J, conv_46_params.K,
-        conv_45_out, conv_46_w, conv_46_b, conv_46_out,
-        RELU, conv_46_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_46");
+    // Add residuals, in place
+    const int res_45 = net_tensor(&net, conv_45_params.I, conv_45_params.J, NULL);
+    net_resadd(&net, "res_45", conv_42, conv_45, res_45, false, &conv_45_params);
 
-    end = read_cycles();
-    matmul_cycles += end - start;
+    // conv_46
+    const int conv_46 = net_tensor(&net, conv_46_params.I, conv_46_params.J, NULL);
+    net_conv(&net, "conv_46", res_45, conv_46, (elem_t *) conv_46_w, (acc_t *) conv_46_b, RELU,
+        &conv_46_params, NULL);
 
     // conv_dw_47
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_46_params.I, conv_46_params.J, conv_dw_47_params.I, conv_dw_47_params.J,
-        conv_dw_47_params.batch_size, conv_dw_47_params.in_channels, conv_dw_47_params.out_dim, conv_dw_47_params.kernel_size,
-        conv_46_out, conv_dw_47_w, conv_dw_47_b, conv_dw_47_out, &conv_dw_47_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_47 = net_tensor(&net, conv_dw_47_params.I, conv_dw_47_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_47", conv_46, conv_dw_47, (elem_t *) conv_dw_47_w, (acc_t *) conv_dw_47_b,
+        &conv_dw_47_params);
 
     // conv_48
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_48_params.I, conv_48_params.J, conv_48_params.K,
-        conv_dw_47_out, conv_48_w, conv_48_b, conv_48_out,
-        NO_ACTIVATION, conv_48_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_48");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
-
-    // Add residuals
-    start = read_cycles();
-
-    resadd3(conv_48_params.I, conv_48_params.J,
-        conv_45_out,
-        conv_48_out,
-        conv_48_out,
-        false,
-        &conv_48_params
-    );
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
-    // conv_49
-    start = read_cycles();
+    const int conv_48 = net_tensor(&net, conv_48_params.I, conv_48_params.J, NULL);
+    net_conv(&net, "conv_48", conv_dw_47, conv_48, (elem_t *) conv_48_w, (acc_t *) conv_48_b, NO_ACTIVATION,
+        &conv_48_params, NULL);
 
-    tiled_matmul_nn_auto(conv_49_params.I, conv_49_params.J, conv_49_params.K,
-        conv_48_out, conv_49_w, conv_49_b, conv_49_out,
-        RELU, conv_49_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_49");
+    // Add residuals, in place
+    const int res_48 = net_tensor(&net, conv_48_params.I, conv_48_params.J, NULL);
+    net_resadd(&net, "res_48", res_45, conv_48, res_48, false, &conv_48_params);
 
-    end = read_cycles();
-    matmul_cycles += end - start;
+    // conv_49
+    const int conv_49 = net_tensor(&net, conv_49_params.I, conv_49_params.J, NULL);
+    net_conv(&net, "conv_49", res_48, conv_49, (elem_t *) conv_49_w, (acc_t *) conv_49_b, RELU,
+        &conv_49_params, NULL);
 
     // conv_dw_50
-    start = read_cycles();
-
-    conv_dw_with_col2im(conv_49_params.I, conv_49_params.J, conv_dw_50_params.I, conv_dw_50_params.J,
-        conv_dw_50_params.batch_size, conv_dw_50_params.in_channels, conv_dw_50_params.out_dim, conv_dw_50_params.kernel_size,
-        conv_49_out, conv_dw_50_w, conv_dw_50_b, conv_dw_50_out, &conv_dw_50_params);
-
-    end = read_cycles();
-    conv_dw_cycles += end - start;
+    const int conv_dw_50 = net_tensor(&net, conv_dw_50_params.I, conv_dw_50_params.J, NULL);
+    net_conv_dw(&net, "conv_dw_50", conv_49, conv_dw_50, (elem_t *) conv_dw_50_w, (acc_t *) conv_dw_50_b,
+        &conv_dw_50_params);
 
     // conv_51
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_51_params.I, conv_51_params.J, conv_51_params.K,
-        conv_dw_50_out, conv_51_w, conv_51_b, conv_51_out,
-        NO_ACTIVATION, conv_51_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_51");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_51 = net_tensor(&net, conv_51_params.I, conv_51_params.J, NULL);
+    net_conv(&net, "conv_51", conv_dw_50, conv_51, (elem_t *) conv_51_w, (acc_t *) conv_51_b, NO_ACTIVATION,
+        &conv_51_params, NULL);
 
     // conv_52
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(conv_52_params.I, conv_52_params.J, conv_52_params.K,
-        conv_51_out, conv_52_w, conv_52_b, conv_52_out,
-        RELU, conv_52_params.output_scale, 0, true,
-        tiled_matmul_type, check, "conv_52");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int conv_52 = net_tensor(&net, conv_52_params.I, conv_52_params.J, NULL);
+    net_conv(&net, "conv_52", conv_51, conv_52, (elem_t *) conv_52_w, (acc_t *) conv_52_b, RELU,
+        &conv_52_params, NULL);
 
     // Global averaging
-    static elem_t average[1280][64] row_align(1);
-
-    start = read_cycles();
-
-    for (int batch = 0; batch < conv_52_params.batch_size; batch++) {
-        for (int channel = 0; channel < conv_52_params.out_channels; channel++) {
-            int sum = 0;
-            for (int row = 0; row < conv_52_params.out_dim; row++) {
-                for (int col = 0; col < conv_52_params.out_dim; col++) {
-                    size_t r = batch * conv_52_params.out_dim * conv_52_params.out_dim + row * conv_52_params.out_dim + col;
-
-                    sum += conv_52_out[r][channel];
-                }
-            }
-            const int count = conv_52_params.out_dim * conv_52_params.out_dim;
-
-            average[channel][batch] = (sum + count/2) / count;
-        }
-    }
-
-    end = read_cycles();
-    other_cycles += end - start;
+    const int avg = net_tensor(&net, fc_53_params.K, fc_53_params.J, NULL);
+    net_avgpool(&net, "average", conv_52, avg, &conv_52_params);
 
     // fc_53
-    start = read_cycles();
-
-    tiled_matmul_nn_auto(fc_53_params.I, fc_53_params.J, fc_53_params.K,
-        fc_53_w, average, fc_53_b, fc_53_out,
-        NO_ACTIVATION, fc_53_params.output_scale, 0, false,
-        tiled_matmul_type, check, "fc_53");
-
-    end = read_cycles();
-    matmul_cycles += end - start;
+    const int fc_53 = net_tensor(&net, fc_53_params.I, fc_53_params.J, (elem_t *) fc_53_out);
+    net_fc(&net, "fc_53", avg, fc_53, (elem_t *) fc_53_w, (acc_t *) fc_53_b, NO_ACTIVATION,
+        &fc_53_params);
+
+    if (pipelined) {
+        // Every item reads the same images, and the last stage writes their
+        // outputs in order, so fc_53_out ends up holding the last one's
+        static struct net_pipeline_t pipeline;
+        net_pipeline_init(&pipeline, &net, PIPELINE_ITEMS, PIPELINE_STAGES, PIPELINE_DEPTH,
+            tiled_matmul_type, check);
+        net_pipeline_run(&pipeline, 0, 1);
+    } else {
+        net_run(&net, tiled_matmul_type, check);
+    }
 
     // Find highest probs
     int preds[fc_53_params.batch_size];
@@ -808,15 +425,7 @@ int main (int argc, char * argv[]) {
         preds[batch] = max_idx;
     }
 
-    uint64_t total_cycles = im2col_cycles + matmul_cycles + pool_cycles + conv_dw_cycles + res_add_cycles + other_cycles;
-
-    printf("\nTotal cycles: %llu\n", total_cycles);
-    printf("Matmul cycles: %llu\n", matmul_cycles);
-    printf("Im2col cycles: %llu\n", im2col_cycles);
-    printf("Pooling cycles: %llu\n", pool_cycles);
-    printf("Depthwise convolution cycles: %llu\n", conv_dw_cycles);
-    printf("Other cycles: %llu\n", other_cycles);
-
+    net_print_cycles(&net);
 
     int correct[] = {553, 233, 43, 523};
     for (int i = 0; i < fc_53_params.batch_size; i++) {
@@ -8,8 +8,27 @@
 #include <math.h>
 #include <limits.h>
 #include <stdbool.h>
+#ifdef GEMMINI_HOST_EMU
+#include <time.h>
+#endif
+
+// pthreads are only available on Linux
+#if defined(BAREMETAL) || !defined(GEMMINI_CPU_THREADS)
+#undef GEMMINI_CPU_THREADS
+#define GEMMINI_CPU_THREADS 1
+#endif
+
+#if GEMMINI_CPU_THREADS > 1
+#include <pthread.h>
+#endif
+
+#if defined(GEMMINI_PROFILE) || defined(GEMMINI_TRACE)
+#include <stdio.h>
+#include <string.h>
+#endif
 
 #include "include/gemmini_params.h"
+#include "include/gemmini_pack.h"
 
 // #define GEMMINI_ASSERTIONS
 
@@ -277,9 +296,16 @@ int rand() {
 }
 
 uint64_t read_cycles() {
+#ifdef GEMMINI_HOST_EMU
+    // There is no rdcycle on the host, so we count nanoseconds instead
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
     uint64_t cycles;
     asm volatile ("rdcycle %0" : "=r" (cycles));
     return cycles;
+#endif
 
     // const uint32_t * mtime = (uint32_t *)(33554432 + 0xbff8);
     // const uint32_t * mtime = (uint32_t *)(33554432 + 0xbffc);
@@ -287,7 +313,9 @@ uint64_t read_cycles() {
 }
 
 // Accelerator interface
+#ifndef GEMMINI_HOST_EMU
 #include "rocc-software/src/xcustom.h"
+#endif
 
 #define k_CONFIG 0
 #define k_MVIN 2
@@ -312,8 +340,101 @@ uint64_t read_cycles() {
 #define RELU 1
 #define RELU6 2
 
-#define ROCC_INSTRUCTION_RS1_RS2(x, rs1, rs2, funct) \
+#ifdef GEMMINI_HOST_EMU
+#include "include/gemmini_emu.h"
+
+#define ROCC_INSTRUCTION_ISSUE(x, rs1, rs2, funct) \
+  gemmini_emu_exec((uint64_t)(rs1), (uint64_t)(rs2), funct)
+#else
+#define ROCC_INSTRUCTION_ISSUE(x, rs1, rs2, funct) \
   ROCC_INSTRUCTION_0_R_R(x, rs1, rs2, funct, 10, 11)
+#endif
+
+// Command graphs
+//
+// The commands which a fixed sequence of matmuls sends to Gemmini are the
+// same every time, apart from the addresses of the matrices. Instead of
+// recomputing them with the tiling loops on every run, they can be recorded
+// into a gemmini_graph_t once, and then replayed with a single tight loop.
+//
+// mvins and mvouts which point into one of the graph's registered buffers are
+// stored relative to that buffer, so a graph can be replayed on different
+// matrices of the same shapes by passing in new base addresses.
+//
+// Graphs are only available when GEMMINI_GRAPHS is defined. Otherwise,
+// instructions are issued without checking whether they're being recorded.
+#ifdef GEMMINI_GRAPHS
+
+#define GEMMINI_GRAPH_MAX_BUFFERS 8
+
+// Pseudo-funct used to record a fence
+#define GEMMINI_GRAPH_FENCE 0xFF
+
+struct gemmini_cmd_t {
+  uint64_t rs1, rs2;
+  uint8_t funct;
+  int8_t buffer; // Buffer which rs1 is an offset into, or -1 if it's absolute
+};
+
+struct gemmini_graph_t {
+  struct gemmini_cmd_t * cmds;
+  size_t len, capacity;
+
+  size_t n_buffers;
+  uintptr_t buffer_base[GEMMINI_GRAPH_MAX_BUFFERS];
+  size_t buffer_size[GEMMINI_GRAPH_MAX_BUFFERS];
+};
+
+// While this is set, Gemmini instructions are appended to it instead of
+// being issued
+static struct gemmini_graph_t * gemmini_graph_recording = NULL;
+
+static void gemmini_graph_push(uint64_t rs1, uint64_t rs2, uint8_t funct) {
+  struct gemmini_graph_t * g = gemmini_graph_recording;
+
+  if (g->len == g->capacity) {
+    printf("Gemmini graph is out of space (%zu commands)\n", g->capacity);
+    exit(1);
+  }
+
+  struct gemmini_cmd_t * cmd = &g->cmds[g->len++];
+  cmd->rs1 = rs1;
+  cmd->rs2 = rs2;
+  cmd->funct = funct;
+  cmd->buffer = -1;
+
+  if (funct == k_MVIN || funct == k_MVOUT) {
+    for (size_t b = 0; b < g->n_buffers; b++) {
+      if (rs1 >= g->buffer_base[b] && rs1 < g->buffer_base[b] + g->buffer_size[b]) {
+        cmd->rs1 = rs1 - g->buffer_base[b];
+        cmd->buffer = b;
+        break;
+      }
+    }
+  }
+}
+
+#define ROCC_INSTRUCTION_RS1_RS2(x, rs1, rs2, funct) \
+  do { \
+    if (gemmini_graph_recording != NULL) \
+      gemmini_graph_push((uint64_t)(rs1), (uint64_t)(rs2), funct); \
+    else { \
+      gemmini_profile_count((uint64_t)(rs1), (uint64_t)(rs2), funct); \
+      gemmini_trace_record((uint64_t)(rs1), (uint64_t)(rs2), funct); \
+      ROCC_INSTRUCTION_ISSUE(x, rs1, rs2, funct); \
+    } \
+  } while (0)
+
+#else
+
+#define ROCC_INSTRUCTION_RS1_RS2(x, rs1, rs2, funct) \
+  do { \
+    gemmini_profile_count((uint64_t)(rs1), (uint64_t)(rs2), funct); \
+    gemmini_trace_record((uint64_t)(rs1), (uint64_t)(rs2), funct); \
+    ROCC_INSTRUCTION_ISSUE(x, rs1, rs2, funct); \
+  } while (0)
+
+#endif
 
 // mvin and mvout
 #define gemmini_extended_mvin(dram_addr, spad_addr, cols, rows) \
@@ -354,9 +475,13 @@ uint64_t read_cycles() {
 #define gemmini_preload_zeros(C) \
   gemmini_preload(GARBAGE_ADDR, C)
 
-// weight-stationary matmul loop
-// #define gemmini_loop_ws(A, B, I, J, K, bias) \
-    // ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(B) << 32) | (A), ((uint64_t)(bias) << 48) | ((uint64_t)(K) << 32) | ((J) << 16) | (I), k_LOOP_WS)
+// weight-stationary matmul loop, which the hardware unrolls into the preloads
+// and computes of an unpadded tile (see sp_tiled_matmul_ws_compute). A and B
+// are scratchpad addresses, and C_offset is the offset of C from the start of
+// the accumulator, in DIM x DIM blocks. Only hardware which defines
+// GEMMINI_HAS_LOOP_WS supports it.
+#define gemmini_loop_ws(A, B, I, J, K, bias, C_offset) \
+  ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(B) << 32) | (A), ((uint64_t)(C_offset) << 49) | ((uint64_t)(bias) << 48) | ((uint64_t)(K) << 32) | ((J) << 16) | (I), k_LOOP_WS)
 
 // config
 
@@ -385,26 +510,465 @@ uint64_t read_cycles() {
 #define gemmini_config_st(stride) \
   gemmini_config_st_precision_bits(stride, (precision_bits_of(sizeof(elem_t) * 8)))
 
+// Packed matrices (see gemmini_pack.h)
+
+// Precision, in bits, which a config_ld or config_st's rs1 sets
+#define config_ld_st_precision(rs1) (1 << (((rs1) >> 2) & 7))
+
+// The most blocks of DIM elements which one mvin can move at "precision" bits
+#define max_block_len_of(precision) (MAX_BYTES * 8 / (DIM * (precision)))
+
+// Address of element (row, col) of a packed matrix whose rows are row_len
+// elements long. col must be a multiple of DIM.
+static elem_t * packed_addr(const elem_t * base, size_t row, size_t col,
+        size_t row_len, int precision) {
+  return (elem_t *)((uintptr_t)base + row * packed_bytes(row_len, precision) +
+      col * precision / 8);
+}
+
 // flush
 #define gemmini_flush(skip) \
   ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, skip, 0, k_FLUSH)
 
 // fence
-#define gemmini_fence() asm volatile("fence")
+#ifdef GEMMINI_HOST_EMU
+#define gemmini_fence_issue() gemmini_emu_fence()
+#else
+#define gemmini_fence_issue() asm volatile("fence")
+#endif
+
+#ifdef GEMMINI_GRAPHS
+#define gemmini_fence() \
+  do { \
+    if (gemmini_graph_recording != NULL) \
+      gemmini_graph_push(0, 0, GEMMINI_GRAPH_FENCE); \
+    else \
+      gemmini_fence_issue(); \
+  } while (0)
+#else
+#define gemmini_fence() gemmini_fence_issue()
+#endif
+
+// Profiling
+//
+// When GEMMINI_PROFILE is defined, every instruction issued to Gemmini is
+// counted, and attributed to the layer between the innermost enclosing
+// gemmini_profile_begin() and gemmini_profile_end(). Layers with the same
+// name share a row. Nested layers are counted as part of the outermost one,
+// so a network's layers can be profiled as a whole while the matmuls inside
+// them are still named when they are run on their own.
+//
+// gemmini_profile_end() waits for Gemmini to finish, so each layer's cycles
+// include the time to drain it, and one layer's instructions are never
+// overlapped with the next one's. The counters aren't shared between harts,
+// so only one hart should profile at a time.
+//
+// gemmini_profile_dump() prints the rows as CSV (to GEMMINI_PROFILE_FILE on
+// Linux, if it's defined). It runs at exit on Linux, and must be called by
+// hand on bare metal. "utilization" is the percentage of the DIM*DIM
+// multiply-accumulates per cycle which the layer's computes used.
+#ifdef GEMMINI_PROFILE
+
+#ifndef GEMMINI_PROFILE_MAX_LAYERS
+#define GEMMINI_PROFILE_MAX_LAYERS 256
+#endif
+
+#if defined(GEMMINI_PROFILE_FILE) && !defined(BAREMETAL)
+#define GEMMINI_PROFILE_PRINTF(...) fprintf(f, __VA_ARGS__)
+#else
+#define GEMMINI_PROFILE_PRINTF(...) printf(__VA_ARGS__)
+#endif
+
+struct gemmini_profile_counters_t {
+  uint64_t calls, cycles;
+  uint64_t mvins, mvouts, preloads, computes, loops, configs;
+  uint64_t bytes_in, bytes_out, macs;
+};
+
+struct gemmini_profile_state_t {
+  // Row 0 holds the instructions issued outside of any layer
+  const char * names[GEMMINI_PROFILE_MAX_LAYERS + 1];
+  struct gemmini_profile_counters_t rows[GEMMINI_PROFILE_MAX_LAYERS + 1];
+  size_t n_rows;
+
+  size_t current, depth;
+  uint64_t start;
+
+  // Columns of the output which the most recent preload set up
+  size_t preload_cols;
+
+  // Precision of the elements which mvins and mvouts move, from the most
+  // recent config_ld and config_st
+  int load_bits, store_bits;
+
+  bool registered;
+};
+
+static struct gemmini_profile_state_t gemmini_profile_state = {
+  .names = {"(outside layers)"},
+  .n_rows = 1,
+  .load_bits = ELEM_T_BITS,
+  .store_bits = ELEM_T_BITS,
+};
+
+static void gemmini_profile_count(uint64_t rs1, uint64_t rs2, int funct) {
+  struct gemmini_profile_state_t * s = &gemmini_profile_state;
+  struct gemmini_profile_counters_t * c = &s->rows[s->current];
+
+  const size_t rs1_cols = (rs1 >> ADDR_LEN) & 0xFFFF;
+  const size_t rs1_rows = (rs1 >> (ADDR_LEN + 16)) & 0xFFFF;
+  const size_t rs2_cols = (rs2 >> ADDR_LEN) & 0xFFFF;
+  const size_t rs2_rows = (rs2 >> (ADDR_LEN + 16)) & 0xFFFF;
+  const bool rs2_acc = (rs2 >> (ADDR_LEN-1)) & 1;
+
+  switch (funct) {
+    case k_CONFIG:
+      c->configs++;
+      if ((rs1 & 3) == CONFIG_LD)
+        s->load_bits = config_ld_st_precision(rs1);
+      else if ((rs1 & 3) == CONFIG_ST)
+        s->store_bits = config_ld_st_precision(rs1);
+      break;
+    case k_MVIN:
+      // Only biases are moved straight into the accumulator
+      c->mvins++;
+      c->bytes_in += rs2_rows * (rs2_acc ? rs2_cols * sizeof(acc_t) :
+          packed_bytes(rs2_cols, s->load_bits));
+      break;
+    case k_MVOUT:
+      c->mvouts++;
+      c->bytes_out += rs2_rows * packed_bytes(rs2_cols, s->store_bits);
+      break;
+    case k_PRELOAD:
+      c->preloads++;
+      s->preload_cols = rs2_cols;
+      break;
+    case k_COMPUTE_PRELOADED:
+    case k_COMPUTE_ACCUMULATE:
+      c->computes++;
+      c->macs += (uint64_t)rs1_rows * rs1_cols * s->preload_cols;
+      break;
+    case k_LOOP_WS: {
+      // I, J and K are counted in DIMxDIM blocks
+      const uint64_t blocks = (rs2 & 0xFFFF) * ((rs2 >> 16) & 0xFFFF) * ((rs2 >> 32) & 0xFFFF);
+      c->loops++;
+      c->macs += blocks * DIM * DIM * DIM;
+      break;
+    }
+  }
+}
+
+static void gemmini_profile_dump() {
+  const struct gemmini_profile_state_t * s = &gemmini_profile_state;
+
+#if defined(GEMMINI_PROFILE_FILE) && !defined(BAREMETAL)
+  FILE * f = fopen(GEMMINI_PROFILE_FILE, "w");
+  if (f == NULL) {
+    perror("Couldn't open " GEMMINI_PROFILE_FILE);
+    return;
+  }
+#endif
+
+  GEMMINI_PROFILE_PRINTF("layer,calls,cycles,mvins,mvouts,preloads,computes,loops,configs,bytes_in,bytes_out,macs,utilization\n");
+
+  for (size_t r = 0; r < s->n_rows; r++) {
+    const struct gemmini_profile_counters_t * c = &s->rows[r];
+    if (r == 0 && c->mvins + c->mvouts + c->preloads + c->computes + c->loops + c->configs == 0)
+      continue;
+
+    const uint64_t utilization = c->cycles == 0 ? 0 : c->macs * 10000 / (c->cycles * DIM * DIM);
+
+    GEMMINI_PROFILE_PRINTF("%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu.%02llu\n",
+        s->names[r], (unsigned long long)c->calls, (unsigned long long)c->cycles,
+        (unsigned long long)c->mvins, (unsigned long long)c->mvouts,
+        (unsigned long long)c->preloads, (unsigned long long)c->computes,
+        (unsigned long long)c->loops, (unsigned long long)c->configs,
+        (unsigned long long)c->bytes_in, (unsigned long long)c->bytes_out,
+        (unsigned long long)c->macs,
+        (unsigned long long)(utilization / 100), (unsigned long long)(utilization % 100));
+  }
+
+#if defined(GEMMINI_PROFILE_FILE) && !defined(BAREMETAL)
+  fclose(f);
+#endif
+}
+
+static void gemmini_profile_begin(const char * name) {
+  struct gemmini_profile_state_t * s = &gemmini_profile_state;
+
+#ifndef BAREMETAL
+  if (!s->registered) {
+    atexit(gemmini_profile_dump);
+    s->registered = true;
+  }
+#endif
+
+  if (s->depth++ > 0)
+    return;
+
+  size_t row = 1;
+  while (row < s->n_rows && strcmp(s->names[row], name) != 0)
+    row++;
+
+  if (row == s->n_rows) {
+    if (s->n_rows == GEMMINI_PROFILE_MAX_LAYERS + 1) {
+      printf("Can't profile more than %d layers\n", GEMMINI_PROFILE_MAX_LAYERS);
+      exit(1);
+    }
+
+    s->names[s->n_rows++] = name;
+  }
+
+  s->current = row;
+  s->rows[row].calls++;
+  s->start = read_cycles();
+}
+
+static void gemmini_profile_end() {
+  struct gemmini_profile_state_t * s = &gemmini_profile_state;
+
+  if (--s->depth > 0)
+    return;
+
+  gemmini_fence();
+  s->rows[s->current].cycles += read_cycles() - s->start;
+  s->current = 0;
+}
+
+#else
+#define gemmini_profile_count(rs1, rs2, funct) ((void)0)
+#define gemmini_profile_begin(name) ((void)0)
+#define gemmini_profile_end() ((void)0)
+#define gemmini_profile_dump() ((void)0)
+#endif
+
+// Tracing
+//
+// When GEMMINI_TRACE is defined, the last GEMMINI_TRACE_ENTRIES instructions
+// issued to Gemmini are kept in a ring buffer, together with markers which
+// name the matrices that each tiled matmul reads and writes.
+// gemmini_trace_dump() prints them as "gemmini_trace ..." lines, which
+// tools/gemmini_trace_summary.c turns into a summary of how often each
+// matrix's tiles are moved in again, and how far apart the reloads are.
+#ifdef GEMMINI_TRACE
+
+#ifndef GEMMINI_TRACE_ENTRIES
+#define GEMMINI_TRACE_ENTRIES 8192
+#endif
+
+// Pseudo-funct of the entries which name a matrix
+#define GEMMINI_TRACE_MATRIX 0xFE
+
+struct gemmini_trace_entry_t {
+  uint64_t rs1, rs2;
+  uint8_t funct;
+  char name;
+};
+
+struct gemmini_trace_state_t {
+  struct gemmini_trace_entry_t entries[GEMMINI_TRACE_ENTRIES];
+  uint64_t n_entries; // Including the ones which have been overwritten
+};
+
+static struct gemmini_trace_state_t gemmini_trace_state;
+
+static void gemmini_trace_push(uint64_t rs1, uint64_t rs2, uint8_t funct, char name) {
+  struct gemmini_trace_state_t * s = &gemmini_trace_state;
+  struct gemmini_trace_entry_t * e = &s->entries[s->n_entries++ % GEMMINI_TRACE_ENTRIES];
+  e->rs1 = rs1;
+  e->rs2 = rs2;
+  e->funct = funct;
+  e->name = name;
+}
+
+#define gemmini_trace_record(rs1, rs2, funct) gemmini_trace_push(rs1, rs2, funct, 0)
+
+// Names the "bytes" bytes at "addr" until they are named again
+#define gemmini_trace_matrix(name, addr, bytes) \
+  gemmini_trace_push((uintptr_t)(addr), bytes, GEMMINI_TRACE_MATRIX, name)
+
+// Prints a scratchpad operand, and for mvins and mvouts, the number of bytes
+// it moves when its elements are "bits" wide
+static void gemmini_trace_print_operand(const char * name, uint64_t operand, int funct,
+        int bits) {
+  const uint32_t addr = operand & ((1ULL << ADDR_LEN) - 1);
+  const bool acc = (addr >> (ADDR_LEN-1)) & 1;
+  const size_t cols = (operand >> ADDR_LEN) & 0xFFFF;
+  const size_t rows = (operand >> (ADDR_LEN + 16)) & 0xFFFF;
+
+  printf(" %s=0x%x rows=%zu cols=%zu", name, addr, rows, cols);
+
+  // mvins into the accumulator move acc_t's, and everything else elem_t's
+  if (funct == k_MVIN || funct == k_MVOUT)
+    printf(" bytes=%zu", rows * (funct == k_MVIN && acc ? cols * sizeof(acc_t) :
+          packed_bytes(cols, bits)));
+}
+
+static void gemmini_trace_dump() {
+  const struct gemmini_trace_state_t * s = &gemmini_trace_state;
+  const uint64_t first = s->n_entries > GEMMINI_TRACE_ENTRIES ? s->n_entries - GEMMINI_TRACE_ENTRIES : 0;
+  int load_bits = ELEM_T_BITS, store_bits = ELEM_T_BITS;
+
+  printf("gemmini_trace begin dim=%d addr_len=%d sp_bytes=%zu acc_bytes=%zu dropped=%llu\n",
+      DIM, ADDR_LEN, (size_t)BANK_NUM * BANK_ROWS * DIM * sizeof(elem_t),
+      (size_t)ACC_ROWS * DIM * sizeof(acc_t), (unsigned long long)first);
+
+  for (uint64_t i = first; i < s->n_entries; i++) {
+    const struct gemmini_trace_entry_t * e = &s->entries[i % GEMMINI_TRACE_ENTRIES];
+
+    switch (e->funct) {
+      case GEMMINI_TRACE_MATRIX:
+        printf("gemmini_trace matrix name=%c addr=0x%llx bytes=%llu\n",
+            e->name, (unsigned long long)e->rs1, (unsigned long long)e->rs2);
+        break;
+      case k_MVIN:
+      case k_MVOUT:
+        printf("gemmini_trace %s dram=0x%llx", e->funct == k_MVIN ? "mvin" : "mvout",
+            (unsigned long long)e->rs1);
+        gemmini_trace_print_operand("spad", e->rs2, e->funct,
+            e->funct == k_MVIN ? load_bits : store_bits);
+        printf("\n");
+        break;
+      case k_PRELOAD:
+      case k_COMPUTE_PRELOADED:
+      case k_COMPUTE_ACCUMULATE:
+        printf("gemmini_trace %s", e->funct == k_PRELOAD ? "preload" :
+            e->funct == k_COMPUTE_PRELOADED ? "compute_preloaded" : "compute_accumulated");
+        gemmini_trace_print_operand("rs1", e->rs1, e->funct, ELEM_T_BITS);
+        gemmini_trace_print_operand("rs2", e->rs2, e->funct, ELEM_T_BITS);
+        printf("\n");
+        break;
+      default:
+        if (e->funct == k_CONFIG && (e->rs1 & 3) == CONFIG_LD)
+          load_bits = config_ld_st_precision(e->rs1);
+        else if (e->funct == k_CONFIG && (e->rs1 & 3) == CONFIG_ST)
+          store_bits = config_ld_st_precision(e->rs1);
+
+        printf("gemmini_trace %s rs1=0x%llx rs2=0x%llx\n",
+            e->funct == k_CONFIG ? "config" : e->funct == k_FLUSH ? "flush" :
+            e->funct == k_LOOP_WS ? "loop_ws" : "unknown",
+            (unsigned long long)e->rs1, (unsigned long long)e->rs2);
+    }
+  }
+
+  printf("gemmini_trace end\n");
+}
+
+#else
+#define gemmini_trace_record(rs1, rs2, funct) ((void)0)
+#define gemmini_trace_matrix(name, addr, bytes) ((void)0)
+#define gemmini_trace_dump() ((void)0)
+#endif
+
+#ifdef GEMMINI_GRAPHS
+
+// Prepares a graph which records into the caller-provided cmds array
+static void gemmini_graph_init(struct gemmini_graph_t * g,
+        struct gemmini_cmd_t * cmds, size_t capacity) {
+  g->cmds = cmds;
+  g->len = 0;
+  g->capacity = capacity;
+  g->n_buffers = 0;
+}
+
+// Registers a buffer which the graph's mvins and mvouts may be relocated
+// from. Returns the buffer's index in the bases passed to gemmini_graph_replay.
+static size_t gemmini_graph_buffer(struct gemmini_graph_t * g,
+        const void * base, size_t size) {
+  if (g->n_buffers == GEMMINI_GRAPH_MAX_BUFFERS) {
+    printf("Gemmini graph has too many buffers\n");
+    exit(1);
+  }
+
+  g->buffer_base[g->n_buffers] = (uintptr_t)base;
+  g->buffer_size[g->n_buffers] = size;
+  return g->n_buffers++;
+}
+
+// Commands issued between gemmini_graph_begin and gemmini_graph_end are
+// recorded into the graph, without being run
+static void gemmini_graph_begin(struct gemmini_graph_t * g) {
+  gemmini_graph_recording = g;
+}
+
+static void gemmini_graph_end() {
+  gemmini_graph_recording = NULL;
+}
+
+// Issues every command in the graph. If bases isn't NULL, it holds new
+// addresses for each of the graph's buffers.
+static void gemmini_graph_replay(const struct gemmini_graph_t * g,
+        const void * const * bases) {
+  uintptr_t base[GEMMINI_GRAPH_MAX_BUFFERS];
+  for (size_t b = 0; b < g->n_buffers; b++)
+    base[b] = bases != NULL ? (uintptr_t)bases[b] : g->buffer_base[b];
+
+  const struct gemmini_cmd_t * cmd = g->cmds;
+  const struct gemmini_cmd_t * const end = g->cmds + g->len;
+
+  for (; cmd < end; cmd++) {
+    const uint64_t rs1 = cmd->buffer < 0 ? cmd->rs1 : cmd->rs1 + base[cmd->buffer];
+    const uint64_t rs2 = cmd->rs2;
+
+    if (cmd->funct != GEMMINI_GRAPH_FENCE) {
+      gemmini_profile_count(rs1, rs2, cmd->funct);
+      gemmini_trace_record(rs1, rs2, cmd->funct);
+    }
+
+    // The funct is an immediate in the instruction encoding, so each one
+    // needs its own instruction
+    switch (cmd->funct) {
+      case k_CONFIG: ROCC_INSTRUCTION_ISSUE(XCUSTOM_ACC, rs1, rs2, k_CONFIG); break;
+      case k_MVIN: ROCC_INSTRUCTION_ISSUE(XCUSTOM_ACC, rs1, rs2, k_MVIN); break;
+      case k_MVOUT: ROCC_INSTRUCTION_ISSUE(XCUSTOM_ACC, rs1, rs2, k_MVOUT); break;
+      case k_COMPUTE_PRELOADED: ROCC_INSTRUCTION_ISSUE(XCUSTOM_ACC, rs1, rs2, k_COMPUTE_PRELOADED); break;
+      case k_COMPUTE_ACCUMULATE: ROCC_INSTRUCTION_ISSUE(XCUSTOM_ACC, rs1, rs2, k_COMPUTE_ACCUMULATE); break;
+      case k_PRELOAD: ROCC_INSTRUCTION_ISSUE(XCUSTOM_ACC, rs1, rs2, k_PRELOAD); break;
+      case k_FLUSH: ROCC_INSTRUCTION_ISSUE(XCUSTOM_ACC, rs1, rs2, k_FLUSH); break;
+      case k_LOOP_WS: ROCC_INSTRUCTION_ISSUE(XCUSTOM_ACC, rs1, rs2, k_LOOP_WS); break;
+      case GEMMINI_GRAPH_FENCE: gemmini_fence_issue(); break;
+      default:
+        printf("Unknown funct in Gemmini graph: %d\n", cmd->funct);
+        exit(1);
+    }
+  }
+}
+
+#endif // GEMMINI_GRAPHS
 
 // Tiling functions
+
+// Runs one output-stationary tile. In OS mode, the partial sums stay in the
+// array between computes, so a preload is only needed to start each output
+// block and to tell its final compute where to write the result. With
+// stream_k set, the computes in between are issued back to back, which takes
+// K+2 instructions per output block instead of 2K. Otherwise every compute
+// gets its own preload, as it would in WS mode. A, B and C are packed at
+// A_precision, B_precision and C_precision bits.
+//
+// Tiled matmuls only stream their computes when GEMMINI_OS_STREAM_K is
+// defined, and otherwise preload before every compute.
+#ifdef GEMMINI_OS_STREAM_K
+#define OS_STREAM_K true
+#else
+#define OS_STREAM_K false
+#endif
+
 static void sp_tiled_matmul_os(const elem_t * A, const elem_t * B, const acc_t * D, elem_t * C,
         size_t I, size_t J, size_t K, size_t pad_I, size_t pad_J, size_t pad_K,
         size_t A_row_len, size_t B_row_len, size_t D_row_len, size_t C_row_len,
-        bool no_bias, bool repeating_bias) {
+        bool no_bias, bool repeating_bias, bool stream_k,
+        int A_precision, int B_precision, int C_precision) {
 
   const uint32_t A_sp_addr_start = 0;
   const uint32_t B_sp_addr_start = BANK_NUM * BANK_ROWS / 2;
   const uint32_t D_sp_addr_start = 1 << (ADDR_LEN-1);
   const uint32_t C_sp_addr_start = 3 << (ADDR_LEN-2);
 
-  const int A_blocks = K <= MAX_BLOCK_LEN ? K : MAX_BLOCK_LEN;
-  const int B_blocks = J <= MAX_BLOCK_LEN ? J : MAX_BLOCK_LEN;
+  const size_t A_max_blocks = max_block_len_of(A_precision);
+  const size_t B_max_blocks = max_block_len_of(B_precision);
+  const int A_blocks = K <= A_max_blocks ? K : A_max_blocks;
+  const int B_blocks = J <= B_max_blocks ? J : B_max_blocks;
   const int D_blocks = J <= MAX_BLOCK_LEN_ACC ? J : MAX_BLOCK_LEN_ACC;
 
   // Move-in D
@@ -421,7 +985,7 @@ static void sp_tiled_matmul_os(const elem_t * A, const elem_t * B, const acc_t *
 
         const size_t blocks = j + D_blocks <= J ? D_blocks : J-j;
 
-        const size_t cols = blocks * DIM - (j == J-1 ? pad_J : 0);
+        const size_t cols = blocks * DIM - (j + blocks == J ? pad_J : 0);
         const size_t rows = DIM - (i == I-1 ? pad_I : 0);
 
         gemmini_extended_mvin(D_dram_addr, D_sp_addr_acc, cols, rows);
@@ -430,26 +994,28 @@ static void sp_tiled_matmul_os(const elem_t * A, const elem_t * B, const acc_t *
   }
 
   // Move-in B
-  gemmini_config_ld(B_row_len * sizeof(elem_t));
+  gemmini_config_ld_precision_bits(packed_bytes(B_row_len, B_precision),
+      precision_bits_of(B_precision));
   for (size_t j = 0; j < J; j += B_blocks) {
     for (size_t k = 0; k < K; k++) {
-      const elem_t * const B_dram_addr = B + (k*B_row_len + j)*DIM;
+      const elem_t * const B_dram_addr = packed_addr(B, k*DIM, j*DIM, B_row_len, B_precision);
       const uint32_t B_sp_addr = B_sp_addr_start + (k*J + j)*DIM;
       const size_t blocks = j + B_blocks <= J ? B_blocks : J-j;
-      const size_t cols = blocks * DIM - (j == J-1 ? pad_J : 0);
+      const size_t cols = blocks * DIM - (j + blocks == J ? pad_J : 0);
       const size_t rows = DIM - (k == K-1 ? pad_K : 0);
       gemmini_extended_mvin(B_dram_addr, B_sp_addr, cols, rows);
     }
   }
 
   // Move-in A
-  gemmini_config_ld(A_row_len * sizeof(elem_t));
+  gemmini_config_ld_precision_bits(packed_bytes(A_row_len, A_precision),
+      precision_bits_of(A_precision));
   for (size_t i = 0; i < I; i++) {
     for (size_t k = 0; k < K; k += A_blocks) {
-      const elem_t * const A_dram_addr = A + (i*A_row_len + k)*DIM;
+      const elem_t * const A_dram_addr = packed_addr(A, i*DIM, k*DIM, A_row_len, A_precision);
       const uint32_t A_sp_addr = A_sp_addr_start + (i*K + k)*DIM;
       const size_t blocks = k + A_blocks <= K ? A_blocks : K-k;
-      const size_t cols = blocks * DIM - (k == K-1 ? pad_K : 0);
+      const size_t cols = blocks * DIM - (k + blocks == K ? pad_K : 0);
       const size_t rows = DIM - (i == I-1 ? pad_I : 0);
       gemmini_extended_mvin(A_dram_addr, A_sp_addr, cols, rows);
     }
@@ -480,7 +1046,9 @@ static void sp_tiled_matmul_os(const elem_t * A, const elem_t * B, const acc_t *
         const size_t C_cols = DIM - (j == J - 1 ? pad_J : 0);
         const size_t C_rows = DIM - (i == I - 1 ? pad_I : 0);
 
-        gemmini_extended_preload(GARBAGE_ADDR, out_sp_addr, DIM, DIM, C_cols, C_rows);
+        if (!stream_k || k == 0 || k == K-1) {
+          gemmini_extended_preload(GARBAGE_ADDR, out_sp_addr, DIM, DIM, C_cols, C_rows);
+        }
 
         if (k == 0) { // First iteration
           gemmini_extended_compute_preloaded(A_sp_addr, B_sp_addr, A_cols, A_rows, B_cols, B_rows);
@@ -495,7 +1063,7 @@ static void sp_tiled_matmul_os(const elem_t * A, const elem_t * B, const acc_t *
   if (C != NULL) {
     for (size_t i = 0; i < I; i++) {
       for (size_t j = 0; j < J; j++) {
-        elem_t * const C_dram_addr = C + (i*C_row_len + j)*DIM;
+        elem_t * const C_dram_addr = packed_addr(C, i*DIM, j*DIM, C_row_len, C_precision);
         const uint32_t C_sp_addr = C_sp_addr_start + (i*J + j)*DIM;
 
         const size_t C_cols = DIM - (j == J - 1 ? pad_J : 0);
@@ -507,25 +1075,96 @@ static void sp_tiled_matmul_os(const elem_t * A, const elem_t * B, const acc_t *
   }
 }
 
-static void sp_tiled_matmul_ws(const elem_t * A, const elem_t * B,
-        const acc_t * D, elem_t * C,
-        size_t I, size_t J, size_t K, size_t pad_I, size_t pad_J, size_t pad_K,
-        size_t A_row_len, size_t B_row_len, size_t D_row_len, size_t C_row_len,
-        bool no_bias, bool repeating_bias) {
+// Double-buffered tiling defers the mvins of the next tile into this queue,
+// and then interleaves them with the computation of the current tile. Issuing
+// them in one burst instead would fill up Gemmini's reorder buffer with loads,
+// leaving no room for computes to run alongside them. A tile needs at most one
+// mvin per DIM rows of the scratchpad and accumulator, plus three config_lds.
+#define MVIN_QUEUE_LEN (BANK_NUM * BANK_ROWS / DIM + ACC_ROWS / DIM + 3)
+
+struct mvin_cmd_t {
+  bool config; // If set, this is a config_ld with the given stride and precision
+  size_t stride;
+  int precision;
+  const void * dram_addr;
+  uint32_t sp_addr;
+  size_t cols, rows;
+};
+
+static struct mvin_cmd_t mvin_queue[MVIN_QUEUE_LEN];
+static size_t mvin_queue_len = 0, mvin_queue_head = 0;
+
+// Issues the next n deferred commands (or all of them, if there are fewer)
+static void mvin_queue_issue(size_t n) {
+  for (; n > 0 && mvin_queue_head < mvin_queue_len; n--, mvin_queue_head++) {
+    const struct mvin_cmd_t * cmd = &mvin_queue[mvin_queue_head];
+    if (cmd->config) {
+      gemmini_config_ld_precision_bits(cmd->stride, precision_bits_of(cmd->precision));
+    } else {
+      gemmini_extended_mvin(cmd->dram_addr, cmd->sp_addr, cmd->cols, cmd->rows);
+    }
+  }
 
-  const uint32_t A_sp_addr_start = 0;
-  const uint32_t B_sp_addr_start = I * K * DIM;
-  const uint32_t D_sp_addr_start = 1 << (ADDR_LEN-1);
-  const uint32_t C_sp_addr_start = 3 << (ADDR_LEN-2);
+  if (mvin_queue_head == mvin_queue_len) {
+    mvin_queue_len = mvin_queue_head = 0;
+  }
+}
+
+static void mvin_queue_push(bool config, size_t stride, int precision,
+        const void * dram_addr, uint32_t sp_addr, size_t cols, size_t rows) {
+  if (mvin_queue_len == MVIN_QUEUE_LEN) {
+    mvin_queue_issue(1);
+  }
 
-  const int A_blocks = K <= MAX_BLOCK_LEN ? K : MAX_BLOCK_LEN;
-  const int B_blocks = J <= MAX_BLOCK_LEN ? J : MAX_BLOCK_LEN;
+  struct mvin_cmd_t * cmd = &mvin_queue[mvin_queue_len++];
+  cmd->config = config;
+  cmd->stride = stride;
+  cmd->precision = precision;
+  cmd->dram_addr = dram_addr;
+  cmd->sp_addr = sp_addr;
+  cmd->cols = cols;
+  cmd->rows = rows;
+}
+
+static void sp_tiled_config_ld(bool deferred, size_t stride, int precision) {
+  if (deferred) {
+    mvin_queue_push(true, stride, precision, NULL, 0, 0, 0);
+  } else {
+    gemmini_config_ld_precision_bits(stride, precision_bits_of(precision));
+  }
+}
+
+static void sp_tiled_mvin(bool deferred, const void * dram_addr, uint32_t sp_addr,
+        size_t cols, size_t rows) {
+  if (deferred) {
+    mvin_queue_push(false, 0, 0, dram_addr, sp_addr, cols, rows);
+  } else {
+    gemmini_extended_mvin(dram_addr, sp_addr, cols, rows);
+  }
+}
+
+// Moves the D, B, and A matrices of one tile into the accumulator and
+// scratchpad, starting at the given addresses. If deferred is set, the
+// commands are pushed onto mvin_queue instead of being issued. A and B are
+// packed at A_precision and B_precision bits.
+static void sp_tiled_matmul_ws_mvin(const elem_t * A, const elem_t * B,
+        const acc_t * D,
+        size_t I, size_t J, size_t K, size_t pad_I, size_t pad_J, size_t pad_K,
+        size_t A_row_len, size_t B_row_len, size_t D_row_len,
+        bool no_bias, bool repeating_bias,
+        uint32_t A_sp_addr_start, uint32_t B_sp_addr_start, uint32_t D_sp_addr_start,
+        bool deferred, int A_precision, int B_precision) {
+
+  const size_t A_max_blocks = max_block_len_of(A_precision);
+  const size_t B_max_blocks = max_block_len_of(B_precision);
+  const int A_blocks = K <= A_max_blocks ? K : A_max_blocks;
+  const int B_blocks = J <= B_max_blocks ? J : B_max_blocks;
   const int D_blocks = J <= MAX_BLOCK_LEN_ACC ? J : MAX_BLOCK_LEN_ACC;
 
   // Move-in D
   if (D != NULL && !no_bias) {
     const size_t D_stride = repeating_bias ? 0 : D_row_len * sizeof(acc_t);
-    gemmini_config_ld(D_stride);
+    sp_tiled_config_ld(deferred, D_stride, ELEM_T_BITS);
 
     for (size_t i = 0; i < I; i++) {
       for (size_t j = 0; j < J; j += D_blocks) {
@@ -535,42 +1174,67 @@ static void sp_tiled_matmul_ws(const elem_t * A, const elem_t * B,
         const uint32_t D_sp_addr_acc = D_sp_addr_start + (i*J + j)*DIM;
 
         size_t blocks = j + D_blocks <= J ? D_blocks : J-j;
-        const size_t cols = blocks * DIM - (j == J-1 ? pad_J : 0);
+        const size_t cols = blocks * DIM - (j + blocks == J ? pad_J : 0);
         const size_t rows = DIM - (i == I-1 ? pad_I : 0);
 
-        gemmini_extended_mvin(D_dram_addr, D_sp_addr_acc, cols, rows);
+        sp_tiled_mvin(deferred, D_dram_addr, D_sp_addr_acc, cols, rows);
       }
     }
   }
 
-  // Move-in B
-  gemmini_config_ld(B_row_len * sizeof(elem_t));
-  for (size_t j = 0; j < J; j += B_blocks) {
-    for (size_t k = 0; k < K; k++) {
-      const elem_t * const B_dram_addr = B + (k*B_row_len + j)*DIM;
-      const uint32_t B_sp_addr = B_sp_addr_start + (k*J + j)*DIM;
-      const size_t blocks = j + B_blocks <= J ? B_blocks : J-j;
-      const size_t cols = blocks * DIM - (j == J-1 ? pad_J : 0);
-      const size_t rows = DIM - (k == K-1 ? pad_K : 0);
-      gemmini_extended_mvin(B_dram_addr, B_sp_addr, cols, rows);
+  // Move-in B, unless it's still in the scratchpad from an earlier tile
+  if (B != NULL) {
+    sp_tiled_config_ld(deferred, packed_bytes(B_row_len, B_precision), B_precision);
+    for (size_t j = 0; j < J; j += B_blocks) {
+      for (size_t k = 0; k < K; k++) {
+        const elem_t * const B_dram_addr = packed_addr(B, k*DIM, j*DIM, B_row_len, B_precision);
+        const uint32_t B_sp_addr = B_sp_addr_start + (k*J + j)*DIM;
+        const size_t blocks = j + B_blocks <= J ? B_blocks : J-j;
+        const size_t cols = blocks * DIM - (j + blocks == J ? pad_J : 0);
+        const size_t rows = DIM - (k == K-1 ? pad_K : 0);
+        sp_tiled_mvin(deferred, B_dram_addr, B_sp_addr, cols, rows);
+      }
     }
   }
 
-  // Move-in A
-  gemmini_config_ld(A_row_len * sizeof(elem_t));
+  // Move-in A, unless the caller gathers it into the scratchpad itself (as
+  // tiled_conv does)
+  if (A == NULL)
+    return;
+
+  sp_tiled_config_ld(deferred, packed_bytes(A_row_len, A_precision), A_precision);
   for (size_t k = 0; k < K; k += A_blocks) {
     for (size_t i = 0; i < I; i++) {
-      const elem_t * const A_dram_addr = A + (i * A_row_len + k)*DIM;
+      const elem_t * const A_dram_addr = packed_addr(A, i*DIM, k*DIM, A_row_len, A_precision);
       const uint32_t A_sp_addr = A_sp_addr_start + (i*K + k)*DIM;
       const size_t blocks = k + A_blocks <= K ? A_blocks : K-k;
-      const size_t cols = blocks * DIM - (k == K-1 ? pad_K : 0);
+      const size_t cols = blocks * DIM - (k + blocks == K ? pad_K : 0);
       const size_t rows = DIM - (i == I-1 ? pad_I : 0);
-      gemmini_extended_mvin(A_dram_addr, A_sp_addr, cols, rows);
+      sp_tiled_mvin(deferred, A_dram_addr, A_sp_addr, cols, rows);
     }
   }
+}
+
+// Multiplies a tile which has already been moved in by
+// sp_tiled_matmul_ws_mvin, and then moves out C, packed at C_precision bits
+static void sp_tiled_matmul_ws_compute(const acc_t * D, elem_t * C,
+        size_t I, size_t J, size_t K, size_t pad_I, size_t pad_J, size_t pad_K,
+        size_t C_row_len, bool no_bias,
+        uint32_t A_sp_addr_start, uint32_t B_sp_addr_start, uint32_t C_sp_addr_start,
+        int C_precision) {
 
   // Compute
-  // gemmini_loop_ws(A_sp_addr_start, B_sp_addr_start, I, J, K, !no_bias || D == NULL);
+#ifdef GEMMINI_HAS_LOOP_WS
+  // The hardware loop can't pad its last rows and columns, and it can't
+  // interleave the deferred mvins of the next tile. Those are issued behind
+  // it instead, so they still overlap with it.
+  if (pad_I == 0 && pad_J == 0 && pad_K == 0) {
+    const uint32_t C_offset = (C_sp_addr_start - (3 << (ADDR_LEN-2))) / DIM;
+    gemmini_loop_ws(A_sp_addr_start, B_sp_addr_start, I, J, K,
+        !no_bias || D == NULL, C_offset);
+    mvin_queue_issue(SIZE_MAX);
+  } else
+#endif
 
   // The above "gemmini_loop_ws" command will be unrolled in hardware into the
   // following loop:
@@ -606,6 +1270,14 @@ static void sp_tiled_matmul_ws(const elem_t * A, const elem_t * B,
         } else { // All other iterations
           gemmini_extended_compute_accumulated(A_sp_addr, GARBAGE_ADDR, A_cols, A_rows, DIM, DIM);
         }
+
+        // Spread any deferred mvins of the next tile evenly over the
+        // remaining computes
+        if (mvin_queue_head < mvin_queue_len) {
+          const size_t remaining = (J-j)*K*I - k*I - i;
+          const size_t queued = mvin_queue_len - mvin_queue_head;
+          mvin_queue_issue((queued + remaining - 1) / remaining);
+        }
       }
     }
   }
@@ -614,7 +1286,7 @@ static void sp_tiled_matmul_ws(const elem_t * A, const elem_t * B,
   if (C != NULL) {
     for (size_t i = 0; i < I; i++) {
       for (size_t j = 0; j < J; j++) {
-        elem_t * const C_dram_addr = C + (i*C_row_len + j)*DIM;
+        elem_t * const C_dram_addr = packed_addr(C, i*DIM, j*DIM, C_row_len, C_precision);
         const uint32_t C_sp_addr = C_sp_addr_start + (i*J + j)*DIM;
 
         const size_t C_cols = DIM - (j == J - 1 ? pad_J : 0);
@@ -626,32 +1298,118 @@ static void sp_tiled_matmul_ws(const elem_t * A, const elem_t * B,
   }
 }
 
-static void tiled_matmul_outer(size_t dim_I, size_t dim_J, size_t dim_K,
-        const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J],
-        const acc_t * D, elem_t C[dim_I][dim_J],
-        size_t tile_I, size_t tile_J, size_t tile_K,
-        int act, int shift, size_t relu6_shift, bool repeating_bias,
-        int dataflow) {
+static void sp_tiled_matmul_ws(const elem_t * A, const elem_t * B,
+        const acc_t * D, elem_t * C,
+        size_t I, size_t J, size_t K, size_t pad_I, size_t pad_J, size_t pad_K,
+        size_t A_row_len, size_t B_row_len, size_t D_row_len, size_t C_row_len,
+        bool no_bias, bool repeating_bias,
+        int A_precision, int B_precision, int C_precision) {
 
+  const uint32_t A_sp_addr_start = 0;
+  const uint32_t B_sp_addr_start = I * K * DIM;
+  const uint32_t D_sp_addr_start = 1 << (ADDR_LEN-1);
+  const uint32_t C_sp_addr_start = 3 << (ADDR_LEN-2);
+
+  sp_tiled_matmul_ws_mvin(A, B, D,
+      I, J, K, pad_I, pad_J, pad_K,
+      A_row_len, B_row_len, D_row_len,
+      no_bias, repeating_bias,
+      A_sp_addr_start, B_sp_addr_start, D_sp_addr_start,
+      false, A_precision, B_precision);
+
+  sp_tiled_matmul_ws_compute(D, C,
+      I, J, K, pad_I, pad_J, pad_K,
+      C_row_len, no_bias,
+      A_sp_addr_start, B_sp_addr_start, C_sp_addr_start,
+      C_precision);
+}
+
+// Everything about how a matmul is tiled which doesn't depend on the
+// matrices themselves. All sizes besides dim_I/J/K are in DIM x DIM blocks.
+struct tiling_plan_t {
+  size_t dim_I, dim_J, dim_K;
+  int dataflow;
+
+  size_t tile_I, tile_J, tile_K;
+
+  // Number of tiles along each dimension
+  size_t I0, J0, K0;
+
+  // Size of the final tile along each dimension, which may be smaller than
+  // the tiling factor when the dimension isn't divisible by it
+  size_t last_I, last_J, last_K;
+
+  // How much padding the hardware is supposed to add for the final tile, in
+  // elements
+  size_t padding_I, padding_J, padding_K;
+
+  // If set, the tiles are run column by column (j0 outermost, then i0, then
+  // k0) instead of row by row. The B tiles of a whole column, dim_K x tile_J,
+  // are moved in along with its first row of tiles, and then stay in the
+  // scratchpad behind a single A tile while the other rows are computed.
+  // This is only supported by the weight-stationary dataflow.
+  bool weights_resident;
+};
+
+static void tiled_matmul_make_plan(struct tiling_plan_t * plan,
+        size_t dim_I, size_t dim_J, size_t dim_K,
+        size_t tile_I, size_t tile_J, size_t tile_K, int dataflow) {
   const size_t dim_I_padded = (dim_I / DIM + (dim_I % DIM != 0)) * DIM;
   const size_t dim_J_padded = (dim_J / DIM + (dim_J % DIM != 0)) * DIM;
   const size_t dim_K_padded = (dim_K / DIM + (dim_K % DIM != 0)) * DIM;
 
-  const size_t I0 = dim_I_padded / (tile_I*DIM) + (dim_I_padded % (tile_I*DIM) != 0);
-  const size_t J0 = dim_J_padded / (tile_J*DIM) + (dim_J_padded % (tile_J*DIM) != 0);
-  const size_t K0 = dim_K_padded / (tile_K*DIM) + (dim_K_padded % (tile_K*DIM) != 0);
+  plan->dim_I = dim_I;
+  plan->dim_J = dim_J;
+  plan->dim_K = dim_K;
+  plan->dataflow = dataflow;
 
-  // These lines here are supposed to help us deal with when the dimensions of
-  // the systolic array aren't divisible by the tiling factors
-  const size_t last_I = dim_I_padded % (tile_I*DIM) == 0 ? tile_I : (dim_I_padded/DIM) % tile_I;
-  const size_t last_J = dim_J_padded % (tile_J*DIM) == 0 ? tile_J : (dim_J_padded/DIM) % tile_J;
-  const size_t last_K = dim_K_padded % (tile_K*DIM) == 0 ? tile_K : (dim_K_padded/DIM) % tile_K;
+  plan->tile_I = tile_I;
+  plan->tile_J = tile_J;
+  plan->tile_K = tile_K;
 
-  // These lines are supposed to figure out how much padding the hardware is
-  // supposed to add for the final tile
-  const size_t padding_I = dim_I_padded - dim_I;
-  const size_t padding_J = dim_J_padded - dim_J;
-  const size_t padding_K = dim_K_padded - dim_K;
+  plan->I0 = dim_I_padded / (tile_I*DIM) + (dim_I_padded % (tile_I*DIM) != 0);
+  plan->J0 = dim_J_padded / (tile_J*DIM) + (dim_J_padded % (tile_J*DIM) != 0);
+  plan->K0 = dim_K_padded / (tile_K*DIM) + (dim_K_padded % (tile_K*DIM) != 0);
+
+  plan->last_I = dim_I_padded % (tile_I*DIM) == 0 ? tile_I : (dim_I_padded/DIM) % tile_I;
+  plan->last_J = dim_J_padded % (tile_J*DIM) == 0 ? tile_J : (dim_J_padded/DIM) % tile_J;
+  plan->last_K = dim_K_padded % (tile_K*DIM) == 0 ? tile_K : (dim_K_padded/DIM) % tile_K;
+
+  plan->padding_I = dim_I_padded - dim_I;
+  plan->padding_J = dim_J_padded - dim_J;
+  plan->padding_K = dim_K_padded - dim_K;
+
+  plan->weights_resident = false;
+}
+
+// Runs the output tiles numbered [first_tile, end_tile) of a tiled matmul,
+// where tile (i0, j0) is numbered i0*J0 + j0. This only issues the
+// instructions; it doesn't wait for Gemmini to finish them. Plans with
+// weights_resident set are always run single-buffered. A, B and C are packed
+// at A_precision, B_precision and C_precision bits per element.
+static void tiled_matmul_outer_tiles(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J],
+        const acc_t * D, elem_t C[dim_I][dim_J],
+        const struct tiling_plan_t * plan,
+        size_t first_tile, size_t end_tile,
+        int act, int shift, size_t relu6_shift, bool repeating_bias,
+        bool double_buffered,
+        int A_precision, int B_precision, int C_precision) {
+
+  const int dataflow = plan->dataflow;
+
+  gemmini_trace_matrix('A', A, dim_I * packed_bytes(dim_K, A_precision));
+  gemmini_trace_matrix('B', B, dim_K * packed_bytes(dim_J, B_precision));
+  if (D != NULL)
+    gemmini_trace_matrix('D', D, (repeating_bias ? 1 : dim_I) * dim_J * sizeof(acc_t));
+  if (C != NULL)
+    gemmini_trace_matrix('C', C, dim_I * packed_bytes(dim_J, C_precision));
+
+  const size_t tile_I = plan->tile_I, tile_J = plan->tile_J, tile_K = plan->tile_K;
+  const size_t I0 = plan->I0, J0 = plan->J0, K0 = plan->K0;
+  const size_t last_I = plan->last_I, last_J = plan->last_J, last_K = plan->last_K;
+  const size_t padding_I = plan->padding_I, padding_J = plan->padding_J,
+        padding_K = plan->padding_K;
 
   const bool no_bias = D == NULL;
 
@@ -659,12 +1417,41 @@ static void tiled_matmul_outer(size_t dim_I, size_t dim_J, size_t dim_K,
     D = (void*) 1; // Dummy address which isn't NULL
   }
 
-  gemmini_config_ex(dataflow, act, 0, shift, relu6_shift);
-  gemmini_config_st(dim_J * sizeof(elem_t));
-
-  for (size_t i0 = 0; i0 < I0; i0++)
-    for (size_t j0 = 0; j0 < J0; j0++)
+  gemmini_config_ex_precision_bits(dataflow, act, 0, shift, relu6_shift,
+      precision_bits_of(C_precision));
+  gemmini_config_st_precision_bits(packed_bytes(dim_J, C_precision),
+      precision_bits_of(C_precision));
+
+  // When double-buffering, each tile is moved into the half of the scratchpad
+  // which the previous tile isn't using, and its mvins are interleaved with
+  // the computation of the previous tile. This lets the DMA of one tile
+  // overlap with the computation of the tile before it. Output tiles
+  // alternate between the two halves of the accumulator in the same way.
+  size_t tile_count = 0;
+  bool prev_valid = false;
+  const acc_t * prev_pre = NULL;
+  elem_t * prev_out = NULL;
+  size_t prev_I = 0, prev_J = 0, prev_K = 0;
+  size_t prev_pad_I = 0, prev_pad_J = 0, prev_pad_K = 0;
+  uint32_t prev_A_sp_addr = 0, prev_B_sp_addr = 0, prev_C_sp_addr = 0;
+
+  // With resident weights, the first row of tiles which is run in each
+  // column moves in the column's B tiles, and the other rows reuse them
+  const bool resident = plan->weights_resident && dataflow == WEIGHT_STATIONARY;
+  size_t resident_i0 = 0, resident_j0 = SIZE_MAX;
+
+  const size_t outer = resident ? J0 : I0;
+  const size_t inner = resident ? I0 : J0;
+
+  for (size_t o = 0; o < outer; o++)
+    for (size_t n = 0; n < inner; n++)
       for (size_t k0 = 0; k0 < K0; k0++) {
+        const size_t i0 = resident ? n : o;
+        const size_t j0 = resident ? o : n;
+
+        const size_t tile = i0*J0 + j0;
+        if (tile < first_tile || tile >= end_tile)
+          continue;
 
         const acc_t * pre;
         if (k0 != 0) {
@@ -673,7 +1460,12 @@ static void tiled_matmul_outer(size_t dim_I, size_t dim_J, size_t dim_K,
           size_t bias_row = repeating_bias ? 0 : i0*tile_I*DIM;
           pre = &((acc_t (*)[dim_J])D)[bias_row][j0*tile_J*DIM];
         }
-        elem_t * out = k0 == K0-1 ? &C[i0*tile_I*DIM][j0*tile_J*DIM] : NULL;
+        const elem_t * A_tile = packed_addr(&A[0][0], i0*tile_I*DIM, k0*tile_K*DIM,
+            dim_K, A_precision);
+        const elem_t * B_tile = packed_addr(&B[0][0], k0*tile_K*DIM, j0*tile_J*DIM,
+            dim_J, B_precision);
+        elem_t * out = k0 == K0-1 ? packed_addr(&C[0][0], i0*tile_I*DIM, j0*tile_J*DIM,
+            dim_J, C_precision) : NULL;
 
         const size_t I = i0 < I0-1 ? tile_I : last_I;
         const size_t J = j0 < J0-1 ? tile_J : last_J;
@@ -684,24 +1476,113 @@ static void tiled_matmul_outer(size_t dim_I, size_t dim_J, size_t dim_K,
         const size_t pad_K = k0 == K0-1 ? padding_K : 0;
 
         if (dataflow == OUTPUT_STATIONARY) {
-          sp_tiled_matmul_os(&A[i0*tile_I*DIM][k0*tile_K*DIM],
-              &B[k0*tile_K*DIM][j0*tile_J*DIM],
+          sp_tiled_matmul_os(A_tile, B_tile,
               pre, out,
               I, J, K,
               pad_I, pad_J, pad_K,
               dim_K, dim_J, dim_J, dim_J,
-              no_bias, repeating_bias);
-        } else {
-          sp_tiled_matmul_ws(&A[i0*tile_I*DIM][k0*tile_K*DIM],
-              &B[k0*tile_K*DIM][j0*tile_J*DIM],
+              no_bias, repeating_bias, OS_STREAM_K,
+              A_precision, B_precision, C_precision);
+        } else if (resident) {
+          if (j0 != resident_j0) {
+            resident_j0 = j0;
+            resident_i0 = i0;
+          }
+
+          // The column's B tiles are stored one after another, behind the
+          // space for the largest A tile
+          const uint32_t A_sp_addr = 0;
+          const uint32_t B_sp_addr = tile_I * tile_K * DIM + k0 * tile_K * J * DIM;
+          const uint32_t D_sp_addr = 1 << (ADDR_LEN-1);
+          const uint32_t C_sp_addr = 3 << (ADDR_LEN-2);
+
+          sp_tiled_matmul_ws_mvin(A_tile, i0 == resident_i0 ? B_tile : NULL,
+              pre,
+              I, J, K,
+              pad_I, pad_J, pad_K,
+              dim_K, dim_J, dim_J,
+              no_bias, repeating_bias,
+              A_sp_addr, B_sp_addr, D_sp_addr,
+              false, A_precision, B_precision);
+
+          sp_tiled_matmul_ws_compute(pre, out,
+              I, J, K,
+              pad_I, pad_J, pad_K,
+              dim_J, no_bias,
+              A_sp_addr, B_sp_addr, C_sp_addr,
+              C_precision);
+        } else if (!double_buffered) {
+          sp_tiled_matmul_ws(A_tile, B_tile,
               pre, out,
               I, J, K,
               pad_I, pad_J, pad_K,
               dim_K, dim_J, dim_J, dim_J,
-              no_bias, repeating_bias);
+              no_bias, repeating_bias,
+              A_precision, B_precision, C_precision);
+        } else {
+          const uint32_t sp_half = (tile_count % 2) * (BANK_NUM * BANK_ROWS / 2);
+          const uint32_t acc_half = (tile % 2) * (ACC_ROWS / 2);
+
+          const uint32_t A_sp_addr = sp_half;
+          const uint32_t B_sp_addr = sp_half + I * K * DIM;
+          const uint32_t D_sp_addr = (1 << (ADDR_LEN-1)) + acc_half;
+          const uint32_t C_sp_addr = (3 << (ADDR_LEN-2)) + acc_half;
+
+          sp_tiled_matmul_ws_mvin(A_tile, B_tile,
+              pre,
+              I, J, K,
+              pad_I, pad_J, pad_K,
+              dim_K, dim_J, dim_J,
+              no_bias, repeating_bias,
+              A_sp_addr, B_sp_addr, D_sp_addr,
+              prev_valid, A_precision, B_precision);
+
+          if (prev_valid) {
+            sp_tiled_matmul_ws_compute(prev_pre, prev_out,
+                prev_I, prev_J, prev_K,
+                prev_pad_I, prev_pad_J, prev_pad_K,
+                dim_J, no_bias,
+                prev_A_sp_addr, prev_B_sp_addr, prev_C_sp_addr,
+                C_precision);
+          }
+
+          prev_valid = true;
+          prev_pre = pre;
+          prev_out = out;
+          prev_I = I; prev_J = J; prev_K = K;
+          prev_pad_I = pad_I; prev_pad_J = pad_J; prev_pad_K = pad_K;
+          prev_A_sp_addr = A_sp_addr;
+          prev_B_sp_addr = B_sp_addr;
+          prev_C_sp_addr = C_sp_addr;
+
+          tile_count++;
         }
       }
 
+  // Compute the last tile, which nothing else was moved in behind
+  if (prev_valid) {
+    sp_tiled_matmul_ws_compute(prev_pre, prev_out,
+        prev_I, prev_J, prev_K,
+        prev_pad_I, prev_pad_J, prev_pad_K,
+        dim_J, no_bias,
+        prev_A_sp_addr, prev_B_sp_addr, prev_C_sp_addr,
+        C_precision);
+  }
+}
+
+static void tiled_matmul_outer(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J],
+        const acc_t * D, elem_t C[dim_I][dim_J],
+        const struct tiling_plan_t * plan,
+        int act, int shift, size_t relu6_shift, bool repeating_bias,
+        bool double_buffered,
+        int A_precision, int B_precision, int C_precision) {
+
+  tiled_matmul_outer_tiles(dim_I, dim_J, dim_K, A, B, D, C,
+      plan, 0, plan->I0 * plan->J0,
+      act, shift, relu6_shift, repeating_bias,
+      double_buffered, A_precision, B_precision, C_precision);
+
   gemmini_fence();
 }
 
@@ -760,37 +1641,187 @@ static void tiled_matmul_ws(size_t dim_I, size_t dim_J, size_t dim_K,
 }
 */
 
+// matmul_cpu is blocked so that a MATMUL_CPU_BLOCK_I x MATMUL_CPU_BLOCK_J
+// tile of partial sums, and the MATMUL_CPU_BLOCK_K rows of B which feed it,
+// stay in the L1 cache. The innermost loop runs along a row of B, so the
+// compiler can vectorize it for whichever vector unit it targets (e.g. RVV
+// with -march=rv64gcv, or SSE/AVX/NEON on the host). The sums are exact in
+// acc_t, so the blocking doesn't change the rounding, clipping or activation.
+#ifndef MATMUL_CPU_BLOCK_I
+#define MATMUL_CPU_BLOCK_I 16
+#endif
+
+#ifndef MATMUL_CPU_BLOCK_J
+#define MATMUL_CPU_BLOCK_J 64
+#endif
+
+#ifndef MATMUL_CPU_BLOCK_K
+#define MATMUL_CPU_BLOCK_K 256
+#endif
+
+// Computes rows [i_start, i_end) of C
+static void matmul_cpu_rows(size_t i_start, size_t i_end,
+        size_t dim_J, size_t dim_K,
+        const elem_t * A, const elem_t * B, const acc_t * D, elem_t * C,
+        int act, size_t shift, size_t relu6_shift, bool repeating_bias) {
+
+  acc_t acc[MATMUL_CPU_BLOCK_I][MATMUL_CPU_BLOCK_J];
+  const acc_t relu6_max = 6 << relu6_shift;
+
+  for (size_t i0 = i_start; i0 < i_end; i0 += MATMUL_CPU_BLOCK_I) {
+    const size_t rows = i_end - i0 < MATMUL_CPU_BLOCK_I ? i_end - i0 : MATMUL_CPU_BLOCK_I;
+
+    for (size_t j0 = 0; j0 < dim_J; j0 += MATMUL_CPU_BLOCK_J) {
+      const size_t cols = dim_J - j0 < MATMUL_CPU_BLOCK_J ? dim_J - j0 : MATMUL_CPU_BLOCK_J;
+
+      for (size_t i = 0; i < rows; i++) {
+        const acc_t * bias = D + (repeating_bias ? 0 : i0 + i) * dim_J + j0;
+
+        for (size_t j = 0; j < cols; j++)
+          acc[i][j] = D == NULL ? 0 : bias[j];
+      }
+
+      for (size_t k0 = 0; k0 < dim_K; k0 += MATMUL_CPU_BLOCK_K) {
+        const size_t k_end = dim_K - k0 < MATMUL_CPU_BLOCK_K ? dim_K : k0 + MATMUL_CPU_BLOCK_K;
+
+        for (size_t i = 0; i < rows; i++) {
+          const elem_t * a = A + (i0 + i) * dim_K;
+          acc_t * c = acc[i];
+
+          for (size_t k = k0; k < k_end; k++) {
+            const acc_t a_k = a[k];
+            const elem_t * b = B + k * dim_J + j0;
+
+            for (size_t j = 0; j < cols; j++)
+              c[j] += a_k * b[j];
+          }
+        }
+      }
+
+      for (size_t i = 0; i < rows; i++) {
+        elem_t * c = C + (i0 + i) * dim_J + j0;
+
+        for (size_t j = 0; j < cols; j++) {
+          // Shift while rounding to nearest integer (ties round to even)
+          acc_t result = ROUNDING_RIGHT_SHIFT(acc[i][j], shift);
+
+          // Clip result
+          result = result > elem_t_max ? elem_t_max : (result < elem_t_min ? elem_t_min : result);
+
+          // Apply activation function
+          if (act == RELU) {
+            result = result < 0 ? 0 : result;
+          } else if (act == RELU6) {
+            result = result < 0 ? 0 : (result > relu6_max ? relu6_max : result);
+          }
+
+          c[j] = (elem_t)result;
+        }
+      }
+    }
+  }
+}
+
+#if GEMMINI_CPU_THREADS > 1
+struct matmul_cpu_args_t {
+  size_t i_start, i_end, dim_J, dim_K;
+  const elem_t * A;
+  const elem_t * B;
+  const acc_t * D;
+  elem_t * C;
+  int act;
+  size_t shift, relu6_shift;
+  bool repeating_bias;
+};
+
+static void * matmul_cpu_thread(void * arg) {
+  const struct matmul_cpu_args_t * a = (const struct matmul_cpu_args_t *)arg;
+  matmul_cpu_rows(a->i_start, a->i_end, a->dim_J, a->dim_K,
+      a->A, a->B, a->D, a->C,
+      a->act, a->shift, a->relu6_shift, a->repeating_bias);
+  return NULL;
+}
+#endif
+
+// When GEMMINI_CPU_THREADS is above 1 on Linux, the rows of C are split
+// between that many pthreads
 static void matmul_cpu(size_t dim_I, size_t dim_J, size_t dim_K,
         const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J], const acc_t * D,
         elem_t C[dim_I][dim_J],
         int act, size_t shift, size_t relu6_shift, bool repeating_bias) {
 
-  const bool no_bias = D == NULL;
+#if GEMMINI_CPU_THREADS > 1
+  pthread_t threads[GEMMINI_CPU_THREADS];
+  struct matmul_cpu_args_t args[GEMMINI_CPU_THREADS];
+  bool started[GEMMINI_CPU_THREADS];
+
+  // Give each thread a whole number of row blocks
+  const size_t blocks = (dim_I + MATMUL_CPU_BLOCK_I - 1) / MATMUL_CPU_BLOCK_I;
+  const size_t rows_per_thread = ((blocks + GEMMINI_CPU_THREADS - 1) / GEMMINI_CPU_THREADS) * MATMUL_CPU_BLOCK_I;
+
+  for (size_t t = 0; t < GEMMINI_CPU_THREADS; t++) {
+    const size_t i_start = t * rows_per_thread < dim_I ? t * rows_per_thread : dim_I;
+    const size_t i_end = i_start + rows_per_thread < dim_I ? i_start + rows_per_thread : dim_I;
+
+    args[t] = (struct matmul_cpu_args_t) {i_start, i_end, dim_J, dim_K,
+      &A[0][0], &B[0][0], D, &C[0][0],
+      act, shift, relu6_shift, repeating_bias};
+
+    // The first slice runs on this thread, as do any which can't be started
+    started[t] = t > 0 && i_start < i_end &&
+      pthread_create(&threads[t], NULL, matmul_cpu_thread, &args[t]) == 0;
+  }
+
+  for (size_t t = 0; t < GEMMINI_CPU_THREADS; t++)
+    if (!started[t])
+      matmul_cpu_thread(&args[t]);
+
+  for (size_t t = 0; t < GEMMINI_CPU_THREADS; t++)
+    if (started[t])
+      pthread_join(threads[t], NULL);
+#else
+  matmul_cpu_rows(0, dim_I, dim_J, dim_K,
+      &A[0][0], &B[0][0], D, &C[0][0],
+      act, shift, relu6_shift, repeating_bias);
+#endif
+}
+
+// matmul_cpu for matrices packed at A_precision, B_precision and C_precision
+// bits. It's a plain scalar loop, since unpacking each element costs more
+// than the multiply-add.
+static void matmul_cpu_packed(size_t dim_I, size_t dim_J, size_t dim_K,
+        const void * A, const void * B, const acc_t * D, void * C,
+        int act, size_t shift, size_t relu6_shift, bool repeating_bias,
+        int A_precision, int B_precision, int C_precision) {
+
+  const size_t A_row_bytes = packed_bytes(dim_K, A_precision);
+  const size_t B_row_bytes = packed_bytes(dim_J, B_precision);
+  const size_t C_row_bytes = packed_bytes(dim_J, C_precision);
+  const acc_t relu6_max = 6 << relu6_shift;
 
   for (size_t i = 0; i < dim_I; i++) {
+    const uint8_t * a = (const uint8_t *)A + i * A_row_bytes;
+    uint8_t * c = (uint8_t *)C + i * C_row_bytes;
+
     for (size_t j = 0; j < dim_J; j++) {
-      size_t bias_row = repeating_bias ? 0 : i;
-      acc_t result = no_bias ? 0 : ((acc_t (*)[dim_J])D)[bias_row][j];
+      acc_t result = D == NULL ? 0 : D[(repeating_bias ? 0 : i) * dim_J + j];
 
-      for (size_t k = 0; k < dim_K; k++) {
-        result += A[i][k] * B[k][j];
-      }
+      for (size_t k = 0; k < dim_K; k++)
+        result += (acc_t)packed_get(a, k, A_precision) *
+          packed_get((const uint8_t *)B + k * B_row_bytes, j, B_precision);
 
-      // Shift while rounding to nearest integer (ties round to negative infinity)
+      // Shift, clip and activate as matmul_cpu_rows does. packed_set then
+      // saturates the result to C_precision bits.
       result = ROUNDING_RIGHT_SHIFT(result, shift);
-
-      // Clip result
       result = result > elem_t_max ? elem_t_max : (result < elem_t_min ? elem_t_min : result);
 
-      // Apply activation function
       if (act == RELU) {
         result = result < 0 ? 0 : result;
       } else if (act == RELU6) {
-        int max = 6 << relu6_shift;
-        result = result < 0 ? 0 : (result > max ? max : result);
+        result = result < 0 ? 0 : (result > relu6_max ? relu6_max : result);
       }
 
-      C[i][j] = (elem_t)result;
+      packed_set(c, j, C_precision, (elem_t)result);
     }
   }
 }
@@ -891,14 +1922,32 @@ static void matmul_cpu(size_t DIM_I, size_t DIM_J, size_t DIM_K,
 // General matmul which can be run with different dataflows, or on the CPU
 enum tiled_matmul_type_t {OS, WS, CPU};
 
+// Exits if "precision" isn't a width which A, B and C can be packed at
+static void tiled_matmul_check_precision(int precision) {
+  if (precision != ELEM_T_BITS && precision != 4 && precision != 2) {
+    printf("Unsupported precision: %d bits\n", precision);
+    exit(1);
+  }
+}
+
 // This function runs a tiled matrix multiplication, with hardcoded tiling
-// factors
-void tiled_matmul(size_t dim_I, size_t dim_J, size_t dim_K,
-        const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J],
-        const acc_t * D, elem_t C[dim_I][dim_J],
+// factors, on A, B and C packed at A_precision, B_precision and C_precision
+// bits per element (each ELEM_T_BITS, 4 or 2; see packed_addr). For example,
+// an FC layer can keep 8-bit activations with 4-bit weights. D is always a
+// full acc_t matrix. The tiling factors are counted in unpacked elements,
+// since mvins unpack A and B into the scratchpad.
+void tiled_matmul_mixed_precision(size_t dim_I, size_t dim_J, size_t dim_K,
+        const void * A, const void * B,
+        const acc_t * D, void * C,
         int act, size_t shift, size_t relu6_shift, bool repeating_bias,
         size_t tile_I, size_t tile_J, size_t tile_K,
-        enum tiled_matmul_type_t tiled_matmul_type) {
+        enum tiled_matmul_type_t tiled_matmul_type,
+        bool double_buffered,
+        int A_precision, int B_precision, int C_precision) {
+
+  tiled_matmul_check_precision(A_precision);
+  tiled_matmul_check_precision(B_precision);
+  tiled_matmul_check_precision(C_precision);
 
 #ifdef GEMMINI_ASSERTIONS
   // Make sure that the tiling factors make sense
@@ -928,19 +1977,32 @@ void tiled_matmul(size_t dim_I, size_t dim_J, size_t dim_K,
     exit(1);
   }
 
+  // Double-buffering only gives each tile half of the scratchpad and
+  // accumulator
+  const size_t buffers = double_buffered && tiled_matmul_type == WS ? 2 : 1;
+
   const size_t total_spad_rows =
       (tile_I * tile_K * DIM) +   // Rows to store A
       (tile_K * tile_J * DIM);    // Rows to store B
 
-  if (total_spad_rows > BANK_NUM * BANK_ROWS) {
+  if (total_spad_rows > BANK_NUM * BANK_ROWS / buffers) {
     printf("Not enough space in scratchpad to store A and B matrices\n");
     exit(1);
   }
 
+  // sp_tiled_matmul_os keeps B in the second half of the scratchpad, so A and
+  // B each only get half of it
+  if (tiled_matmul_type == OS &&
+      (tile_I * tile_K * DIM > BANK_NUM * BANK_ROWS / 2 ||
+       tile_K * tile_J * DIM > BANK_NUM * BANK_ROWS / 2)) {
+    printf("Not enough space in scratchpad halves to store A and B matrices\n");
+    exit(1);
+  }
+
   const size_t total_acc_rows =
       tile_I * tile_J * DIM;      // Rows to store C
 
-  if (total_acc_rows > ACC_ROWS) {
+  if (total_acc_rows > ACC_ROWS / buffers) {
     printf("Not enough space in accumulator to store C\n");
     exit(1);
   }
@@ -953,11 +2015,21 @@ void tiled_matmul(size_t dim_I, size_t dim_J, size_t dim_K,
 
   // Run a tiled matrix multiplication on either Gemmini or the CPU
   if (tiled_matmul_type == OS || tiled_matmul_type == WS) {
+      struct tiling_plan_t plan;
+      tiled_matmul_make_plan(&plan, dim_I, dim_J, dim_K,
+              tile_I, tile_J, tile_K, (int)tiled_matmul_type);
+
       tiled_matmul_outer(dim_I, dim_J, dim_K,
               A, B, D, C,
-              tile_I, tile_J, tile_K,
+              &plan,
+              act, shift, relu6_shift, repeating_bias,
+              double_buffered, A_precision, B_precision, C_precision);
+  } else if (A_precision != ELEM_T_BITS || B_precision != ELEM_T_BITS ||
+          C_precision != ELEM_T_BITS) {
+      matmul_cpu_packed(dim_I, dim_J, dim_K,
+              A, B, D, C,
               act, shift, relu6_shift, repeating_bias,
-              (int)tiled_matmul_type);
+              A_precision, B_precision, C_precision);
   } else /*if (tiled_matmul_type == CPU)*/ {
       matmul_cpu(dim_I, dim_J, dim_K,
               A, B, D, C,
@@ -965,6 +2037,323 @@ void tiled_matmul(size_t dim_I, size_t dim_J, size_t dim_K,
   }
 }
 
+// tiled_matmul_mixed_precision with A, B and C all packed at "precision" bits
+void tiled_matmul_precision(size_t dim_I, size_t dim_J, size_t dim_K,
+        const void * A, const void * B,
+        const acc_t * D, void * C,
+        int act, size_t shift, size_t relu6_shift, bool repeating_bias,
+        size_t tile_I, size_t tile_J, size_t tile_K,
+        enum tiled_matmul_type_t tiled_matmul_type,
+        bool double_buffered, int precision) {
+  tiled_matmul_mixed_precision(dim_I, dim_J, dim_K,
+      A, B, D, C,
+      act, shift, relu6_shift, repeating_bias,
+      tile_I, tile_J, tile_K,
+      tiled_matmul_type, double_buffered,
+      precision, precision, precision);
+}
+
+// This function runs a tiled matrix multiplication, with hardcoded tiling
+// factors. If double_buffered is set, WS tiles are software-pipelined through
+// two halves of the scratchpad and accumulator (each tile must then fit in one
+// half). It has no effect on the OS or CPU paths.
+void tiled_matmul(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J],
+        const acc_t * D, elem_t C[dim_I][dim_J],
+        int act, size_t shift, size_t relu6_shift, bool repeating_bias,
+        size_t tile_I, size_t tile_J, size_t tile_K,
+        enum tiled_matmul_type_t tiled_matmul_type,
+        bool double_buffered) {
+  tiled_matmul_precision(dim_I, dim_J, dim_K,
+      A, B, D, C,
+      act, shift, relu6_shift, repeating_bias,
+      tile_I, tile_J, tile_K,
+      tiled_matmul_type, double_buffered, ELEM_T_BITS);
+}
+
+// Tiling factors, in units of DIM x DIM blocks
+struct tiling_factors_t {
+  size_t tile_I, tile_J, tile_K;
+  bool weights_resident;
+};
+
+// Which loop orders the auto-tuner may pick. With TILING_RESIDENCY_AUTO, it
+// keeps B's tiles resident in the scratchpad (see tiling_plan_t) whenever it
+// estimates that to be cheaper. TILING_RESIDENCY_WEIGHTS falls back to the
+// usual order if no column of B fits in the scratchpad.
+enum tiling_residency_t {
+  TILING_RESIDENCY_AUTO,
+  TILING_RESIDENCY_NONE,
+  TILING_RESIDENCY_WEIGHTS,
+};
+
+// The auto-tuner below weighs each instruction as if it cost this many bytes
+// of DRAM traffic. With a DMA bus of ~16 bytes per cycle, this corresponds to
+// an instruction occupying the issue path for a few cycles.
+#ifndef TILING_BYTES_PER_INSTRUCTION
+#define TILING_BYTES_PER_INSTRUCTION 64
+#endif
+
+// Estimates the cost of a tiling, as DRAM bytes moved plus the weighted number
+// of Gemmini instructions issued. All dimensions are in blocks.
+static uint64_t tiling_cost(size_t I, size_t J, size_t K,
+        size_t tile_I, size_t tile_J, size_t tile_K, int dataflow,
+        bool weights_resident) {
+  const size_t I0 = I / tile_I + (I % tile_I != 0);
+  const size_t J0 = J / tile_J + (J % tile_J != 0);
+  const size_t K0 = K / tile_K + (K % tile_K != 0);
+
+  const size_t last_J = J - (J0-1)*tile_J;
+  const size_t last_K = K - (K0-1)*tile_K;
+
+#define ceil_div(x, y) ((x) / (y) + ((x) % (y) != 0))
+  // Number of mvins across one row of tiles, along the J and K dimensions
+  const uint64_t J_mvins = (J0-1) * ceil_div(tile_J, MAX_BLOCK_LEN) + ceil_div(last_J, MAX_BLOCK_LEN);
+  const uint64_t K_mvins = (K0-1) * ceil_div(tile_K, MAX_BLOCK_LEN) + ceil_div(last_K, MAX_BLOCK_LEN);
+#undef ceil_div
+
+  // Each A tile is moved in once per column of tiles, and each B tile once
+  // per row of tiles, or only once if B is resident. The bias and output are
+  // moved once regardless of the tiling, so they're left out.
+  const size_t B_loads = weights_resident ? 1 : I0;
+
+  const uint64_t bytes = ((uint64_t)I * K * J0 + (uint64_t)K * J * B_loads) *
+    DIM * DIM * sizeof(elem_t);
+
+  uint64_t instructions =
+    (uint64_t)I * K_mvins * J0 +          // A mvins
+    (uint64_t)K * J_mvins * B_loads +     // B mvins
+    (uint64_t)I0 * J0 * K0 * 3;           // config_lds for each tile
+
+  if (dataflow == WS) {
+    // B is preloaded once for every row of tiles
+    instructions += (uint64_t)J * K * I0;
+  }
+
+  return bytes + instructions * TILING_BYTES_PER_INSTRUCTION;
+}
+
+// Enumerates every tiling which fits in the scratchpad and accumulator (the
+// same limits that tiled_matmul checks under GEMMINI_ASSERTIONS) and returns
+// the one that tiling_cost estimates to be cheapest. With weight-stationary
+// matmuls, this also considers keeping B resident, as "residency" allows.
+static struct tiling_factors_t tiled_matmul_search(size_t dim_I, size_t dim_J,
+        size_t dim_K, int dataflow, enum tiling_residency_t residency) {
+  const size_t I = dim_I / DIM + (dim_I % DIM != 0);
+  const size_t J = dim_J / DIM + (dim_J % DIM != 0);
+  const size_t K = dim_K / DIM + (dim_K % DIM != 0);
+
+  const size_t mats_in_spad = BANK_NUM * BANK_ROWS / DIM;
+  const size_t mats_in_acc = ACC_ROWS / DIM;
+
+  struct tiling_factors_t best = {1, 1, 1, false};
+  uint64_t best_cost = UINT64_MAX;
+
+  // Resident tilings are tried first, so they win ties
+  const bool try_resident = dataflow == WS && residency != TILING_RESIDENCY_NONE;
+
+  for (int resident = try_resident; resident >= 0; resident--) {
+    for (size_t tile_I = 1; tile_I <= I && tile_I <= mats_in_acc; tile_I++) {
+      for (size_t tile_J = 1; tile_J <= J && tile_I * tile_J <= mats_in_acc; tile_J++) {
+        // Both the DRAM traffic and the instruction count shrink as tile_K
+        // grows, so only the largest tile_K that fits needs to be considered.
+        // A resident column of B takes up K * tile_J blocks, leaving the
+        // rest for a single A tile.
+        size_t tile_K;
+        if (resident) {
+          if (K * tile_J + tile_I > mats_in_spad)
+            break;
+          tile_K = (mats_in_spad - K * tile_J) / tile_I;
+        } else if (dataflow == OS) {
+          // sp_tiled_matmul_os keeps A and B in separate halves
+          const size_t larger = tile_I > tile_J ? tile_I : tile_J;
+          if (larger > mats_in_spad / 2)
+            break;
+          tile_K = (mats_in_spad / 2) / larger;
+        } else {
+          if (tile_I + tile_J > mats_in_spad)
+            break;
+          tile_K = mats_in_spad / (tile_I + tile_J);
+        }
+
+        if (tile_K > K)
+          tile_K = K;
+
+        const uint64_t cost = tiling_cost(I, J, K, tile_I, tile_J, tile_K,
+            dataflow, resident);
+
+        if (cost < best_cost) {
+          best_cost = cost;
+          best.tile_I = tile_I;
+          best.tile_J = tile_J;
+          best.tile_K = tile_K;
+          best.weights_resident = resident;
+        }
+      }
+    }
+
+    // A forced residency only falls back if nothing fit
+    if (residency == TILING_RESIDENCY_WEIGHTS && best_cost != UINT64_MAX)
+      break;
+  }
+
+  return best;
+}
+
+// The tile search is cheap compared to the matmul itself, but the same shapes
+// tend to be multiplied over and over again (e.g. once per inference for each
+// layer of a DNN), so the resulting plans are cached.
+//
+// The cache can also be seeded with plans which were computed ahead of time.
+// Building a program with GEMMINI_TILING_PLANS_OUT set to a file name makes it
+// write every plan it used to that file when it exits. Building it again with
+// GEMMINI_TILING_PLANS set to that file name compiles those plans in, so that
+// no tile search has to run on Gemmini's host CPU at all. The file can only be
+// written on Linux or the host emulator, but it can be read on bare metal.
+#ifndef TILING_CACHE_SIZE
+#define TILING_CACHE_SIZE 64
+#endif
+
+struct tiling_cache_entry_t {
+  bool valid;
+  enum tiling_residency_t residency;
+  struct tiling_plan_t plan;
+};
+
+static struct tiling_cache_entry_t tiling_cache[TILING_CACHE_SIZE];
+
+#ifdef GEMMINI_TILING_PLANS
+#include GEMMINI_TILING_PLANS
+#endif
+
+#ifdef GEMMINI_TILING_PLANS_OUT
+static void tiled_matmul_write_plans(const char * path) {
+  FILE * f = fopen(path, "w");
+  if (f == NULL) {
+    printf("Couldn't open %s to write tiling plans\n", path);
+    exit(1);
+  }
+
+  fprintf(f, "// Generated by tiled_matmul_write_plans in include/gemmini.h\n");
+  fprintf(f, "// dim_I, dim_J, dim_K, dataflow, tile_I, tile_J, tile_K, I0, J0, K0,\n");
+  fprintf(f, "// last_I, last_J, last_K, padding_I, padding_J, padding_K, weights_resident\n");
+  fprintf(f, "static const struct tiling_plan_t tiling_plans[] = {\n");
+
+  for (size_t i = 0; i < TILING_CACHE_SIZE; i++) {
+    if (!tiling_cache[i].valid)
+      continue;
+
+    const struct tiling_plan_t * p = &tiling_cache[i].plan;
+    fprintf(f, "  {%zu, %zu, %zu, %d, %zu, %zu, %zu, %zu, %zu, %zu, %zu, %zu, %zu, %zu, %zu, %zu, %d},\n",
+        p->dim_I, p->dim_J, p->dim_K, p->dataflow,
+        p->tile_I, p->tile_J, p->tile_K, p->I0, p->J0, p->K0,
+        p->last_I, p->last_J, p->last_K,
+        p->padding_I, p->padding_J, p->padding_K, p->weights_resident);
+  }
+
+  fprintf(f, "};\n");
+  fclose(f);
+}
+
+static void tiled_matmul_write_plans_at_exit() {
+  tiled_matmul_write_plans(GEMMINI_TILING_PLANS_OUT);
+}
+#endif
+
+// Returns the plan that tiled_matmul_auto_residency would use for a matmul of
+// this shape. This can also be called at startup to populate the cache, so
+// that the tile search doesn't run later on.
+static const struct tiling_plan_t * tiled_matmul_plan_residency(size_t dim_I,
+        size_t dim_J, size_t dim_K, int dataflow,
+        enum tiling_residency_t residency) {
+  const size_t hash = (dim_I * 31 * 31 + dim_J * 31 + dim_K + dataflow * 3 + residency) %
+    TILING_CACHE_SIZE;
+  struct tiling_cache_entry_t * entry = &tiling_cache[hash];
+
+  // Linear probing, so that every shape gets its own entry until the cache
+  // fills up. After that, new shapes evict whatever they hash to.
+  for (size_t probe = 0; probe < TILING_CACHE_SIZE; probe++) {
+    struct tiling_cache_entry_t * e = &tiling_cache[(hash + probe) % TILING_CACHE_SIZE];
+
+    if (!e->valid) {
+      entry = e;
+      break;
+    } else if (e->plan.dim_I == dim_I && e->plan.dim_J == dim_J &&
+        e->plan.dim_K == dim_K && e->plan.dataflow == dataflow &&
+        e->residency == residency) {
+      return &e->plan;
+    }
+  }
+
+#ifdef GEMMINI_TILING_PLANS_OUT
+  static bool registered = false;
+  if (!registered) {
+    atexit(tiled_matmul_write_plans_at_exit);
+    registered = true;
+  }
+#endif
+
+  entry->valid = true;
+  entry->residency = residency;
+
+#ifdef GEMMINI_TILING_PLANS
+  for (size_t i = 0; i < sizeof(tiling_plans)/sizeof(tiling_plans[0]); i++) {
+    const struct tiling_plan_t * p = &tiling_plans[i];
+    if (p->dim_I == dim_I && p->dim_J == dim_J && p->dim_K == dim_K &&
+        p->dataflow == dataflow && (residency == TILING_RESIDENCY_AUTO ||
+          p->weights_resident == (residency == TILING_RESIDENCY_WEIGHTS))) {
+      entry->plan = *p;
+      return &entry->plan;
+    }
+  }
+#endif
+
+  struct tiling_factors_t t = tiled_matmul_search(dim_I, dim_J, dim_K,
+      dataflow, residency);
+  tiled_matmul_make_plan(&entry->plan, dim_I, dim_J, dim_K,
+      t.tile_I, t.tile_J, t.tile_K, dataflow);
+  entry->plan.weights_resident = t.weights_resident;
+
+  return &entry->plan;
+}
+
+// Returns the plan that tiled_matmul_auto would use for a matmul of this
+// shape
+static const struct tiling_plan_t * tiled_matmul_plan(size_t dim_I, size_t dim_J,
+        size_t dim_K, int dataflow) {
+  return tiled_matmul_plan_residency(dim_I, dim_J, dim_K, dataflow,
+      TILING_RESIDENCY_AUTO);
+}
+
+// This function runs a tiled matrix multiplication, with automatically
+// calculated tiling factors. "residency" chooses whether B's tiles are kept
+// in the scratchpad across rows of tiles, which saves moving B in again for
+// every row at the cost of smaller A tiles.
+void tiled_matmul_auto_residency(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J],
+        const acc_t * D, elem_t C[dim_I][dim_J],
+        int act, size_t shift, size_t relu6_shift, bool repeating_bias,
+        enum tiled_matmul_type_t tiled_matmul_type,
+        enum tiling_residency_t residency) {
+    if (tiled_matmul_type == CPU) {
+      matmul_cpu(dim_I, dim_J, dim_K,
+              A, B, D, C,
+              act, shift, relu6_shift, repeating_bias);
+      return;
+    }
+
+    // The plan always fits in the scratchpad and accumulator, so this skips
+    // the checks in tiled_matmul
+    const struct tiling_plan_t * plan = tiled_matmul_plan_residency(dim_I,
+        dim_J, dim_K, (int)tiled_matmul_type, residency);
+
+    tiled_matmul_outer(dim_I, dim_J, dim_K,
+        A, B, D, C,
+        plan,
+        act, shift, relu6_shift, repeating_bias,
+        false, ELEM_T_BITS, ELEM_T_BITS, ELEM_T_BITS);
+}
+
 // This function runs a tiled matrix multiplication, with automatically
 // calculated tiling factors
 void tiled_matmul_auto(size_t dim_I, size_t dim_J, size_t dim_K,
@@ -972,30 +2361,211 @@ void tiled_matmul_auto(size_t dim_I, size_t dim_J, size_t dim_K,
         const acc_t * D, elem_t C[dim_I][dim_J],
         int act, size_t shift, size_t relu6_shift, bool repeating_bias,
         enum tiled_matmul_type_t tiled_matmul_type) {
-#define partition_rows (BANK_NUM * BANK_ROWS / 2)
-#define mats_in_partition (partition_rows / DIM)
-#define mats_in_acc (ACC_ROWS / DIM)
-#define max_tile_i_j ((int)sqrt(mats_in_acc))
-#define max_tile_k (mats_in_partition / max_tile_i_j)
-
-    const size_t dim_I_padded = (dim_I / DIM + (dim_I % DIM != 0)) * DIM;
-    const size_t dim_J_padded = (dim_J / DIM + (dim_J % DIM != 0)) * DIM;
-    const size_t dim_K_padded = (dim_K / DIM + (dim_K % DIM != 0)) * DIM;
-
-    const size_t tile_I = dim_I_padded/DIM < max_tile_i_j ? dim_I_padded/DIM : max_tile_i_j;
-    const size_t tile_J = dim_J_padded/DIM < max_tile_i_j ? dim_J_padded/DIM : max_tile_i_j;
-    const size_t tile_K = dim_K_padded/DIM < max_tile_k ? dim_K_padded/DIM : max_tile_k;
-
-    tiled_matmul(dim_I, dim_J, dim_K,
-        A, B, D, C, act, shift, relu6_shift, repeating_bias,
-        tile_I, tile_J, tile_K,
-        tiled_matmul_type);
-
-#undef partition_rows
-#undef mats_in_partition
-#undef mats_in_acc
-#undef max_tile_i_j
-#undef max_tile_k
+    tiled_matmul_auto_residency(dim_I, dim_J, dim_K,
+        A, B, D, C,
+        act, shift, relu6_shift, repeating_bias,
+        tiled_matmul_type, TILING_RESIDENCY_AUTO);
+}
+
+// tiled_matmul_auto for A, B and C packed at A_precision, B_precision and
+// C_precision bits per element (see tiled_matmul_mixed_precision). The plans
+// don't depend on the precisions, since the scratchpad and accumulator always
+// hold unpacked elements.
+void tiled_matmul_auto_mixed_precision(size_t dim_I, size_t dim_J, size_t dim_K,
+        const void * A, const void * B,
+        const acc_t * D, void * C,
+        int act, size_t shift, size_t relu6_shift, bool repeating_bias,
+        enum tiled_matmul_type_t tiled_matmul_type,
+        int A_precision, int B_precision, int C_precision) {
+    tiled_matmul_check_precision(A_precision);
+    tiled_matmul_check_precision(B_precision);
+    tiled_matmul_check_precision(C_precision);
+
+    if (tiled_matmul_type == CPU) {
+      matmul_cpu_packed(dim_I, dim_J, dim_K,
+              A, B, D, C,
+              act, shift, relu6_shift, repeating_bias,
+              A_precision, B_precision, C_precision);
+      return;
+    }
+
+    const struct tiling_plan_t * plan = tiled_matmul_plan(dim_I, dim_J, dim_K,
+        (int)tiled_matmul_type);
+
+    tiled_matmul_outer(dim_I, dim_J, dim_K,
+        A, B, D, C,
+        plan,
+        act, shift, relu6_shift, repeating_bias,
+        false, A_precision, B_precision, C_precision);
+}
+
+// tiled_matmul_auto_mixed_precision with A, B and C all packed at "precision"
+// bits
+void tiled_matmul_auto_precision(size_t dim_I, size_t dim_J, size_t dim_K,
+        const void * A, const void * B,
+        const acc_t * D, void * C,
+        int act, size_t shift, size_t relu6_shift, bool repeating_bias,
+        enum tiled_matmul_type_t tiled_matmul_type,
+        int precision) {
+    tiled_matmul_auto_mixed_precision(dim_I, dim_J, dim_K,
+        A, B, D, C,
+        act, shift, relu6_shift, repeating_bias,
+        tiled_matmul_type, precision, precision, precision);
+}
+
+// Asynchronous matmuls
+//
+// tiled_matmul_auto_async issues a matmul's instructions and returns
+// without waiting for Gemmini to finish them, so the CPU can get on with
+// independent work (e.g. another layer's im2col) in the meantime. It returns
+// a token, and gemmini_wait(token) returns once that matmul has finished.
+//
+// Gemmini doesn't track dependencies through DRAM, so until then the CPU
+// must not write A, B or D, or touch C. A later matmul which reads C must be
+// passed the token as "after", which makes it wait first. Because Gemmini
+// only has one fence, waiting on any token also completes every matmul which
+// was issued before it.
+typedef uint64_t gemmini_token_t;
+
+// Matmuls which don't depend on anything can pass this as "after"
+#define GEMMINI_NO_TOKEN 0
+
+static gemmini_token_t gemmini_issued_token = 0;
+static gemmini_token_t gemmini_completed_token = 0;
+
+static void gemmini_wait(gemmini_token_t token) {
+  if (token > gemmini_completed_token) {
+    gemmini_fence();
+    gemmini_completed_token = gemmini_issued_token;
+  }
+}
+
+gemmini_token_t tiled_matmul_auto_async(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J],
+        const acc_t * D, elem_t C[dim_I][dim_J],
+        int act, size_t shift, size_t relu6_shift, bool repeating_bias,
+        enum tiled_matmul_type_t tiled_matmul_type,
+        gemmini_token_t after) {
+    gemmini_wait(after);
+
+    gemmini_issued_token++;
+
+    if (tiled_matmul_type == CPU) {
+      matmul_cpu(dim_I, dim_J, dim_K,
+              A, B, D, C,
+              act, shift, relu6_shift, repeating_bias);
+      return gemmini_issued_token;
+    }
+
+    const struct tiling_plan_t * plan = tiled_matmul_plan(dim_I, dim_J, dim_K,
+        (int)tiled_matmul_type);
+
+    tiled_matmul_outer_tiles(dim_I, dim_J, dim_K,
+        A, B, D, C,
+        plan, 0, plan->I0 * plan->J0,
+        act, shift, relu6_shift, repeating_bias,
+        false, ELEM_T_BITS, ELEM_T_BITS, ELEM_T_BITS);
+
+    return gemmini_issued_token;
+}
+
+// Multi-core tiled matmuls
+//
+// On SoCs with several harts, each driving its own Gemmini, tiled_matmul_mc
+// splits a matmul's output tiles between the harts. Every hart must call it
+// with the same arguments, plus its hart ID "cid" and the number of harts
+// "nc" (the arguments which riscv-tests' crt.S passes to thread_entry).
+
+// Waits until all nc harts have called this
+static void tiled_matmul_mc_barrier(size_t nc) {
+  static volatile size_t count = 0;
+  static volatile size_t generation = 0;
+
+  const size_t gen = generation;
+  __sync_synchronize();
+
+  if (__sync_fetch_and_add(&count, 1) == nc - 1) {
+    count = 0;
+    __sync_synchronize();
+    generation = gen + 1;
+  } else {
+    while (generation == gen);
+  }
+
+  __sync_synchronize();
+}
+
+// Starts from tiled_matmul_auto's plan, and shrinks its tiles until there
+// are at least as many output tiles as harts, if the matmul is big enough
+static void tiled_matmul_mc_plan(struct tiling_plan_t * plan,
+        size_t dim_I, size_t dim_J, size_t dim_K, int dataflow, size_t nc) {
+  *plan = *tiled_matmul_plan(dim_I, dim_J, dim_K, dataflow);
+
+  size_t tile_I = plan->tile_I, tile_J = plan->tile_J;
+
+  while (plan->I0 * plan->J0 < nc && (tile_I > 1 || tile_J > 1)) {
+    if (tile_J >= tile_I) {
+      tile_J = (tile_J + 1) / 2;
+    } else {
+      tile_I = (tile_I + 1) / 2;
+    }
+
+    tiled_matmul_make_plan(plan, dim_I, dim_J, dim_K,
+        tile_I, tile_J, plan->tile_K, dataflow);
+  }
+}
+
+// Runs hart cid's share of the output tiles, without waiting for the others.
+// Contiguous tiles go to the same hart, so that it reuses rows of A.
+static void tiled_matmul_mc_part(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J],
+        const acc_t * D, elem_t C[dim_I][dim_J],
+        const struct tiling_plan_t * plan,
+        int act, size_t shift, size_t relu6_shift, bool repeating_bias,
+        size_t cid, size_t nc) {
+  const size_t tiles = plan->I0 * plan->J0;
+
+  tiled_matmul_outer_tiles(dim_I, dim_J, dim_K,
+      A, B, D, C,
+      plan, tiles * cid / nc, tiles * (cid + 1) / nc,
+      act, shift, relu6_shift, repeating_bias,
+      false, ELEM_T_BITS, ELEM_T_BITS, ELEM_T_BITS);
+
+  gemmini_fence();
+}
+
+// Returns once every hart has finished its share. Because of the barriers,
+// this can't be run with nc > 1 on the host emulator, which only has one
+// hart; tiled_matmul_mc_part can be called for each cid in turn instead.
+void tiled_matmul_mc(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J],
+        const acc_t * D, elem_t C[dim_I][dim_J],
+        int act, size_t shift, size_t relu6_shift, bool repeating_bias,
+        enum tiled_matmul_type_t tiled_matmul_type,
+        size_t cid, size_t nc) {
+    static struct tiling_plan_t plan;
+
+    if (tiled_matmul_type == CPU) {
+      matmul_cpu_rows(dim_I * cid / nc, dim_I * (cid + 1) / nc, dim_J, dim_K,
+          &A[0][0], &B[0][0], D, &C[0][0],
+          act, shift, relu6_shift, repeating_bias);
+    } else {
+      // Only hart 0 touches the plan cache
+      if (cid == 0) {
+        tiled_matmul_mc_plan(&plan, dim_I, dim_J, dim_K,
+            (int)tiled_matmul_type, nc);
+      }
+
+      tiled_matmul_mc_barrier(nc);
+
+      tiled_matmul_mc_part(dim_I, dim_J, dim_K,
+          A, B, D, C,
+          &plan,
+          act, shift, relu6_shift, repeating_bias,
+          cid, nc);
+    }
+
+    tiled_matmul_mc_barrier(nc);
 }
 
 #endif // SRC_MAIN_C_GEMMINI_H
@@ -0,0 +1,380 @@
+// See LICENSE for license details.
+
+#ifndef SRC_MAIN_C_GEMMINI_EMU_H
+#define SRC_MAIN_C_GEMMINI_EMU_H
+
+// Functional model of Gemmini which runs natively on the host. When
+// GEMMINI_HOST_EMU is defined, gemmini.h routes every RoCC instruction to
+// gemmini_emu_exec() instead of emitting a custom3 opcode.
+//
+// The model executes each instruction to completion before returning, so
+// fences are no-ops unless the timing model in gemmini_perf.h is enabled with
+// GEMMINI_PERF_MODEL. Scratchpad rows hold one (sign-extended) element per
+// column regardless of the load precision; packed sub-byte values are only
+// unpacked on mvin and re-packed on mvout.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "include/gemmini_params.h"
+#ifdef GEMMINI_PERF_MODEL
+#include "include/gemmini_perf.h"
+#endif
+
+#define GEMMINI_EMU_SP_ROWS (BANK_NUM * BANK_ROWS)
+
+struct gemmini_emu_state_t {
+  // Configuration set by CONFIG_EX
+  int mode;
+  int act;
+  int sys_shift;
+  int acc_shift;
+  int relu6_shift;
+  int ex_precision;
+
+  // Configuration set by CONFIG_LD and CONFIG_ST
+  size_t load_stride;
+  int load_precision;
+  size_t store_stride;
+  int store_precision;
+
+  // Operands latched by the most recent preload
+  uint32_t preload_sp_addr;
+  size_t preload_cols, preload_rows;
+  uint32_t output_sp_addr;
+  size_t output_cols, output_rows;
+
+  // In OS mode, pe_state holds the partial sums. In WS mode, it holds the
+  // stationary weights.
+  acc_t pe_state[DIM][DIM];
+
+  elem_t spad[GEMMINI_EMU_SP_ROWS][DIM];
+  acc_t acc[ACC_ROWS][DIM];
+};
+
+static struct gemmini_emu_state_t gemmini_emu_state = {
+  .ex_precision = sizeof(elem_t) * 8,
+  .load_stride = DIM * sizeof(elem_t),
+  .load_precision = sizeof(elem_t) * 8,
+  .store_stride = DIM * sizeof(elem_t),
+  .store_precision = sizeof(elem_t) * 8,
+  .preload_sp_addr = GARBAGE_ADDR,
+  .output_sp_addr = GARBAGE_ADDR,
+};
+
+#define GEMMINI_EMU_IS_ACC(addr) (((addr) >> (ADDR_LEN-1)) & 1)
+#define GEMMINI_EMU_IS_ACCUMULATE(addr) (((addr) >> (ADDR_LEN-2)) & 1)
+#define GEMMINI_EMU_ROW(addr) ((addr) & ((1 << (ADDR_LEN-2)) - 1))
+
+static void gemmini_emu_check_row(uint32_t addr, size_t row) {
+  const size_t limit = GEMMINI_EMU_IS_ACC(addr) ? ACC_ROWS : GEMMINI_EMU_SP_ROWS;
+  if (GEMMINI_EMU_ROW(addr) + row >= limit) {
+    printf("gemmini_emu: %s row %u is out of bounds\n",
+        GEMMINI_EMU_IS_ACC(addr) ? "accumulator" : "scratchpad",
+        (unsigned)(GEMMINI_EMU_ROW(addr) + row));
+    exit(1);
+  }
+}
+
+static acc_t gemmini_emu_saturate(int64_t x, int precision) {
+  int bits = precision < (int)(sizeof(elem_t) * 8) ? precision : (int)(sizeof(elem_t) * 8);
+  int64_t max = (1LL << (bits - 1)) - 1;
+  int64_t min = -(1LL << (bits - 1));
+  return x > max ? max : (x < min ? min : x);
+}
+
+static acc_t gemmini_emu_activate(acc_t x) {
+  const struct gemmini_emu_state_t * s = &gemmini_emu_state;
+  if (s->act == RELU) {
+    return x < 0 ? 0 : x;
+  } else if (s->act == RELU6) {
+    const acc_t max = 6 << s->relu6_shift;
+    return x < 0 ? 0 : (x > max ? max : x);
+  }
+  return x;
+}
+
+// Reads element "col" of a DRAM row whose elements are packed at "precision"
+// bits. Sub-byte elements are stored lowest bits first.
+static elem_t gemmini_emu_load_elem(const uint8_t * row, size_t col, int precision) {
+  if (precision >= 8) {
+    return ((const elem_t *)row)[col];
+  }
+
+  const size_t bit = col * precision;
+  const int shift = 8 - precision;
+  const int8_t packed = row[bit / 8] >> (bit % 8);
+  return (int8_t)(packed << shift) >> shift;
+}
+
+static void gemmini_emu_store_elem(uint8_t * row, size_t col, int precision, elem_t x) {
+  if (precision >= 8) {
+    ((elem_t *)row)[col] = x;
+    return;
+  }
+
+  const size_t bit = col * precision;
+  const uint8_t mask = ((1 << precision) - 1) << (bit % 8);
+  const uint8_t val = (gemmini_emu_saturate(x, precision) << (bit % 8)) & mask;
+  row[bit / 8] = (row[bit / 8] & ~mask) | val;
+}
+
+static void gemmini_emu_config(uint64_t rs1, uint64_t rs2) {
+  struct gemmini_emu_state_t * s = &gemmini_emu_state;
+  const int type = rs1 & 3;
+
+  if (type == CONFIG_EX) {
+    s->mode = (rs1 >> 2) & 1;
+    s->act = (rs1 >> 3) & 3;
+    s->ex_precision = 1 << ((rs1 >> 29) & 7);
+    s->acc_shift = (uint32_t)(rs1 >> 32);
+    s->sys_shift = (uint32_t)rs2;
+    s->relu6_shift = (uint32_t)(rs2 >> 32);
+  } else if (type == CONFIG_LD) {
+    s->load_precision = 1 << ((rs1 >> 2) & 7);
+    s->load_stride = rs2;
+  } else if (type == CONFIG_ST) {
+    s->store_precision = 1 << ((rs1 >> 2) & 7);
+    s->store_stride = rs2;
+  }
+}
+
+static void gemmini_emu_mvin(uint64_t dram_addr, uint64_t rs2) {
+  struct gemmini_emu_state_t * s = &gemmini_emu_state;
+  const uint32_t sp_addr = (uint32_t)rs2;
+  const size_t cols = (rs2 >> ADDR_LEN) & 0xFFFF;
+  const size_t rows = (rs2 >> (ADDR_LEN + 16)) & 0xFFFF;
+  const uint32_t base = GEMMINI_EMU_ROW(sp_addr);
+
+  for (size_t row = 0; row < rows; row++) {
+    const uint8_t * dram_row = (const uint8_t *)(uintptr_t)dram_addr + row * s->load_stride;
+
+    for (size_t col = 0; col < cols; col++) {
+      const size_t sp_row = row + (col / DIM) * DIM;
+      gemmini_emu_check_row(sp_addr, sp_row);
+
+      if (GEMMINI_EMU_IS_ACC(sp_addr)) {
+        const acc_t x = ((const acc_t *)dram_row)[col];
+        if (GEMMINI_EMU_IS_ACCUMULATE(sp_addr))
+          s->acc[base + sp_row][col % DIM] += x;
+        else
+          s->acc[base + sp_row][col % DIM] = x;
+      } else {
+        s->spad[base + sp_row][col % DIM] = gemmini_emu_load_elem(dram_row, col, s->load_precision);
+      }
+    }
+  }
+}
+
+static void gemmini_emu_mvout(uint64_t dram_addr, uint64_t rs2) {
+  struct gemmini_emu_state_t * s = &gemmini_emu_state;
+  const uint32_t sp_addr = (uint32_t)rs2;
+  const size_t cols = (rs2 >> ADDR_LEN) & 0xFFFF;
+  const size_t rows = (rs2 >> (ADDR_LEN + 16)) & 0xFFFF;
+  const uint32_t base = GEMMINI_EMU_ROW(sp_addr);
+
+  for (size_t row = 0; row < rows; row++) {
+    uint8_t * dram_row = (uint8_t *)(uintptr_t)dram_addr + row * s->store_stride;
+
+    for (size_t col = 0; col < cols; col++) {
+      const size_t sp_row = row + (col / DIM) * DIM;
+      gemmini_emu_check_row(sp_addr, sp_row);
+
+      elem_t x;
+      if (GEMMINI_EMU_IS_ACC(sp_addr)) {
+        // Values read out of the accumulator are scaled down, clipped, and
+        // then passed through the activation function
+        const acc_t full = s->acc[base + sp_row][col % DIM];
+        const int64_t shifted = ROUNDING_RIGHT_SHIFT((int64_t)full, s->acc_shift);
+        x = gemmini_emu_activate(gemmini_emu_saturate(shifted, sizeof(elem_t) * 8));
+      } else {
+        x = s->spad[base + sp_row][col % DIM];
+      }
+
+      gemmini_emu_store_elem(dram_row, col, s->store_precision, x);
+    }
+  }
+}
+
+static void gemmini_emu_preload(uint64_t rs1, uint64_t rs2) {
+  struct gemmini_emu_state_t * s = &gemmini_emu_state;
+  s->preload_sp_addr = (uint32_t)rs1;
+  s->preload_cols = (rs1 >> ADDR_LEN) & 0xFFFF;
+  s->preload_rows = (rs1 >> (ADDR_LEN + 16)) & 0xFFFF;
+  s->output_sp_addr = (uint32_t)rs2;
+  s->output_cols = (rs2 >> ADDR_LEN) & 0xFFFF;
+  s->output_rows = (rs2 >> (ADDR_LEN + 16)) & 0xFFFF;
+}
+
+// Reads a DIM x DIM block out of the scratchpad, replacing everything outside
+// of rows x cols (or the whole block, for GARBAGE_ADDR) with zeros
+static void gemmini_emu_read_block(uint32_t addr, size_t cols, size_t rows, acc_t out[DIM][DIM]) {
+  struct gemmini_emu_state_t * s = &gemmini_emu_state;
+
+  for (size_t i = 0; i < DIM; i++)
+    for (size_t j = 0; j < DIM; j++)
+      out[i][j] = 0;
+
+  if (addr == GARBAGE_ADDR)
+    return;
+
+  for (size_t i = 0; i < rows && i < DIM; i++) {
+    gemmini_emu_check_row(addr, i);
+    for (size_t j = 0; j < cols && j < DIM; j++)
+      out[i][j] = s->spad[GEMMINI_EMU_ROW(addr) + i][j];
+  }
+}
+
+static void gemmini_emu_compute(uint64_t rs1, uint64_t rs2, bool preloaded) {
+  struct gemmini_emu_state_t * s = &gemmini_emu_state;
+
+  acc_t a[DIM][DIM];
+  acc_t bd[DIM][DIM];
+  gemmini_emu_read_block((uint32_t)rs1, (rs1 >> ADDR_LEN) & 0xFFFF,
+      (rs1 >> (ADDR_LEN + 16)) & 0xFFFF, a);
+  gemmini_emu_read_block((uint32_t)rs2, (rs2 >> ADDR_LEN) & 0xFFFF,
+      (rs2 >> (ADDR_LEN + 16)) & 0xFFFF, bd);
+
+  if (preloaded) {
+    gemmini_emu_read_block(s->preload_sp_addr, s->preload_cols,
+        s->preload_rows, s->pe_state);
+  }
+
+  // In WS mode, "bd" is the bias D. In OS mode, it is the B matrix
+  static acc_t results[DIM][DIM];
+  if (s->mode == WEIGHT_STATIONARY) {
+    memcpy(results, bd, sizeof(results));
+    for (size_t i = 0; i < DIM; i++)
+      for (size_t k = 0; k < DIM; k++) {
+        const acc_t a_ik = a[i][k];
+        for (size_t j = 0; j < DIM; j++)
+          results[i][j] += a_ik * s->pe_state[k][j];
+      }
+  } else {
+    for (size_t i = 0; i < DIM; i++)
+      for (size_t k = 0; k < DIM; k++) {
+        const acc_t a_ik = a[i][k];
+        for (size_t j = 0; j < DIM; j++)
+          s->pe_state[i][j] += a_ik * bd[k][j];
+      }
+    memcpy(results, s->pe_state, sizeof(results));
+  }
+
+  const uint32_t out_addr = s->output_sp_addr;
+  if (out_addr == GARBAGE_ADDR)
+    return;
+
+  for (size_t i = 0; i < s->output_rows && i < DIM; i++) {
+    gemmini_emu_check_row(out_addr, i);
+    const uint32_t row = GEMMINI_EMU_ROW(out_addr) + i;
+
+    for (size_t j = 0; j < s->output_cols && j < DIM; j++) {
+      if (GEMMINI_EMU_IS_ACC(out_addr)) {
+        if (GEMMINI_EMU_IS_ACCUMULATE(out_addr))
+          s->acc[row][j] += results[i][j];
+        else
+          s->acc[row][j] = results[i][j];
+      } else {
+        const int64_t shifted = ROUNDING_RIGHT_SHIFT((int64_t)results[i][j], s->sys_shift);
+        s->spad[row][j] = gemmini_emu_activate(gemmini_emu_saturate(shifted, s->ex_precision));
+      }
+    }
+  }
+}
+
+static void gemmini_emu_loop_ws(uint64_t rs1, uint64_t rs2);
+
+static void gemmini_emu_run(uint64_t rs1, uint64_t rs2, int funct) {
+  switch (funct) {
+    case k_CONFIG:
+      gemmini_emu_config(rs1, rs2);
+      break;
+    case k_MVIN:
+      gemmini_emu_mvin(rs1, rs2);
+      break;
+    case k_MVOUT:
+      gemmini_emu_mvout(rs1, rs2);
+      break;
+    case k_COMPUTE_PRELOADED:
+      gemmini_emu_compute(rs1, rs2, true);
+      break;
+    case k_COMPUTE_ACCUMULATE:
+      gemmini_emu_compute(rs1, rs2, false);
+      break;
+    case k_PRELOAD:
+      gemmini_emu_preload(rs1, rs2);
+      break;
+    case k_FLUSH:
+      // There is no TLB to flush
+      break;
+    case k_LOOP_WS:
+      gemmini_emu_loop_ws(rs1, rs2);
+      break;
+    default:
+      printf("gemmini_emu: unknown funct %d\n", funct);
+      exit(1);
+  }
+}
+
+static void gemmini_emu_exec(uint64_t rs1, uint64_t rs2, int funct) {
+#ifdef GEMMINI_PERF_MODEL
+  gemmini_perf_exec(rs1, rs2, funct);
+#endif
+
+  gemmini_emu_run(rs1, rs2, funct);
+}
+
+// Runs an instruction which the hardware generates itself while unrolling a
+// loop, without the CPU having to issue it
+static void gemmini_emu_exec_unrolled(uint64_t rs1, uint64_t rs2, int funct) {
+#ifdef GEMMINI_PERF_MODEL
+  gemmini_perf_exec_unrolled(rs1, rs2, funct);
+#endif
+
+  gemmini_emu_run(rs1, rs2, funct);
+}
+
+#define GEMMINI_EMU_OPERAND(addr, cols, rows) \
+  (((uint64_t)(rows) << (ADDR_LEN + 16)) | ((uint64_t)(cols) << ADDR_LEN) | (uint64_t)(addr))
+
+// Unrolls gemmini_loop_ws into the same preloads and computes that
+// sp_tiled_matmul_ws_compute issues for an unpadded tile
+static void gemmini_emu_loop_ws(uint64_t rs1, uint64_t rs2) {
+  const uint32_t A_sp_addr_start = (uint32_t)rs1;
+  const uint32_t B_sp_addr_start = (uint32_t)(rs1 >> 32);
+  const size_t I = rs2 & 0xFFFF;
+  const size_t J = (rs2 >> 16) & 0xFFFF;
+  const size_t K = (rs2 >> 32) & 0xFFFF;
+  const bool bias = (rs2 >> 48) & 1;
+  const uint32_t C_sp_addr_start = ((uint32_t)3 << (ADDR_LEN-2)) + (uint32_t)(rs2 >> 49) * DIM;
+
+  for (size_t j = 0; j < J; j++) {
+    for (size_t k = 0; k < K; k++) {
+      const uint32_t B_sp_addr = B_sp_addr_start + (k*J + j)*DIM;
+
+      for (size_t i = 0; i < I; i++) {
+        const uint32_t A_sp_addr = A_sp_addr_start + (i*K + k)*DIM;
+        const uint32_t pre_sp_addr = i == 0 ? B_sp_addr : GARBAGE_ADDR;
+        uint32_t out_sp_addr = C_sp_addr_start + (i*J + j)*DIM;
+
+        // Without a bias, the first partial sum overwrites the accumulator
+        if (!bias && k == 0)
+          out_sp_addr &= ~((uint32_t)1 << (ADDR_LEN-2));
+
+        gemmini_emu_exec_unrolled(GEMMINI_EMU_OPERAND(pre_sp_addr, DIM, DIM),
+            GEMMINI_EMU_OPERAND(out_sp_addr, DIM, DIM), k_PRELOAD);
+        gemmini_emu_exec_unrolled(GEMMINI_EMU_OPERAND(A_sp_addr, DIM, DIM),
+            GEMMINI_EMU_OPERAND(GARBAGE_ADDR, DIM, DIM),
+            i == 0 ? k_COMPUTE_PRELOADED : k_COMPUTE_ACCUMULATE);
+      }
+    }
+  }
+}
+
+static void gemmini_emu_fence() {
+#ifdef GEMMINI_PERF_MODEL
+  gemmini_perf_fence();
+#endif
+}
+
+#endif // SRC_MAIN_C_GEMMINI_EMU_H
@@ -0,0 +1,616 @@
+// See LICENSE for license details.
+
+#ifndef SRC_MAIN_C_GEMMINI_MODEL_H
+#define SRC_MAIN_C_GEMMINI_MODEL_H
+
+// Model files
+//
+// Instead of compiling a network's weights in as C arrays, which makes the
+// generated parameter headers tens of megabytes of initializers, they can be
+// kept in a model file: a header, a table of named entries, and the entries'
+// data, each aligned to MODEL_ALIGN bytes so that it can be moved in as it
+// is. Entries are elem_t or acc_t tensors, or the ConvParams and FcParams of
+// a layer, named like the arrays of the generated headers (conv_1_w, conv_1_b,
+// conv_1_params, ...).
+//
+// A model is used wherever its bytes already are: model_load maps a file on
+// Linux, and MODEL_INCBIN links one into a bare-metal binary as a raw
+// section. model_open only checks the header and the entry table, and decodes
+// the layer parameters. Tensors are never copied, so loading a model doesn't
+// cost anything per weight, and a different model can be loaded without
+// recompiling.
+//
+// Models are written into a buffer with model_writer_init and the
+// model_write_* functions, or from generated parameter headers with
+// tools/gemmini_model_pack.c. All fields are little-endian.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#ifndef BAREMETAL
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+#include "include/gemmini_net.h"
+
+// The header, the entry table and the tensors are all read in place, as
+// native integers, so models can only be written and read on little-endian
+// hosts, like Gemmini's
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Gemmini model files are little-endian, and can only be used on little-endian hosts"
+#endif
+
+#define MODEL_MAGIC "GEMMODEL"
+#define MODEL_VERSION 1
+
+// Every entry's data starts on a multiple of this many bytes, so tensors are
+// at least as aligned as row_align(1) arrays
+#define MODEL_ALIGN 64
+#define MODEL_ALIGN_STR "64"
+
+#define MODEL_NAME_LEN 48
+#define MODEL_MAX_DIMS 4
+
+// The most ConvParams, and the most FcParams, which one model can have
+#ifndef MODEL_MAX_PARAMS
+#define MODEL_MAX_PARAMS 256
+#endif
+
+enum model_entry_type_t {
+  MODEL_ELEM, MODEL_ACC, MODEL_CONV_PARAMS, MODEL_FC_PARAMS,
+};
+
+struct model_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t n_entries;
+  uint32_t elem_bits, acc_bits; // The widths of elem_t and acc_t it was written for
+  uint64_t size; // Of the whole model, in bytes
+};
+
+struct model_entry_t {
+  char name[MODEL_NAME_LEN]; // NUL-terminated
+  uint32_t type;
+  uint32_t precision; // Bits per element of MODEL_ELEM tensors, which are packed below ELEM_T_BITS
+  uint32_t n_dims;
+  uint32_t dims[MODEL_MAX_DIMS];
+  uint32_t reserved;
+  uint64_t offset, bytes; // From the start of the model
+};
+
+// ConvParams and FcParams are stored as one int32_t per field, in this order
+#define MODEL_CONV_PARAMS_FIELDS(X) \
+  X(batch_size) X(in_dim) X(out_dim) X(kernel_size) X(in_channels) \
+  X(out_channels) X(stride) X(padding) X(bias) X(depthwise) X(n_patches) \
+  X(patch_size) X(output_scale) X(res_scale) X(pool_size) X(pool_stride) \
+  X(pool_padding) X(out_dim_pooled) X(I) X(J) X(K)
+
+#define MODEL_FC_PARAMS_FIELDS(X) \
+  X(batch_size) X(in_features) X(out_features) X(output_scale) X(bias) \
+  X(I) X(J) X(K)
+
+#define MODEL_COUNT_FIELD(field) + 1
+#define MODEL_CONV_PARAMS_N_FIELDS (0 MODEL_CONV_PARAMS_FIELDS(MODEL_COUNT_FIELD))
+#define MODEL_FC_PARAMS_N_FIELDS (0 MODEL_FC_PARAMS_FIELDS(MODEL_COUNT_FIELD))
+
+#define model_align(bytes) (((bytes) + MODEL_ALIGN - 1) / MODEL_ALIGN * MODEL_ALIGN)
+
+// Bytes before the first entry's data, with room for n_entries entries
+#define model_table_bytes(n_entries) \
+  model_align(sizeof(struct model_header_t) + (n_entries) * sizeof(struct model_entry_t))
+
+struct model_t {
+  const uint8_t * data;
+  size_t size;
+  const struct model_header_t * header;
+  const struct model_entry_t * entries;
+
+  // Set if model_load mapped the model, which model_close unmaps again
+  bool mapped;
+
+  // The decoded layer parameters, and the entries they were decoded from
+  struct ConvParams conv_params[MODEL_MAX_PARAMS];
+  struct FcParams fc_params[MODEL_MAX_PARAMS];
+  const struct model_entry_t * conv_entries[MODEL_MAX_PARAMS];
+  const struct model_entry_t * fc_entries[MODEL_MAX_PARAMS];
+  size_t n_conv_params, n_fc_params;
+};
+
+// Tensors are rows x cols, where cols is the last dimension and rows is
+// every other dimension multiplied together
+static size_t model_entry_rows(const struct model_entry_t * e) {
+  size_t rows = 1;
+  for (uint32_t d = 0; d + 1 < e->n_dims; d++)
+    rows *= e->dims[d];
+  return rows;
+}
+
+static size_t model_entry_cols(const struct model_entry_t * e) {
+  return e->dims[e->n_dims - 1];
+}
+
+// The bytes which an entry's data must take up, given its type and shape.
+// Packed rows start on a byte boundary, as in pack_matrix.
+static uint64_t model_entry_bytes(const struct model_entry_t * e) {
+  const uint64_t rows = model_entry_rows(e), cols = model_entry_cols(e);
+
+  switch (e->type) {
+    case MODEL_ELEM:
+      return rows * packed_bytes(cols, e->precision);
+    case MODEL_ACC:
+      return rows * cols * sizeof(acc_t);
+    default:
+      return rows * cols * sizeof(int32_t);
+  }
+}
+
+static void model_check_entry(const struct model_t * m, const struct model_entry_t * e) {
+  if (memchr(e->name, 0, MODEL_NAME_LEN) == NULL) {
+    printf("Model entry name isn't terminated\n");
+    exit(1);
+  }
+
+  bool valid = e->type <= MODEL_FC_PARAMS && e->n_dims >= 1 && e->n_dims <= MODEL_MAX_DIMS;
+  if (valid && e->type == MODEL_ELEM)
+    valid = e->precision == ELEM_T_BITS || e->precision == 4 || e->precision == 2;
+  if (valid && e->type == MODEL_CONV_PARAMS)
+    valid = e->n_dims == 1 && e->dims[0] == MODEL_CONV_PARAMS_N_FIELDS;
+  if (valid && e->type == MODEL_FC_PARAMS)
+    valid = e->n_dims == 1 && e->dims[0] == MODEL_FC_PARAMS_N_FIELDS;
+
+  if (!valid) {
+    printf("Model entry %s has an invalid type or shape\n", e->name);
+    exit(1);
+  }
+
+  if (e->offset % MODEL_ALIGN != 0 || e->offset < model_table_bytes(m->header->n_entries) ||
+      e->offset > m->header->size || e->bytes > m->header->size - e->offset ||
+      e->bytes != model_entry_bytes(e)) {
+    printf("Model entry %s is out of bounds\n", e->name);
+    exit(1);
+  }
+}
+
+static void model_decode_params(struct model_t * m, const struct model_entry_t * e) {
+  const int32_t * fields = (const int32_t *)(m->data + e->offset);
+  size_t f = 0;
+
+#define MODEL_DECODE_FIELD(field) p->field = fields[f++];
+
+  if (e->type == MODEL_CONV_PARAMS) {
+    if (m->n_conv_params == MODEL_MAX_PARAMS) {
+      printf("Model has more than %d ConvParams\n", MODEL_MAX_PARAMS);
+      exit(1);
+    }
+
+    struct ConvParams * p = &m->conv_params[m->n_conv_params];
+    memset(p, 0, sizeof(*p));
+    MODEL_CONV_PARAMS_FIELDS(MODEL_DECODE_FIELD)
+    m->conv_entries[m->n_conv_params++] = e;
+  } else {
+    if (m->n_fc_params == MODEL_MAX_PARAMS) {
+      printf("Model has more than %d FcParams\n", MODEL_MAX_PARAMS);
+      exit(1);
+    }
+
+    struct FcParams * p = &m->fc_params[m->n_fc_params];
+    memset(p, 0, sizeof(*p));
+    MODEL_FC_PARAMS_FIELDS(MODEL_DECODE_FIELD)
+    m->fc_entries[m->n_fc_params++] = e;
+  }
+
+#undef MODEL_DECODE_FIELD
+}
+
+// Opens the model in the "size" bytes at "data", which must stay there for
+// as long as the model is used
+static void model_open(struct model_t * m, const void * data, size_t size) {
+  memset(m, 0, sizeof(*m));
+  m->data = (const uint8_t *)data;
+  m->size = size;
+  m->header = (const struct model_header_t *)data;
+  m->entries = (const struct model_entry_t *)(m->data + sizeof(struct model_header_t));
+
+  const struct model_header_t * h = m->header;
+
+  if ((uintptr_t)data % MODEL_ALIGN != 0) {
+    printf("Model isn't aligned to %d bytes\n", MODEL_ALIGN);
+    exit(1);
+  }
+
+  if (size < sizeof(*h) || memcmp(h->magic, MODEL_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != MODEL_VERSION) {
+    printf("Not a version %d model\n", MODEL_VERSION);
+    exit(1);
+  }
+
+  if (h->elem_bits != sizeof(elem_t) * 8 || h->acc_bits != sizeof(acc_t) * 8) {
+    printf("Model was written for %u-bit elem_t and %u-bit acc_t\n",
+        h->elem_bits, h->acc_bits);
+    exit(1);
+  }
+
+  if (h->size > size || model_table_bytes((uint64_t)h->n_entries) > h->size) {
+    printf("Model is truncated\n");
+    exit(1);
+  }
+
+  for (uint32_t i = 0; i < h->n_entries; i++) {
+    const struct model_entry_t * e = &m->entries[i];
+    model_check_entry(m, e);
+
+    if (e->type == MODEL_CONV_PARAMS || e->type == MODEL_FC_PARAMS)
+      model_decode_params(m, e);
+  }
+}
+
+// Returns the entry called "name", or NULL if there isn't one
+static const struct model_entry_t * model_find(const struct model_t * m, const char * name) {
+  for (uint32_t i = 0; i < m->header->n_entries; i++)
+    if (strcmp(m->entries[i].name, name) == 0)
+      return &m->entries[i];
+
+  return NULL;
+}
+
+static const struct model_entry_t * model_get(const struct model_t * m, const char * name,
+    enum model_entry_type_t type) {
+  const struct model_entry_t * e = model_find(m, name);
+
+  if (e == NULL) {
+    printf("Model has no entry called %s\n", name);
+    exit(1);
+  }
+
+  if (e->type != type) {
+    printf("Model entry %s has the wrong type\n", name);
+    exit(1);
+  }
+
+  return e;
+}
+
+// Tensors can be used as rows x cols if their leading dimensions multiply to
+// rows and the rest to cols, so [channels][3][3] weights are channels x 9, and
+// a bias of [J] is 1 x J. Packed tensors can only be split before their last
+// dimension, since each of their rows starts on a byte boundary.
+static void model_check_shape(const struct model_entry_t * e, size_t rows, size_t cols) {
+  const bool packed = e->type == MODEL_ELEM && e->precision != ELEM_T_BITS;
+
+  for (uint32_t split = packed ? e->n_dims - 1 : 0; split <= e->n_dims; split++) {
+    size_t r = 1, c = 1;
+    for (uint32_t d = 0; d < e->n_dims; d++)
+      *(d < split ? &r : &c) *= e->dims[d];
+
+    if (r == rows && c == cols)
+      return;
+  }
+
+  printf("Model entry %s is %zux%zu (expected %zux%zu)\n", e->name,
+      model_entry_rows(e), model_entry_cols(e), rows, cols);
+  exit(1);
+}
+
+// The rows x cols elem_t tensor called "name", packed at "precision" bits
+// (see pack_matrix) unless that is ELEM_T_BITS
+static const elem_t * model_elems(const struct model_t * m, const char * name,
+    size_t rows, size_t cols, int precision) {
+  const struct model_entry_t * e = model_get(m, name, MODEL_ELEM);
+  model_check_shape(e, rows, cols);
+
+  if (e->precision != precision) {
+    printf("Model entry %s is packed at %u bits (expected %d)\n", name, e->precision, precision);
+    exit(1);
+  }
+
+  return (const elem_t *)(m->data + e->offset);
+}
+
+// The rows x cols acc_t tensor called "name"
+static const acc_t * model_accs(const struct model_t * m, const char * name,
+    size_t rows, size_t cols) {
+  const struct model_entry_t * e = model_get(m, name, MODEL_ACC);
+  model_check_shape(e, rows, cols);
+  return (const acc_t *)(m->data + e->offset);
+}
+
+static const struct ConvParams * model_conv_params(const struct model_t * m, const char * name) {
+  const struct model_entry_t * e = model_get(m, name, MODEL_CONV_PARAMS);
+
+  for (size_t i = 0; i < m->n_conv_params; i++)
+    if (m->conv_entries[i] == e)
+      return &m->conv_params[i];
+
+  return NULL;
+}
+
+static const struct FcParams * model_fc_params(const struct model_t * m, const char * name) {
+  const struct model_entry_t * e = model_get(m, name, MODEL_FC_PARAMS);
+
+  for (size_t i = 0; i < m->n_fc_params; i++)
+    if (m->fc_entries[i] == e)
+      return &m->fc_params[i];
+
+  return NULL;
+}
+
+// Writes "<layer><suffix>", the name of one of a layer's entries, to "name"
+static void model_layer_entry(char name[MODEL_NAME_LEN], const char * layer, const char * suffix) {
+  if (strlen(layer) + strlen(suffix) >= MODEL_NAME_LEN) {
+    printf("Model entry name %s%s is too long\n", layer, suffix);
+    exit(1);
+  }
+
+  strcpy(name, layer);
+  strcat(name, suffix);
+}
+
+// Adds a conv layer to a network, with the model's <name>_w, <name>_b and
+// <name>_params as its weights, bias and parameters
+static void model_net_conv(struct net_t * net, const struct model_t * m, char * name,
+    int input, int output, int act, elem_t * patches) {
+  char entry[MODEL_NAME_LEN];
+
+  model_layer_entry(entry, name, "_params");
+  const struct ConvParams * p = model_conv_params(m, entry);
+
+  model_layer_entry(entry, name, "_w");
+  const elem_t * weights = model_elems(m, entry, p->K, p->J, ELEM_T_BITS);
+
+  model_layer_entry(entry, name, "_b");
+  const acc_t * bias = p->bias ? model_accs(m, entry, 1, p->J) : NULL;
+
+  net_conv(net, name, input, output, weights, bias, act, p, patches);
+}
+
+// Like model_net_conv, for depthwise convs, whose weights are
+// [channels][kernel_size][kernel_size]
+static void model_net_conv_dw(struct net_t * net, const struct model_t * m, char * name,
+    int input, int output) {
+  char entry[MODEL_NAME_LEN];
+
+  model_layer_entry(entry, name, "_params");
+  const struct ConvParams * p = model_conv_params(m, entry);
+
+  model_layer_entry(entry, name, "_w");
+  const elem_t * weights = model_elems(m, entry, p->out_channels,
+      p->kernel_size * p->kernel_size, ELEM_T_BITS);
+
+  model_layer_entry(entry, name, "_b");
+  const acc_t * bias = p->bias ? model_accs(m, entry, 1, p->J) : NULL;
+
+  net_conv_dw(net, name, input, output, weights, bias, p);
+}
+
+// Like model_net_conv, for FC layers, whose bias is I x J
+static void model_net_fc(struct net_t * net, const struct model_t * m, char * name,
+    int input, int output, int act) {
+  char entry[MODEL_NAME_LEN];
+
+  model_layer_entry(entry, name, "_params");
+  const struct FcParams * f = model_fc_params(m, entry);
+
+  model_layer_entry(entry, name, "_w");
+  const elem_t * weights = model_elems(m, entry, f->I, f->K, ELEM_T_BITS);
+
+  model_layer_entry(entry, name, "_b");
+  const acc_t * bias = f->bias ? model_accs(m, entry, f->I, f->J) : NULL;
+
+  net_fc(net, name, input, output, weights, bias, act, f);
+}
+
+// Links the model file at "path" into a bare-metal binary, as the bytes from
+// sym to sym##_end, in a read-only section of its own:
+//
+//   MODEL_INCBIN(resnet50_model, "resnet50.model");
+//   ...
+//   model_open(&model, resnet50_model, resnet50_model_end - resnet50_model);
+//
+// The assembler looks for "path" relative to the directory it runs in, or in
+// directories passed to it with -Wa,-I.
+#define MODEL_INCBIN(sym, path) \
+  __asm__(".pushsection .rodata." #sym ", \"a\"\n" \
+      ".balign " MODEL_ALIGN_STR "\n" \
+      ".global " #sym "\n" \
+      #sym ":\n" \
+      ".incbin \"" path "\"\n" \
+      ".global " #sym "_end\n" \
+      #sym "_end:\n" \
+      ".popsection\n"); \
+  extern const uint8_t sym[], sym##_end[]
+
+#ifndef BAREMETAL
+// Maps the model file at "path" read-only, and opens it. Its pages are read
+// in from the file when they're first touched, unless "populate" is set, in
+// which case they're all read in and mapped up front (MAP_POPULATE), so that
+// the first inference doesn't fault on them. Either way, they aren't locked
+// (see net_lock_layers).
+static void model_load(struct model_t * m, const char * path, bool populate) {
+  const int fd = open(path, O_RDONLY);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(path);
+    exit(1);
+  }
+
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  if (populate)
+    flags |= MAP_POPULATE;
+#endif
+
+  void * data = mmap(NULL, st.st_size, PROT_READ, flags, fd, 0);
+  if (data == MAP_FAILED) {
+    perror("mmap failed");
+    exit(1);
+  }
+
+  close(fd);
+
+  model_open(m, data, st.st_size);
+  m->mapped = true;
+}
+
+static void model_close(struct model_t * m) {
+  if (m->mapped)
+    munmap((void *)m->data, m->size);
+
+  m->data = NULL;
+  m->mapped = false;
+}
+
+// Writes a model which was built with model_writer_init to a file
+static void model_save(const char * path, const void * data, size_t size) {
+  FILE * f = fopen(path, "wb");
+
+  if (f == NULL || fwrite(data, 1, size, f) != size || fclose(f) != 0) {
+    perror(path);
+    exit(1);
+  }
+}
+#endif
+
+struct model_writer_t {
+  uint8_t * data;
+  size_t capacity, size;
+  size_t max_entries, n_entries;
+};
+
+// Starts a model in the "capacity" bytes at "data", which must be aligned to
+// MODEL_ALIGN bytes, with room for up to max_entries entries
+static void model_writer_init(struct model_writer_t * w, void * data, size_t capacity,
+    size_t max_entries) {
+  w->data = (uint8_t *)data;
+  w->capacity = capacity;
+  w->size = model_table_bytes(max_entries);
+  w->max_entries = max_entries;
+  w->n_entries = 0;
+
+  if ((uintptr_t)data % MODEL_ALIGN != 0) {
+    printf("Model buffer isn't aligned to %d bytes\n", MODEL_ALIGN);
+    exit(1);
+  }
+
+  if (w->size > capacity) {
+    printf("Model is larger than %zu bytes\n", capacity);
+    exit(1);
+  }
+
+  memset(data, 0, w->size);
+}
+
+// Adds an entry, copying its data, which must be as large as the entry's
+// type and dimensions say (see model_entry_bytes)
+static void model_write_entry(struct model_writer_t * w, const char * name,
+    enum model_entry_type_t type, int precision,
+    size_t n_dims, const size_t * dims, const void * data) {
+  struct model_entry_t e;
+  memset(&e, 0, sizeof(e));
+
+  if (strlen(name) >= MODEL_NAME_LEN) {
+    printf("Model entry name %s is too long\n", name);
+    exit(1);
+  }
+
+  if (n_dims < 1 || n_dims > MODEL_MAX_DIMS) {
+    printf("Model entry %s has %zu dimensions\n", name, n_dims);
+    exit(1);
+  }
+
+  if (w->n_entries == w->max_entries) {
+    printf("Model has more than %zu entries\n", w->max_entries);
+    exit(1);
+  }
+
+  const struct model_entry_t * entries =
+    (const struct model_entry_t *)(w->data + sizeof(struct model_header_t));
+  for (size_t i = 0; i < w->n_entries; i++)
+    if (strcmp(entries[i].name, name) == 0) {
+      printf("Model already has an entry called %s\n", name);
+      exit(1);
+    }
+
+  strcpy(e.name, name);
+  e.type = type;
+  e.precision = precision;
+  e.n_dims = n_dims;
+  for (size_t d = 0; d < n_dims; d++)
+    e.dims[d] = dims[d];
+  e.offset = w->size;
+  e.bytes = model_entry_bytes(&e);
+
+  if (w->size + model_align(e.bytes) > w->capacity) {
+    printf("Model is larger than %zu bytes\n", w->capacity);
+    exit(1);
+  }
+
+  memcpy(w->data + w->size, data, e.bytes);
+  memset(w->data + w->size + e.bytes, 0, model_align(e.bytes) - e.bytes);
+  w->size += model_align(e.bytes);
+
+  memcpy(w->data + sizeof(struct model_header_t) + w->n_entries * sizeof(e), &e, sizeof(e));
+  w->n_entries++;
+}
+
+// Adds a rows x cols elem_t tensor, which is packed at "precision" bits
+// already if that isn't ELEM_T_BITS
+static void model_write_elems(struct model_writer_t * w, const char * name,
+    size_t rows, size_t cols, const void * data, int precision) {
+  const size_t dims[] = {rows, cols};
+  model_write_entry(w, name, MODEL_ELEM, precision, 2, dims, data);
+}
+
+static void model_write_accs(struct model_writer_t * w, const char * name,
+    size_t rows, size_t cols, const acc_t * data) {
+  const size_t dims[] = {rows, cols};
+  model_write_entry(w, name, MODEL_ACC, sizeof(acc_t) * 8, 2, dims, data);
+}
+
+#define MODEL_ENCODE_FIELD(field) fields[f++] = p->field;
+
+static void model_write_conv_params(struct model_writer_t * w, const char * name,
+    const struct ConvParams * p) {
+  int32_t fields[MODEL_CONV_PARAMS_N_FIELDS];
+  size_t f = 0;
+  MODEL_CONV_PARAMS_FIELDS(MODEL_ENCODE_FIELD)
+
+  const size_t dims[] = {MODEL_CONV_PARAMS_N_FIELDS};
+  model_write_entry(w, name, MODEL_CONV_PARAMS, 32, 1, dims, fields);
+}
+
+static void model_write_fc_params(struct model_writer_t * w, const char * name,
+    const struct FcParams * p) {
+  int32_t fields[MODEL_FC_PARAMS_N_FIELDS];
+  size_t f = 0;
+  MODEL_FC_PARAMS_FIELDS(MODEL_ENCODE_FIELD)
+
+  const size_t dims[] = {MODEL_FC_PARAMS_N_FIELDS};
+  model_write_entry(w, name, MODEL_FC_PARAMS, 32, 1, dims, fields);
+}
+
+#undef MODEL_ENCODE_FIELD
+
+// Writes the header, and returns the size of the model in bytes
+static size_t model_writer_finish(struct model_writer_t * w) {
+  struct model_header_t h;
+  memset(&h, 0, sizeof(h));
+
+  memcpy(h.magic, MODEL_MAGIC, sizeof(h.magic));
+  h.version = MODEL_VERSION;
+  h.n_entries = w->n_entries;
+  h.elem_bits = sizeof(elem_t) * 8;
+  h.acc_bits = sizeof(acc_t) * 8;
+  h.size = w->size;
+
+  memcpy(w->data, &h, sizeof(h));
+  return w->size;
+}
+
+#endif // SRC_MAIN_C_GEMMINI_MODEL_H
@@ -0,0 +1,1116 @@
+#ifndef GEMMINI_NET_H
+#define GEMMINI_NET_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#ifndef BAREMETAL
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "include/gemmini.h"
+#include "include/gemmini_nn.h"
+#include "include/gemmini_pipeline.h"
+
+// Network runtime
+//
+// Instead of calling each layer's functions by hand, a network can be
+// described as a graph of tensors and the layers which connect them, built
+// from the same ConvParams and FcParams as the generated parameter headers.
+// net_compile orders the layers, works out how long each tensor lives, and
+// picks the cheapest implementation of each layer that is still exact:
+//
+// - Bias addition, scaling and activations are always done by the matmul
+//   which computes a conv or FC layer.
+// - 1x1 convs with a stride of 1 read their input directly, without im2col.
+// - Max-pools run on Gemmini if their input can't be negative, i.e. if it
+//   came out of a ReLU.
+// - A residual addition whose output has no buffer of its own writes it over
+//   whichever of its inputs isn't needed afterwards.
+//
+// Tensors and im2col outputs which aren't given buffers of their own are
+// carved out of a single arena (see net_arena), reusing the memory of
+// tensors which nothing reads anymore, so a network only needs as much
+// memory for activations as it has live at any one time.
+//
+// net_run then runs every layer with the matmul type it is given, so the
+// same network description runs on WS, OS or the CPU. On Linux, it can also
+// keep only the current layer's memory locked (see net_lock_layers).
+//
+// net_pipeline_run instead streams several items (e.g. batches of images)
+// through the network, split into groups of layers which run as the stages
+// of a pipeline (see include/gemmini_pipeline.h).
+
+#ifndef NET_MAX_TENSORS
+#define NET_MAX_TENSORS 256
+#endif
+
+#ifndef NET_MAX_LAYERS
+#define NET_MAX_LAYERS 128
+#endif
+
+enum net_layer_type_t {
+  NET_CONV, NET_CONV_DW, NET_FC, NET_RESADD, NET_POOL, NET_AVGPOOL,
+};
+
+// The buckets which net_run sorts cycles into
+enum net_cycles_t {
+  NET_IM2COL_CYCLES, NET_MATMUL_CYCLES, NET_POOL_CYCLES, NET_CONV_DW_CYCLES,
+  NET_RES_ADD_CYCLES, NET_OTHER_CYCLES, NET_CYCLE_TYPES,
+};
+
+struct net_tensor_t {
+  elem_t * data;
+  size_t rows, cols;
+
+  // Filled in by net_compile. Tensors which nothing produces are inputs.
+  int producer;
+  int last_use;
+  bool non_negative;
+
+  // Set if the tensor shares its buffer with another one, or lives in the
+  // arena at "offset" elements
+  int alias;
+  bool in_arena;
+  size_t offset;
+};
+
+struct net_layer_t {
+  enum net_layer_type_t type;
+  char * name;
+  int inputs[2];
+  int n_inputs;
+  int output;
+
+  const elem_t * weights;
+  const acc_t * bias;
+  int act;
+  const struct ConvParams * conv_params;
+  const struct FcParams * fc_params;
+
+  // im2col's output, for convs which need it
+  elem_t * patches;
+
+  // Filled in by net_compile
+  bool direct;
+  bool accelerated;
+  bool patches_in_arena;
+  size_t patches_offset;
+};
+
+// A range of memory which a layer reads or writes
+struct net_range_t {
+  const void * start;
+  size_t bytes;
+};
+
+// A layer's weights, bias, inputs, output and im2col output, or the static
+// buffers in include/gemmini_nn.h which Gemmini reads or writes for it
+#define NET_MAX_RANGES 6
+
+struct net_t {
+  struct net_tensor_t tensors[NET_MAX_TENSORS];
+  struct net_layer_t layers[NET_MAX_LAYERS];
+  int order[NET_MAX_LAYERS];
+  int n_tensors, n_layers;
+  bool compiled;
+
+  elem_t * arena;
+  size_t arena_size, arena_used;
+
+  uint64_t cycles[NET_CYCLE_TYPES];
+
+  // Set by net_lock_layers. locked_bytes is how much net_run has locked for
+  // the current layer, rounded out to whole pages, and prefaulted_bytes how
+  // many bytes of weights it has faulted in ahead of the layers using them.
+  bool lock_layers;
+  size_t locked_bytes, max_locked_bytes;
+  uint64_t prefaulted_bytes;
+
+  struct net_range_t prefault_ranges[NET_MAX_RANGES];
+  int n_prefault_ranges;
+#if GEMMINI_CPU_THREADS > 1
+  pthread_t prefault_thread;
+  bool prefault_started;
+#endif
+};
+
+static void net_init(struct net_t * net) {
+  memset(net, 0, sizeof(*net));
+}
+
+// Adds a rows x cols tensor. Tensors whose data is NULL are given a buffer
+// by net_compile, from the arena unless a residual addition can reuse one
+// of its inputs'.
+static int net_tensor(struct net_t * net, size_t rows, size_t cols, elem_t * data) {
+  if (net->n_tensors == NET_MAX_TENSORS) {
+    printf("Networks can't have more than %d tensors\n", NET_MAX_TENSORS);
+    exit(1);
+  }
+
+  struct net_tensor_t * t = &net->tensors[net->n_tensors];
+  t->data = data;
+  t->rows = rows;
+  t->cols = cols;
+  t->alias = -1;
+
+  return net->n_tensors++;
+}
+
+static struct net_layer_t * net_layer(struct net_t * net, enum net_layer_type_t type,
+    char * name, int input, int output) {
+  if (net->n_layers == NET_MAX_LAYERS) {
+    printf("Networks can't have more than %d layers\n", NET_MAX_LAYERS);
+    exit(1);
+  }
+
+  if (input < 0 || input >= net->n_tensors || output < 0 || output >= net->n_tensors) {
+    printf("%s: unknown tensor\n", name);
+    exit(1);
+  }
+
+  struct net_layer_t * l = &net->layers[net->n_layers++];
+  memset(l, 0, sizeof(*l));
+  l->type = type;
+  l->name = name;
+  l->inputs[0] = input;
+  l->n_inputs = 1;
+  l->output = output;
+
+  net->compiled = false;
+
+  return l;
+}
+
+static void net_check_shape(const struct net_t * net, const char * name,
+    int tensor, size_t rows, size_t cols) {
+  const struct net_tensor_t * t = &net->tensors[tensor];
+
+  if (t->rows != rows || t->cols != cols) {
+    printf("%s: expected a %zux%zu tensor, but got a %zux%zu one\n",
+        name, rows, cols, t->rows, t->cols);
+    exit(1);
+  }
+}
+
+// The input holds one row per pixel (NHWC), and the output one row per
+// patch, like im2col followed by a matmul. "patches" is im2col's output, and
+// comes from the arena if it's NULL (1x1 convs with a stride of 1 don't need
+// it at all).
+static void net_conv(struct net_t * net, char * name, int input, int output,
+    const elem_t * weights, const acc_t * bias, int act,
+    const struct ConvParams * params, elem_t * patches) {
+  struct net_layer_t * l = net_layer(net, NET_CONV, name, input, output);
+  l->weights = weights;
+  l->bias = bias;
+  l->act = act;
+  l->conv_params = params;
+  l->patches = patches;
+
+  net_check_shape(net, name, input,
+      params->batch_size * params->in_dim * params->in_dim, params->in_channels);
+  net_check_shape(net, name, output, params->I, params->J);
+}
+
+// The weights are laid out as [channels][kernel_size][kernel_size]. Like
+// conv_dw_with_col2im, this always applies a ReLU.
+static void net_conv_dw(struct net_t * net, char * name, int input, int output,
+    const elem_t * weights, const acc_t * bias,
+    const struct ConvParams * params) {
+  struct net_layer_t * l = net_layer(net, NET_CONV_DW, name, input, output);
+  l->weights = weights;
+  l->bias = bias;
+  l->act = RELU;
+  l->conv_params = params;
+
+  net_check_shape(net, name, input,
+      params->batch_size * params->in_dim * params->in_dim, params->in_channels);
+  net_check_shape(net, name, output, params->I, params->J);
+}
+
+// Like the generated networks' FC layers, the weights are the left-hand
+// operand, so the input holds one column per image
+static void net_fc(struct net_t * net, char * name, int input, int output,
+    const elem_t * weights, const acc_t * bias, int act,
+    const struct FcParams * params) {
+  struct net_layer_t * l = net_layer(net, NET_FC, name, input, output);
+  l->weights = weights;
+  l->bias = bias;
+  l->act = act;
+  l->fc_params = params;
+
+  net_check_shape(net, name, input, params->K, params->J);
+  net_check_shape(net, name, output, params->I, params->J);
+}
+
+// Computes ROUNDING_RIGHT_SHIFT(a, res_scale) + b, like resadd3
+static void net_resadd(struct net_t * net, char * name, int a, int b, int output,
+    bool relu, const struct ConvParams * params) {
+  struct net_layer_t * l = net_layer(net, NET_RESADD, name, a, output);
+  l->inputs[1] = b;
+  l->n_inputs = 2;
+  l->act = relu ? RELU : NO_ACTIVATION;
+  l->conv_params = params;
+
+  if (b < 0 || b >= net->n_tensors) {
+    printf("%s: unknown tensor\n", name);
+    exit(1);
+  }
+
+  const size_t rows = params->batch_size * params->out_dim_pooled * params->out_dim_pooled;
+  net_check_shape(net, name, a, rows, params->out_channels);
+  net_check_shape(net, name, b, rows, params->out_channels);
+  net_check_shape(net, name, output, rows, params->out_channels);
+}
+
+// Max-pools the output of the conv which "params" describes
+static void net_pool(struct net_t * net, char * name, int input, int output,
+    const struct ConvParams * params) {
+  struct net_layer_t * l = net_layer(net, NET_POOL, name, input, output);
+  l->conv_params = params;
+
+  net_check_shape(net, name, input, params->I, params->J);
+  net_check_shape(net, name, output,
+      params->batch_size * params->out_dim_pooled * params->out_dim_pooled, params->out_channels);
+}
+
+// Averages each channel of the output of the conv which "params" describes,
+// rounding to the nearest integer. The output holds one column per image,
+// ready for net_fc.
+static void net_avgpool(struct net_t * net, char * name, int input, int output,
+    const struct ConvParams * params) {
+  struct net_layer_t * l = net_layer(net, NET_AVGPOOL, name, input, output);
+  l->conv_params = params;
+
+  net_check_shape(net, name, input,
+      params->batch_size * params->out_dim * params->out_dim, params->out_channels);
+
+  if (net->tensors[output].rows < params->out_channels ||
+      net->tensors[output].cols < params->batch_size) {
+    printf("%s: output is too small\n", name);
+    exit(1);
+  }
+}
+
+// Gives the network "bytes" bytes of row-aligned memory, from which
+// net_compile allocates every buffer which was left NULL
+static void net_arena(struct net_t * net, elem_t * arena, size_t bytes) {
+  net->arena = arena;
+  net->arena_size = bytes;
+  net->compiled = false;
+}
+
+// Orders the layers, and decides how to run each of them
+static void net_plan_layers(struct net_t * net) {
+  bool done[NET_MAX_LAYERS] = {false};
+  bool ready[NET_MAX_TENSORS];
+
+  for (int t = 0; t < net->n_tensors; t++) {
+    struct net_tensor_t * tensor = &net->tensors[t];
+
+    // Forget the buffers which the last net_compile handed out
+    if (tensor->in_arena || tensor->alias >= 0)
+      tensor->data = NULL;
+
+    tensor->producer = -1;
+    tensor->last_use = -1;
+    tensor->alias = -1;
+    tensor->in_arena = false;
+  }
+
+  for (int i = 0; i < net->n_layers; i++) {
+    if (net->layers[i].patches_in_arena)
+      net->layers[i].patches = NULL;
+    net->layers[i].patches_in_arena = false;
+  }
+
+  for (int i = 0; i < net->n_layers; i++) {
+    struct net_tensor_t * out = &net->tensors[net->layers[i].output];
+
+    if (out->producer >= 0) {
+      printf("%s: tensor is already written by %s\n",
+          net->layers[i].name, net->layers[out->producer].name);
+      exit(1);
+    }
+
+    out->producer = i;
+  }
+
+  for (int t = 0; t < net->n_tensors; t++)
+    ready[t] = net->tensors[t].producer < 0;
+
+  // Order the layers so that each one runs after the layers it depends on,
+  // keeping the order they were added in where possible
+  for (int n = 0; n < net->n_layers; n++) {
+    int next = -1;
+
+    for (int i = 0; i < net->n_layers && next < 0; i++) {
+      const struct net_layer_t * l = &net->layers[i];
+
+      if (!done[i] && ready[l->inputs[0]] && (l->n_inputs < 2 || ready[l->inputs[1]]))
+        next = i;
+    }
+
+    if (next < 0) {
+      printf("Network has a cycle\n");
+      exit(1);
+    }
+
+    done[next] = true;
+    ready[net->layers[next].output] = true;
+    net->order[n] = next;
+
+    for (int in = 0; in < net->layers[next].n_inputs; in++)
+      net->tensors[net->layers[next].inputs[in]].last_use = n;
+  }
+
+  for (int n = 0; n < net->n_layers; n++) {
+    struct net_layer_t * l = &net->layers[net->order[n]];
+    struct net_tensor_t * in = &net->tensors[l->inputs[0]];
+    struct net_tensor_t * out = &net->tensors[l->output];
+    const struct ConvParams * p = l->conv_params;
+
+    switch (l->type) {
+      case NET_CONV:
+        l->direct = p->kernel_size == 1 && p->stride == 1 && p->padding == 0 &&
+          p->I == in->rows && p->K == in->cols;
+
+        out->non_negative = l->act != NO_ACTIVATION;
+        break;
+
+      case NET_CONV_DW:
+      case NET_FC:
+        out->non_negative = l->act != NO_ACTIVATION;
+        break;
+
+      case NET_RESADD:
+        // Write the sum over an input which nothing reads afterwards
+        if (out->data == NULL) {
+          for (int i = 1; i >= 0 && out->alias < 0; i--) {
+            const struct net_tensor_t * t = &net->tensors[l->inputs[i]];
+            if (t->last_use == n && t->producer >= 0)
+              out->alias = l->inputs[i];
+          }
+        }
+
+        out->non_negative = l->act != NO_ACTIVATION;
+        break;
+
+      case NET_POOL:
+        l->accelerated = in->non_negative;
+        out->non_negative = in->non_negative;
+        break;
+
+      case NET_AVGPOOL:
+        out->non_negative = in->non_negative;
+        break;
+    }
+  }
+
+}
+
+// Returns the tensor which reuses t's buffer, or -1
+static int net_aliased_by(const struct net_t * net, int t) {
+  for (int u = 0; u < net->n_tensors; u++)
+    if (net->tensors[u].alias == t)
+      return u;
+  return -1;
+}
+
+struct net_buffer_t {
+  size_t size, offset;
+  int first_step, last_step;
+  int tensor, layer;
+};
+
+static bool net_buffers_live_together(const struct net_buffer_t * a, const struct net_buffer_t * b) {
+  return a->first_step <= b->last_step && b->first_step <= a->last_step;
+}
+
+// Gives each tensor and im2col output without a buffer an offset in the
+// arena. Two buffers only share memory if no layer needs both of them, and
+// each one starts on a new row.
+static void net_plan_arena(struct net_t * net) {
+  static struct net_buffer_t buffers[NET_MAX_TENSORS + NET_MAX_LAYERS];
+  int step[NET_MAX_LAYERS];
+  int n_buffers = 0;
+
+  for (int n = 0; n < net->n_layers; n++)
+    step[net->order[n]] = n;
+
+  for (int t = 0; t < net->n_tensors; t++) {
+    struct net_tensor_t * tensor = &net->tensors[t];
+    tensor->in_arena = tensor->data == NULL && tensor->alias < 0;
+
+    if (!tensor->in_arena)
+      continue;
+
+    if (tensor->producer < 0) {
+      printf("Tensor %d is an input to the network, but has no buffer\n", t);
+      exit(1);
+    }
+
+    struct net_buffer_t * b = &buffers[n_buffers++];
+    b->size = tensor->rows * tensor->cols;
+    b->first_step = step[tensor->producer];
+    b->last_step = -1;
+    b->tensor = t;
+    b->layer = -1;
+
+    // A residual addition's output extends the life of the buffer it reuses,
+    // and the network's outputs live until it's finished
+    for (int a = t; a >= 0; a = net_aliased_by(net, a)) {
+      const int last_use = net->tensors[a].last_use < 0 ? net->n_layers : net->tensors[a].last_use;
+      if (last_use > b->last_step)
+        b->last_step = last_use;
+    }
+  }
+
+  for (int i = 0; i < net->n_layers; i++) {
+    struct net_layer_t * l = &net->layers[i];
+    l->patches_in_arena = l->type == NET_CONV && !l->direct && l->patches == NULL;
+
+    if (!l->patches_in_arena)
+      continue;
+
+    struct net_buffer_t * b = &buffers[n_buffers++];
+    b->size = l->conv_params->I * l->conv_params->K;
+    b->first_step = step[i];
+    b->last_step = step[i];
+    b->tensor = -1;
+    b->layer = i;
+  }
+
+  // Place the largest buffers first, each in the smallest gap that fits it
+  // between the buffers which are live at the same time
+  for (int i = 0; i < n_buffers; i++)
+    buffers[i].size = (buffers[i].size + DIM - 1) / DIM * DIM;
+
+  for (int i = 1; i < n_buffers; i++) {
+    const struct net_buffer_t b = buffers[i];
+    int j = i;
+    for (; j > 0 && buffers[j-1].size < b.size; j--)
+      buffers[j] = buffers[j-1];
+    buffers[j] = b;
+  }
+
+  net->arena_used = 0;
+
+  for (int i = 0; i < n_buffers; i++) {
+    struct net_buffer_t * b = &buffers[i];
+    size_t best_gap = 0;
+    bool placed = false;
+
+    // Gaps start either at the beginning of the arena, or right after
+    // another buffer
+    for (int c = -1; c < i; c++) {
+      if (c >= 0 && !net_buffers_live_together(b, &buffers[c]))
+        continue;
+
+      const size_t offset = c < 0 ? 0 : buffers[c].offset + buffers[c].size;
+      size_t gap = SIZE_MAX;
+      bool fits = true;
+
+      for (int j = 0; j < i && fits; j++) {
+        if (!net_buffers_live_together(b, &buffers[j]))
+          continue;
+
+        const size_t start = buffers[j].offset;
+        if (start < offset + b->size && offset < start + buffers[j].size)
+          fits = false;
+        else if (start >= offset && start - offset < gap)
+          gap = start - offset;
+      }
+
+      if (fits && (!placed || gap < best_gap || (gap == best_gap && offset < b->offset))) {
+        best_gap = gap;
+        b->offset = offset;
+        placed = true;
+      }
+    }
+
+    if (b->tensor >= 0)
+      net->tensors[b->tensor].offset = b->offset;
+    else
+      net->layers[b->layer].patches_offset = b->offset;
+
+    if ((b->offset + b->size) * sizeof(elem_t) > net->arena_used)
+      net->arena_used = (b->offset + b->size) * sizeof(elem_t);
+  }
+}
+
+// Returns how many bytes of arena the network needs
+static size_t net_arena_size(struct net_t * net) {
+  net_plan_layers(net);
+  net_plan_arena(net);
+  return net->arena_used;
+}
+
+static void net_compile(struct net_t * net) {
+  net_plan_layers(net);
+  net_plan_arena(net);
+
+  if (net->arena_used > net->arena_size) {
+    printf("Network needs an arena of %zu bytes, but only has %zu\n",
+        net->arena_used, net->arena_size);
+    exit(1);
+  }
+
+  for (int t = 0; t < net->n_tensors; t++)
+    if (net->tensors[t].in_arena)
+      net->tensors[t].data = net->arena + net->tensors[t].offset;
+
+  for (int i = 0; i < net->n_layers; i++)
+    if (net->layers[i].patches_in_arena)
+      net->layers[i].patches = net->arena + net->layers[i].patches_offset;
+
+  // Aliases are resolved in the order the layers run in, since a residual
+  // addition's output can itself be reused by a later one
+  for (int n = 0; n < net->n_layers; n++) {
+    struct net_tensor_t * out = &net->tensors[net->layers[net->order[n]].output];
+    if (out->alias >= 0)
+      out->data = net->tensors[out->alias].data;
+  }
+
+  net->compiled = true;
+}
+
+// Runs one layer on the given buffers: its first and second inputs, its
+// output, and its im2col output. The cycles it takes are added to "cycles".
+static void net_run_layer_on(const struct net_t * net, const struct net_layer_t * l,
+    elem_t * in_data, elem_t * b_data, elem_t * out_data, elem_t * patches,
+    uint64_t cycles[NET_CYCLE_TYPES],
+    enum tiled_matmul_type_t tiled_matmul_type, bool check) {
+  const struct net_tensor_t * in = &net->tensors[l->inputs[0]];
+  const struct net_tensor_t * out = &net->tensors[l->output];
+  const struct ConvParams * p = l->conv_params;
+  uint64_t start = read_cycles();
+
+  switch (l->type) {
+    case NET_CONV: {
+      const elem_t * A = in_data;
+
+      if (!l->direct) {
+        // im2col skips the padding, which must be zero
+        if (p->padding > 0)
+          memset(patches, 0, p->I * p->K * sizeof(elem_t));
+
+        im2col_with_col2im(in->rows, in->cols, p->I, p->K,
+            (elem_t (*)[in->cols]) in_data, (elem_t (*)[p->K]) patches, p);
+        A = patches;
+
+        const uint64_t end = read_cycles();
+        cycles[NET_IM2COL_CYCLES] += end - start;
+        start = end;
+      }
+
+      tiled_matmul_nn_auto(p->I, p->J, p->K,
+          (elem_t (*)[p->K]) A, (elem_t (*)[p->J]) l->weights, l->bias,
+          (elem_t (*)[p->J]) out_data,
+          l->act, p->output_scale, 0, true,
+          tiled_matmul_type, check, l->name);
+
+      cycles[NET_MATMUL_CYCLES] += read_cycles() - start;
+      break;
+    }
+
+    case NET_CONV_DW:
+      tiled_conv_dw_with_col2im(in->rows, in->cols, p->I, p->J,
+          p->batch_size, p->in_channels, p->out_dim, p->kernel_size,
+          (elem_t (*)[in->cols]) in_data,
+          (elem_t (*)[p->kernel_size][p->kernel_size]) l->weights, l->bias,
+          (elem_t (*)[p->J]) out_data, p,
+          tiled_matmul_type);
+
+      cycles[NET_CONV_DW_CYCLES] += read_cycles() - start;
+      break;
+
+    case NET_FC: {
+      const struct FcParams * f = l->fc_params;
+
+      tiled_matmul_nn_auto(f->I, f->J, f->K,
+          (elem_t (*)[f->K]) l->weights, (elem_t (*)[f->J]) in_data, l->bias,
+          (elem_t (*)[f->J]) out_data,
+          l->act, f->output_scale, 0, false,
+          tiled_matmul_type, check, l->name);
+
+      cycles[NET_MATMUL_CYCLES] += read_cycles() - start;
+      break;
+    }
+
+    case NET_RESADD: {
+      tiled_resadd3(out->rows, out->cols,
+          (elem_t (*)[out->cols]) in_data, (elem_t (*)[out->cols]) b_data,
+          (elem_t (*)[out->cols]) out_data,
+          l->act == RELU, p,
+          tiled_matmul_type);
+
+      cycles[NET_RES_ADD_CYCLES] += read_cycles() - start;
+      break;
+    }
+
+    case NET_POOL: {
+      const size_t dim = p->out_dim_pooled;
+
+      if (l->accelerated) {
+        tiled_pool_with_col2im(p->I, p->J, p->batch_size, p->out_channels, dim,
+            (elem_t (*)[p->J]) in_data,
+            (elem_t (*)[dim][dim][p->out_channels]) out_data, p,
+            tiled_matmul_type);
+      } else {
+        pool_with_col2im(p->I, p->J, p->batch_size, p->out_channels, dim,
+            (elem_t (*)[p->J]) in_data,
+            (elem_t (*)[dim][dim][p->out_channels]) out_data, p);
+      }
+
+      cycles[NET_POOL_CYCLES] += read_cycles() - start;
+      break;
+    }
+
+    case NET_AVGPOOL: {
+      const elem_t (*input)[in->cols] = (elem_t (*)[in->cols]) in_data;
+      elem_t (*output)[out->cols] = (elem_t (*)[out->cols]) out_data;
+      const int count = p->out_dim * p->out_dim;
+
+      for (int batch = 0; batch < p->batch_size; batch++) {
+        for (int channel = 0; channel < p->out_channels; channel++) {
+          int sum = 0;
+          for (int r = batch * count; r < (batch + 1) * count; r++)
+            sum += input[r][channel];
+
+          output[channel][batch] = (sum + count/2) / count;
+        }
+      }
+
+      cycles[NET_OTHER_CYCLES] += read_cycles() - start;
+      break;
+    }
+  }
+}
+
+static void net_run_layer(struct net_t * net, const struct net_layer_t * l,
+    enum tiled_matmul_type_t tiled_matmul_type, bool check) {
+  net_run_layer_on(net, l, net->tensors[l->inputs[0]].data,
+      l->n_inputs > 1 ? net->tensors[l->inputs[1]].data : NULL,
+      net->tensors[l->output].data, l->patches, net->cycles,
+      tiled_matmul_type, check);
+}
+
+#ifndef BAREMETAL
+// Fills "ranges" with the memory which a layer reads and writes, its weights
+// and bias first, and returns how many ranges there are. With weights_only,
+// that's all it returns.
+static int net_layer_ranges(const struct net_t * net, const struct net_layer_t * l,
+    struct net_range_t ranges[NET_MAX_RANGES], bool weights_only) {
+  const struct ConvParams * p = l->conv_params;
+  const struct FcParams * f = l->fc_params;
+  size_t weights = 0, bias = 0;
+  int n = 0;
+
+  if (l->type == NET_CONV) {
+    weights = p->K * p->J;
+    bias = p->J;
+  } else if (l->type == NET_CONV_DW) {
+    weights = p->out_channels * p->kernel_size * p->kernel_size;
+    bias = p->J;
+  } else if (l->type == NET_FC) {
+    weights = f->I * f->K;
+    bias = f->I * f->J;
+  }
+
+  if (l->weights != NULL && weights > 0)
+    ranges[n++] = (struct net_range_t) {l->weights, weights * sizeof(elem_t)};
+  if (l->bias != NULL && bias > 0)
+    ranges[n++] = (struct net_range_t) {l->bias, bias * sizeof(acc_t)};
+
+  if (weights_only)
+    return n;
+
+  for (int i = 0; i < l->n_inputs; i++) {
+    const struct net_tensor_t * t = &net->tensors[l->inputs[i]];
+    ranges[n++] = (struct net_range_t) {t->data, t->rows * t->cols * sizeof(elem_t)};
+  }
+
+  const struct net_tensor_t * out = &net->tensors[l->output];
+  ranges[n++] = (struct net_range_t) {out->data, out->rows * out->cols * sizeof(elem_t)};
+
+  if (l->type == NET_CONV && !l->direct)
+    ranges[n++] = (struct net_range_t) {l->patches, p->I * p->K * sizeof(elem_t)};
+
+  if (l->type == NET_CONV_DW) {
+    // Only the channel blocks which this layer uses
+    size_t channel_blocks = (p->in_channels + DIM - 1) / DIM;
+    if (channel_blocks > CONV_DW_CHANNEL_BLOCKS)
+      channel_blocks = CONV_DW_CHANNEL_BLOCKS;
+    ranges[n++] = (struct net_range_t) {conv_dw_weights, channel_blocks * sizeof(conv_dw_weights[0])};
+    ranges[n++] = (struct net_range_t) {conv_bounce, sizeof(conv_bounce)};
+  } else if (l->type == NET_RESADD) {
+    ranges[n++] = (struct net_range_t) {gemmini_identity, sizeof(gemmini_identity)};
+  } else if (l->type == NET_POOL && l->accelerated) {
+    ranges[n++] = (struct net_range_t) {gemmini_identity, sizeof(gemmini_identity)};
+    ranges[n++] = (struct net_range_t) {conv_bounce, sizeof(conv_bounce)};
+    ranges[n++] = (struct net_range_t) {pool_diff, sizeof(pool_diff)};
+  }
+
+  return n;
+}
+
+// Rounds a range out to whole pages
+static void net_page_range(const struct net_range_t * r, uint8_t ** start, size_t * bytes) {
+  const uintptr_t page = sysconf(_SC_PAGESIZE);
+  const uintptr_t first = (uintptr_t)r->start & ~(page - 1);
+  const uintptr_t last = ((uintptr_t)r->start + r->bytes + page - 1) & ~(page - 1);
+
+  *start = (uint8_t *)first;
+  *bytes = last - first;
+}
+
+#if GEMMINI_CPU_THREADS > 1
+// Touches every page of the ranges which net_prefault_start was given
+static void * net_prefault_thread(void * arg) {
+  const struct net_t * net = (const struct net_t *)arg;
+  const size_t page = sysconf(_SC_PAGESIZE);
+
+  for (int r = 0; r < net->n_prefault_ranges; r++) {
+    uint8_t * start;
+    size_t bytes;
+    net_page_range(&net->prefault_ranges[r], &start, &bytes);
+
+    for (size_t b = 0; b < bytes; b += page)
+      (void)*(volatile const uint8_t *)(start + b);
+  }
+
+  return NULL;
+}
+#endif
+
+// Starts reading in a layer's weights and bias, which the kernel does in the
+// background. With GEMMINI_CPU_THREADS above 1, a thread also maps their pages
+// in, so that locking them later doesn't fault.
+static void net_prefault_start(struct net_t * net, const struct net_layer_t * l) {
+  net->n_prefault_ranges = net_layer_ranges(net, l, net->prefault_ranges, true);
+
+  for (int r = 0; r < net->n_prefault_ranges; r++) {
+    uint8_t * start;
+    size_t bytes;
+    net_page_range(&net->prefault_ranges[r], &start, &bytes);
+
+    // Only a hint, so failures are ignored
+    madvise(start, bytes, MADV_WILLNEED);
+    net->prefaulted_bytes += net->prefault_ranges[r].bytes;
+  }
+
+#if GEMMINI_CPU_THREADS > 1
+  net->prefault_started =
+    pthread_create(&net->prefault_thread, NULL, net_prefault_thread, net) == 0;
+#endif
+}
+
+static void net_prefault_wait(struct net_t * net) {
+#if GEMMINI_CPU_THREADS > 1
+  if (net->prefault_started)
+    pthread_join(net->prefault_thread, NULL);
+  net->prefault_started = false;
+#endif
+}
+
+static void net_lock_ranges(struct net_t * net, const struct net_range_t * ranges, int n,
+    bool lock) {
+  for (int r = 0; r < n; r++) {
+    uint8_t * start;
+    size_t bytes;
+    net_page_range(&ranges[r], &start, &bytes);
+
+    if (lock) {
+      if (mlock(start, bytes) != 0) {
+        perror("mlock failed");
+        exit(1);
+      }
+      net->locked_bytes += bytes;
+    } else {
+      munlock(start, bytes);
+      net->locked_bytes -= bytes;
+    }
+  }
+
+  if (net->locked_bytes > net->max_locked_bytes)
+    net->max_locked_bytes = net->locked_bytes;
+}
+
+// Instead of a program locking all of its memory with mlockall, which pins
+// every weight of the network for as long as it runs, net_run then only
+// mlocks the memory which each layer reads and writes while that layer runs.
+// Meanwhile, the next layer's weights are faulted in, so that they're
+// resident by the time it's locked. This is meant for weights which are
+// mapped from a file (see model_load in include/gemmini_model.h).
+static void net_lock_layers(struct net_t * net) {
+  net->lock_layers = true;
+}
+#endif
+
+// Runs every layer in order. With "check", every matmul is also checked
+// against the CPU.
+static void net_run(struct net_t * net, enum tiled_matmul_type_t tiled_matmul_type,
+    bool check) {
+  if (!net->compiled)
+    net_compile(net);
+
+  for (int n = 0; n < net->n_layers; n++) {
+    const struct net_layer_t * l = &net->layers[net->order[n]];
+
+#ifndef BAREMETAL
+    struct net_range_t ranges[NET_MAX_RANGES];
+    int n_ranges = 0;
+
+    if (net->lock_layers) {
+      net_prefault_wait(net);
+
+      n_ranges = net_layer_ranges(net, l, ranges, false);
+      net_lock_ranges(net, ranges, n_ranges, true);
+
+      if (n + 1 < net->n_layers)
+        net_prefault_start(net, &net->layers[net->order[n + 1]]);
+    }
+#endif
+
+    gemmini_profile_begin(l->name);
+    net_run_layer(net, l, tiled_matmul_type, check);
+    gemmini_profile_end();
+
+#ifndef BAREMETAL
+    if (net->lock_layers)
+      net_lock_ranges(net, ranges, n_ranges, false);
+#endif
+  }
+}
+
+// Pipelined runs
+//
+// The layers, in the order net_compile picked, are split into stages with
+// roughly the same number of MACs each. Every item gets its own copy of the
+// arena, so the tensors and im2col outputs which live there never need to
+// be copied between stages. Each stage only pops an item once it's done
+// with it, so at most NET_PIPELINE_COPIES items are in flight at once, and
+// item n can use arena copy n % NET_PIPELINE_COPIES.
+//
+// Tensors with buffers of their own are shared by every item. That's fine
+// for the network's inputs, which are only read, and for its outputs, which
+// the last stage writes in order, but any other tensor needs a buffer per
+// item (see net_pipeline_tensor).
+
+#define NET_PIPELINE_COPIES(n_stages, depth) (((n_stages) - 1) * (depth) + 1)
+
+#ifndef NET_PIPELINE_MAX_TENSORS
+#define NET_PIPELINE_MAX_TENSORS 4
+#endif
+
+struct net_pipeline_t;
+
+struct net_stage_t {
+  struct net_pipeline_t * pipeline;
+  int first, last;
+  uint64_t cycles[NET_CYCLE_TYPES];
+};
+
+struct net_pipeline_t {
+  struct net_t * net;
+  struct pipeline_t pipeline;
+  struct net_stage_t stages[PIPELINE_MAX_STAGES];
+  size_t copies;
+
+  enum tiled_matmul_type_t tiled_matmul_type;
+  bool check;
+
+  // Tensors whose buffer for item n is data[n]
+  int tensors[NET_PIPELINE_MAX_TENSORS];
+  elem_t * const * data[NET_PIPELINE_MAX_TENSORS];
+  int n_tensors;
+};
+
+// Roughly how many MACs, or elements for layers without any, a layer takes
+static uint64_t net_layer_work(const struct net_t * net, const struct net_layer_t * l) {
+  const struct ConvParams * p = l->conv_params;
+
+  switch (l->type) {
+    case NET_CONV:
+      return (uint64_t) p->I * p->J * p->K;
+    case NET_CONV_DW:
+      return (uint64_t) p->I * p->J * p->kernel_size * p->kernel_size;
+    case NET_FC:
+      return (uint64_t) l->fc_params->I * l->fc_params->J * l->fc_params->K;
+    default: {
+      const struct net_tensor_t * in = &net->tensors[l->inputs[0]];
+      return (uint64_t) in->rows * in->cols;
+    }
+  }
+}
+
+static elem_t * net_pipeline_arena(const struct net_pipeline_t * pipeline, size_t item) {
+  const struct net_t * net = pipeline->net;
+  return net->arena + (item % pipeline->copies) * (net->arena_used / sizeof(elem_t));
+}
+
+// Returns tensor t's buffer for "item"
+static elem_t * net_pipeline_data(const struct net_pipeline_t * pipeline, size_t item, int t) {
+  const struct net_tensor_t * tensor = &pipeline->net->tensors[t];
+
+  for (int i = 0; i < pipeline->n_tensors; i++)
+    if (pipeline->tensors[i] == t)
+      return pipeline->data[i][item];
+
+  if (tensor->alias >= 0)
+    return net_pipeline_data(pipeline, item, tensor->alias);
+  if (tensor->in_arena)
+    return net_pipeline_arena(pipeline, item) + tensor->offset;
+  return tensor->data;
+}
+
+static void net_pipeline_stage(size_t item, void * arg) {
+  struct net_stage_t * stage = arg;
+  const struct net_pipeline_t * pipeline = stage->pipeline;
+  const struct net_t * net = pipeline->net;
+
+  for (int n = stage->first; n < stage->last; n++) {
+    const struct net_layer_t * l = &net->layers[net->order[n]];
+    elem_t * patches = l->patches_in_arena ?
+      net_pipeline_arena(pipeline, item) + l->patches_offset : l->patches;
+
+    gemmini_profile_begin(l->name);
+    net_run_layer_on(net, l,
+        net_pipeline_data(pipeline, item, l->inputs[0]),
+        l->n_inputs > 1 ? net_pipeline_data(pipeline, item, l->inputs[1]) : NULL,
+        net_pipeline_data(pipeline, item, l->output), patches, stage->cycles,
+        pipeline->tiled_matmul_type, pipeline->check);
+    gemmini_profile_end();
+  }
+}
+
+// Splits the network into "n_stages" stages, and gets it ready to stream
+// "n_items" items through them, with "depth" items between each pair of
+// stages. The arena must hold NET_PIPELINE_COPIES(n_stages, depth) times
+// what net_arena_size returns.
+static void net_pipeline_init(struct net_pipeline_t * pipeline, struct net_t * net,
+    size_t n_items, size_t n_stages, size_t depth,
+    enum tiled_matmul_type_t tiled_matmul_type, bool check) {
+  if (!net->compiled)
+    net_compile(net);
+
+  if (n_stages == 0 || n_stages > PIPELINE_MAX_STAGES || n_stages > (size_t) net->n_layers) {
+    printf("Pipelines need between 1 and %d stages, and no more than the network's %d layers\n",
+        PIPELINE_MAX_STAGES, net->n_layers);
+    exit(1);
+  }
+
+  if (net->lock_layers) {
+    printf("net_lock_layers doesn't support pipelined runs\n");
+    exit(1);
+  }
+
+  pipeline_init(&pipeline->pipeline, n_items, depth);
+  pipeline->net = net;
+  pipeline->copies = NET_PIPELINE_COPIES(n_stages, depth);
+  pipeline->tiled_matmul_type = tiled_matmul_type;
+  pipeline->check = check;
+  pipeline->n_tensors = 0;
+
+  if (pipeline->copies * net->arena_used > net->arena_size) {
+    printf("Pipelined network needs an arena of %zu bytes, but only has %zu\n",
+        pipeline->copies * net->arena_used, net->arena_size);
+    exit(1);
+  }
+
+  uint64_t total_work = 0;
+  for (int n = 0; n < net->n_layers; n++)
+    total_work += net_layer_work(net, &net->layers[net->order[n]]);
+
+  // End a stage once it has its share of the work, leaving at least one
+  // layer for each of the stages after it
+  size_t s = 0;
+  uint64_t work = 0;
+  pipeline->stages[0].first = 0;
+
+  for (int n = 0; n < net->n_layers; n++) {
+    work += net_layer_work(net, &net->layers[net->order[n]]);
+
+    if (s + 1 < n_stages && (work * n_stages >= total_work * (s + 1) ||
+          (size_t) (net->n_layers - (n + 1)) == n_stages - (s + 1))) {
+      pipeline->stages[s].last = n + 1;
+      pipeline->stages[++s].first = n + 1;
+    }
+  }
+
+  pipeline->stages[s].last = net->n_layers;
+
+  for (s = 0; s < n_stages; s++) {
+    pipeline->stages[s].pipeline = pipeline;
+    memset(pipeline->stages[s].cycles, 0, sizeof(pipeline->stages[s].cycles));
+    pipeline_add_stage(&pipeline->pipeline, net_pipeline_stage, &pipeline->stages[s]);
+  }
+}
+
+// Gives tensor t a buffer per item: item n uses data[n]
+static void net_pipeline_tensor(struct net_pipeline_t * pipeline, int t,
+    elem_t * const * data) {
+  if (pipeline->n_tensors == NET_PIPELINE_MAX_TENSORS) {
+    printf("Pipelines can't have more than %d tensors with a buffer per item\n",
+        NET_PIPELINE_MAX_TENSORS);
+    exit(1);
+  }
+
+  pipeline->tensors[pipeline->n_tensors] = t;
+  pipeline->data[pipeline->n_tensors] = data;
+  pipeline->n_tensors++;
+}
+
+// Like pipeline_run, every hart calls this, after hart 0 has called
+// net_pipeline_init. Gemmini's routines keep some state in statics (e.g. the
+// tiling cache and include/gemmini_nn.h's buffers), so the stages can only
+// be spread over several harts when the layers run on the CPU.
+static void net_pipeline_run(struct net_pipeline_t * pipeline, size_t cid, size_t nc) {
+  struct net_t * net = pipeline->net;
+
+  if (nc > 1 && pipeline->tiled_matmul_type != CPU) {
+    printf("Pipelined networks only run on several harts on the CPU\n");
+    exit(1);
+  }
+
+  for (int t = 0; t < net->n_tensors; t++) {
+    const struct net_tensor_t * tensor = &net->tensors[t];
+    bool per_item = false;
+
+    for (int i = 0; i < pipeline->n_tensors; i++)
+      per_item |= pipeline->tensors[i] == t;
+
+    if (!per_item && !tensor->in_arena && tensor->alias < 0 &&
+        tensor->producer >= 0 && tensor->last_use >= 0) {
+      printf("Tensor %d is passed between layers, but has no buffer per item\n", t);
+      exit(1);
+    }
+  }
+
+  pipeline_run(&pipeline->pipeline, cid, nc);
+
+  // Each hart hands in the cycles of its own stages
+  for (size_t s = cid; s < pipeline->pipeline.n_stages; s += nc) {
+    for (int i = 0; i < NET_CYCLE_TYPES; i++) {
+      __sync_fetch_and_add(&net->cycles[i], pipeline->stages[s].cycles[i]);
+      pipeline->stages[s].cycles[i] = 0;
+    }
+  }
+}
+
+static void net_print_cycles(const struct net_t * net) {
+  uint64_t total_cycles = 0;
+  for (int i = 0; i < NET_CYCLE_TYPES; i++)
+    total_cycles += net->cycles[i];
+
+  printf("\nTotal cycles: %llu\n", (unsigned long long)total_cycles);
+  printf("Matmul cycles: %llu\n", (unsigned long long)net->cycles[NET_MATMUL_CYCLES]);
+  printf("Im2col cycles: %llu\n", (unsigned long long)net->cycles[NET_IM2COL_CYCLES]);
+  printf("Pooling cycles: %llu\n", (unsigned long long)net->cycles[NET_POOL_CYCLES]);
+  printf("Depthwise convolution cycles: %llu\n", (unsigned long long)net->cycles[NET_CONV_DW_CYCLES]);
+  printf("Residual addition cycles: %llu\n", (unsigned long long)net->cycles[NET_RES_ADD_CYCLES]);
+  printf("Other cycles: %llu\n", (unsigned long long)net->cycles[NET_OTHER_CYCLES]);
+}
+
+#endif // GEMMINI_NET_H
@@ -2,6 +2,7 @@
 #define GEMMINI_NN_H
 
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
 #ifndef BAREMETAL
@@ -83,10 +84,20 @@ static void tiled_matmul_nn(size_t dim_I, size_t dim_J, size_t dim_K,
     if (check)
         printf("%s: gemmini\n", layer_name);
 
+#ifdef GEMMINI_PERF_MODEL
+    gemmini_perf_begin(layer_name);
+#endif
+    gemmini_profile_begin(layer_name);
+
     tiled_matmul(dim_I, dim_J, dim_K,
         A, B, D, C, act, shift, relu6_shift, repeating_bias,
         tile_I, tile_J, tile_K,
-        tiled_matmul_type);
+        tiled_matmul_type, false);
+
+    gemmini_profile_end();
+#ifdef GEMMINI_PERF_MODEL
+    gemmini_perf_end();
+#endif
 
     if (check) {
         printf("%s: CPU\n", layer_name);
@@ -114,10 +125,20 @@ static void tiled_matmul_nn_auto(size_t dim_I, size_t dim_J, size_t dim_K,
     if (check)
         printf("%s: gemmini\n", layer_name);
 
+#ifdef GEMMINI_PERF_MODEL
+    gemmini_perf_begin(layer_name);
+#endif
+    gemmini_profile_begin(layer_name);
+
     tiled_matmul_auto(dim_I, dim_J, dim_K,
         A, B, D, C, act, shift, relu6_shift, repeating_bias,
         tiled_matmul_type);
 
+    gemmini_profile_end();
+#ifdef GEMMINI_PERF_MODEL
+    gemmini_perf_end();
+#endif
+
     if (check) {
         printf("%s: CPU\n", layer_name);
         elem_t gold[dim_I][dim_J];
@@ -323,6 +344,349 @@ static void im2col_with_col2im(size_t prev_I, size_t prev_J,
     }
 }
 
+// Fused convolution
+//
+// tiled_conv multiplies the same patch matrix that im2col builds, but moves
+// its rows straight from the input image into the scratchpad, without ever
+// materializing it in DRAM. To make each DIM-wide block of a patch contiguous
+// in the (NHWC) input, the patch matrix is laid out by kernel row, then kernel
+// column, then input channel. This differs from im2col, which puts the input
+// channel first. Each kernel row is also padded to a multiple of DIM columns,
+// so the weights must be rearranged with tiled_conv_weights first.
+
+// Number of columns in tiled_conv's patch matrix
+static size_t tiled_conv_K(const struct ConvParams * params) {
+    const size_t row_len = params->kernel_size * params->in_channels;
+    return params->kernel_size * ((row_len + DIM - 1) / DIM) * DIM;
+}
+
+// Rearranges weights from im2col's layout into tiled_conv's layout, with zeros
+// in the padding after each kernel row
+static void tiled_conv_weights(size_t im2col_K, size_t J, size_t K,
+    const elem_t weights[im2col_K][J],
+    elem_t output[K][J],
+    const struct ConvParams * params)
+{
+    const size_t kernel_size = params->kernel_size;
+    const size_t padded_row_len = K / kernel_size;
+
+    memset(output, 0, K * J * sizeof(elem_t));
+
+    for (size_t channel = 0; channel < params->in_channels; channel++) {
+        for (size_t kernel_row = 0; kernel_row < kernel_size; kernel_row++) {
+            for (size_t kernel_col = 0; kernel_col < kernel_size; kernel_col++) {
+                const size_t from = (channel * kernel_size + kernel_row) * kernel_size + kernel_col;
+                const size_t to = kernel_row * padded_row_len + kernel_col * params->in_channels + channel;
+                memcpy(output[to], weights[from], J * sizeof(elem_t));
+            }
+        }
+    }
+}
+
+// Patches which overlap the image's padding can't be moved in directly, so
+// they're assembled on the CPU in this buffer first. Gemmini reads it
+// asynchronously, so we fence before reusing it. This also means that a
+// tiled_conv can't be recorded into a gemmini_graph_t.
+#ifndef CONV_BOUNCE_ROWS
+#define CONV_BOUNCE_ROWS 256
+#endif
+
+static elem_t conv_bounce[CONV_BOUNCE_ROWS][DIM] row_align(1);
+static size_t conv_bounce_row = 0;
+
+// Moves "cols" elements of the patch matrix, for rows [patch, patch+rows),
+// into the scratchpad. The elements start "offset" elements into the row of
+// pixels which kernel_row covers. Consecutive patches along the same output
+// row, which lie entirely inside the image, are moved in by one strided mvin.
+// gemmini_config_ld must already have set the stride to
+// stride * in_channels elements.
+static void tiled_conv_mvin_block(const elem_t * input, size_t patch,
+    size_t rows, int kernel_row, size_t offset, size_t cols, uint32_t sp_addr,
+    const struct ConvParams * params)
+{
+    const int in_dim = params->in_dim;
+    const int out_dim = params->out_dim;
+    const int channels = params->in_channels;
+    const int stride = params->stride;
+    const int padding = params->padding;
+
+    // Kernel columns which this block covers
+    const int first_kernel_col = offset / channels;
+    const int last_kernel_col = (offset + cols - 1) / channels;
+
+    size_t r = 0;
+    while (r < rows) {
+        const size_t p = patch + r;
+        const int batch = p / (out_dim * out_dim);
+        const int out_row = (p / out_dim) % out_dim;
+        const int out_col = p % out_dim;
+
+        const int in_row = out_row * stride - padding + kernel_row;
+        const int in_col = out_col * stride - padding;
+        const bool row_valid = in_row >= 0 && in_row < in_dim;
+
+        if (row_valid && in_col + first_kernel_col >= 0 &&
+                in_col + last_kernel_col < in_dim) {
+            size_t run = 1;
+            while (r + run < rows && out_col + run < out_dim &&
+                    (out_col + (int)run) * stride - padding + last_kernel_col < in_dim) {
+                run++;
+            }
+
+            const ptrdiff_t pixel = ((ptrdiff_t)(batch * in_dim + in_row) * in_dim + in_col) * channels;
+            gemmini_extended_mvin(input + pixel + offset, sp_addr + r, cols, run);
+
+            r += run;
+        } else {
+            if (conv_bounce_row == CONV_BOUNCE_ROWS) {
+                gemmini_fence();
+                conv_bounce_row = 0;
+            }
+
+            elem_t * bounce = conv_bounce[conv_bounce_row++];
+
+            for (size_t c = 0; c < cols; c++) {
+                const int pixel_col = in_col + (offset + c) / channels;
+                const int channel = (offset + c) % channels;
+
+                if (row_valid && pixel_col >= 0 && pixel_col < in_dim) {
+                    bounce[c] = input[((batch * in_dim + in_row) * in_dim + pixel_col) * channels + channel];
+                } else {
+                    bounce[c] = 0;
+                }
+            }
+
+            gemmini_extended_mvin(bounce, sp_addr + r, cols, 1);
+
+            r++;
+        }
+    }
+}
+
+// Runs a convolution on an NHWC input with the weight-stationary dataflow.
+// I is the number of patches, J the number of output channels, and K must be
+// tiled_conv_K(params). The bias, if there is one, holds one value per output
+// channel. The output has the same layout as a matmul on im2col's output.
+static void tiled_conv(size_t batch_size, size_t in_dim, size_t in_channels,
+    size_t I, size_t J, size_t K,
+    const elem_t input[batch_size][in_dim][in_dim][in_channels],
+    const elem_t weights[K][J],
+    const acc_t * bias,
+    elem_t output[I][J],
+    int act, size_t shift, size_t relu6_shift,
+    const struct ConvParams * params)
+{
+    const struct tiling_plan_t * plan = tiled_matmul_plan(I, J, K, WS);
+
+    const size_t tile_I = plan->tile_I, tile_J = plan->tile_J, tile_K = plan->tile_K;
+
+    const size_t row_len = params->kernel_size * in_channels;
+    const size_t padded_row_len = K / params->kernel_size;
+
+    const bool no_bias = bias == NULL;
+    if (no_bias) {
+        bias = (void*) 1; // Dummy address which isn't NULL
+    }
+
+    gemmini_config_ex(WEIGHT_STATIONARY, act, 0, shift, relu6_shift);
+    gemmini_config_st(J * sizeof(elem_t));
+
+    // With resident weights, the tiles are run column by column, and only
+    // the first row of each column moves its weights in
+    const bool resident = plan->weights_resident;
+    const size_t outer = resident ? plan->J0 : plan->I0;
+    const size_t inner = resident ? plan->I0 : plan->J0;
+
+    for (size_t o = 0; o < outer; o++)
+        for (size_t n = 0; n < inner; n++)
+            for (size_t k0 = 0; k0 < plan->K0; k0++) {
+                const size_t i0 = resident ? n : o;
+                const size_t j0 = resident ? o : n;
+
+                const acc_t * pre = k0 == 0 ? bias + j0*tile_J*DIM : NULL;
+                elem_t * out = k0 == plan->K0-1 ? &output[i0*tile_I*DIM][j0*tile_J*DIM] : NULL;
+
+                const size_t I_tile = i0 < plan->I0-1 ? tile_I : plan->last_I;
+                const size_t J_tile = j0 < plan->J0-1 ? tile_J : plan->last_J;
+                const size_t K_tile = k0 < plan->K0-1 ? tile_K : plan->last_K;
+
+                const size_t pad_I = i0 == plan->I0-1 ? plan->padding_I : 0;
+                const size_t pad_J = j0 == plan->J0-1 ? plan->padding_J : 0;
+
+                const uint32_t A_sp_addr_start = 0;
+                const uint32_t B_sp_addr_start = resident ?
+                    tile_I * tile_K * DIM + k0 * tile_K * J_tile * DIM :
+                    I_tile * K_tile * DIM;
+                const uint32_t D_sp_addr_start = 1 << (ADDR_LEN-1);
+                const uint32_t C_sp_addr_start = 3 << (ADDR_LEN-2);
+
+                // Move in the bias and weights
+                sp_tiled_matmul_ws_mvin(NULL,
+                    !resident || i0 == 0 ? &weights[k0*tile_K*DIM][j0*tile_J*DIM] : NULL,
+                    pre,
+                    I_tile, J_tile, K_tile, pad_I, pad_J, 0,
+                    0, J, J,
+                    no_bias, true,
+                    A_sp_addr_start, B_sp_addr_start, D_sp_addr_start,
+                    false, ELEM_T_BITS, ELEM_T_BITS);
+
+                // Gather the patches
+                gemmini_config_ld(params->stride * in_channels * sizeof(elem_t));
+
+                for (size_t i = 0; i < I_tile; i++) {
+                    const size_t rows = DIM - (i == I_tile-1 ? pad_I : 0);
+
+                    for (size_t k = 0; k < K_tile; k++) {
+                        const size_t col = (k0*tile_K + k) * DIM;
+                        const size_t offset = col % padded_row_len;
+                        const size_t cols = row_len - offset < DIM ? row_len - offset : DIM;
+
+                        tiled_conv_mvin_block(&input[0][0][0][0],
+                            (i0*tile_I + i) * DIM, rows,
+                            col / padded_row_len, offset, cols,
+                            A_sp_addr_start + (i*K_tile + k)*DIM,
+                            params);
+                    }
+                }
+
+                sp_tiled_matmul_ws_compute(pre, out,
+                    I_tile, J_tile, K_tile, pad_I, pad_J, 0,
+                    J, no_bias,
+                    A_sp_addr_start, B_sp_addr_start, C_sp_addr_start,
+                    ELEM_T_BITS);
+            }
+
+    gemmini_fence();
+    conv_bounce_row = 0;
+}
+
+// Depthwise convolution
+//
+// Each block of DIM channels is computed as a weight-stationary matmul, whose
+// K dimension runs over the kernel's taps. The A block for a tap holds the
+// input pixels under that tap (moved in like tiled_conv's patches), and the B
+// block is a diagonal matrix holding each channel's weight for that tap. This
+// wastes most of the array's multipliers, but still leaves the Rocket core
+// with nothing to do but issue instructions.
+#ifndef CONV_DW_MAX_CHANNELS
+#define CONV_DW_MAX_CHANNELS 1024
+#endif
+#ifndef CONV_DW_MAX_KERNEL_SIZE
+#define CONV_DW_MAX_KERNEL_SIZE 3
+#endif
+
+#define CONV_DW_CHANNEL_BLOCKS ((CONV_DW_MAX_CHANNELS + DIM - 1) / DIM)
+#define CONV_DW_MAX_TAPS (CONV_DW_MAX_KERNEL_SIZE * CONV_DW_MAX_KERNEL_SIZE)
+
+// Diagonal weight matrices, for each channel block and tap. Only the
+// diagonals are ever written, so everything else stays zero.
+static elem_t conv_dw_weights[CONV_DW_CHANNEL_BLOCKS][CONV_DW_MAX_TAPS * DIM][DIM] row_align(1);
+
+static void tiled_conv_dw_with_col2im(size_t prev_I, size_t prev_J, size_t I, size_t J,
+    const size_t batch_size, const size_t channels, const size_t out_dim, const size_t kernel_size,
+    const elem_t input[prev_I][prev_J],
+    const elem_t weight[channels][kernel_size][kernel_size],
+    const acc_t * bias,
+    elem_t output [I][J],
+    const struct ConvParams * params,
+    enum tiled_matmul_type_t tiled_matmul_type)
+{
+    // Gemmini's path expects one row of the input per pixel
+    if (tiled_matmul_type == CPU || prev_J != channels) {
+        conv_dw_with_col2im(prev_I, prev_J, I, J, batch_size, channels, out_dim,
+            kernel_size, input, weight, bias, output, params);
+        return;
+    }
+
+    if (channels > CONV_DW_MAX_CHANNELS || kernel_size > CONV_DW_MAX_KERNEL_SIZE) {
+        printf("Depthwise convolution is too large (increase CONV_DW_MAX_CHANNELS or CONV_DW_MAX_KERNEL_SIZE)\n");
+        exit(1);
+    }
+
+    const size_t taps = kernel_size * kernel_size;
+    const size_t channel_blocks = (channels + DIM - 1) / DIM;
+
+    // Channels past the end of the last block get zero weights
+    for (size_t c = 0; c < channel_blocks * DIM; c++)
+        for (size_t tap = 0; tap < taps; tap++)
+            conv_dw_weights[c / DIM][tap * DIM + c % DIM][c % DIM] =
+                c < channels ? weight[c][tap / kernel_size][tap % kernel_size] : 0;
+
+    // Every channel block is an I x (taps * DIM) x DIM matmul
+    const struct tiling_plan_t * plan = tiled_matmul_plan(I, DIM, taps * DIM, WS);
+    const size_t tile_I = plan->tile_I, tile_K = plan->tile_K;
+
+    const bool no_bias = !params->bias;
+    if (no_bias) {
+        bias = (void*) 1; // Dummy address which isn't NULL
+    }
+
+    gemmini_config_ex(WEIGHT_STATIONARY, RELU, 0, params->output_scale, 0);
+    gemmini_config_st(J * sizeof(elem_t));
+
+    for (size_t cb = 0; cb < channel_blocks; cb++) {
+        const size_t cols = channels - cb * DIM < DIM ? channels - cb * DIM : DIM;
+        const size_t pad_J = DIM - cols;
+
+        // With resident weights, the channel block's diagonal weights are
+        // only moved in for the first row of tiles
+        const bool resident = plan->weights_resident;
+
+        for (size_t i0 = 0; i0 < plan->I0; i0++)
+            for (size_t k0 = 0; k0 < plan->K0; k0++) {
+                const acc_t * pre = k0 == 0 ? bias + cb*DIM : NULL;
+                elem_t * out = k0 == plan->K0-1 ? &output[i0*tile_I*DIM][cb*DIM] : NULL;
+
+                const size_t I_tile = i0 < plan->I0-1 ? tile_I : plan->last_I;
+                const size_t K_tile = k0 < plan->K0-1 ? tile_K : plan->last_K;
+                const size_t pad_I = i0 == plan->I0-1 ? plan->padding_I : 0;
+
+                const uint32_t A_sp_addr_start = 0;
+                const uint32_t B_sp_addr_start = resident ?
+                    tile_I * tile_K * DIM + k0 * tile_K * DIM :
+                    I_tile * K_tile * DIM;
+                const uint32_t D_sp_addr_start = 1 << (ADDR_LEN-1);
+                const uint32_t C_sp_addr_start = 3 << (ADDR_LEN-2);
+
+                // Move in the bias and diagonal weights
+                sp_tiled_matmul_ws_mvin(NULL,
+                    !resident || i0 == 0 ? &conv_dw_weights[cb][k0*tile_K*DIM][0] : NULL,
+                    pre,
+                    I_tile, 1, K_tile, pad_I, pad_J, 0,
+                    0, DIM, J,
+                    no_bias, true,
+                    A_sp_addr_start, B_sp_addr_start, D_sp_addr_start,
+                    false, ELEM_T_BITS, ELEM_T_BITS);
+
+                // Gather the pixels under each tap
+                gemmini_config_ld(params->stride * channels * sizeof(elem_t));
+
+                for (size_t i = 0; i < I_tile; i++) {
+                    const size_t rows = DIM - (i == I_tile-1 ? pad_I : 0);
+
+                    for (size_t k = 0; k < K_tile; k++) {
+                        const size_t tap = k0*tile_K + k;
+
+                        tiled_conv_mvin_block(&input[0][0],
+                            (i0*tile_I + i) * DIM, rows,
+                            tap / kernel_size, (tap % kernel_size) * channels + cb * DIM, cols,
+                            A_sp_addr_start + (i*K_tile + k)*DIM,
+                            params);
+                    }
+                }
+
+                sp_tiled_matmul_ws_compute(pre, out,
+                    I_tile, 1, K_tile, pad_I, pad_J, 0,
+                    J, no_bias,
+                    A_sp_addr_start, B_sp_addr_start, C_sp_addr_start,
+                    ELEM_T_BITS);
+            }
+    }
+
+    gemmini_fence();
+    conv_bounce_row = 0;
+}
+
 // Compute C = A + B with saturating add
 void vecadd(size_t len, const elem_t * A, const elem_t * B, elem_t * C, int A_shift) {
     for (size_t i = 0; i < len; i++) {
@@ -515,5 +879,300 @@ void pool_with_col2im(size_t I, size_t J,
     }
 }
 
+// Residual additions and pooling on Gemmini
+//
+// Both are built out of weight-stationary computes which multiply by an
+// identity matrix (or its negation) into the accumulator, so that the only
+// arithmetic left is the accumulation, and the rounding shift (acc_shift),
+// saturation and ReLU which Gemmini applies when it moves results out of the
+// accumulator. Results which are needed again after that take a round trip
+// through DRAM.
+static elem_t gemmini_identity[2][DIM][DIM] row_align(1);
+
+// Moves I into scratchpad row 0 and -I into row DIM
+static void gemmini_mvin_identity() {
+    static bool initialized = false;
+
+    if (!initialized) {
+        for (size_t i = 0; i < DIM; i++) {
+            gemmini_identity[0][i][i] = 1;
+            gemmini_identity[1][i][i] = -1;
+        }
+        initialized = true;
+    }
+
+    gemmini_config_ld(DIM * sizeof(elem_t));
+    gemmini_mvin(gemmini_identity[0], 0);
+    gemmini_mvin(gemmini_identity[1], DIM);
+}
+
+// Writes (or adds, if "accumulate" is set) A or -A to accumulator row
+// acc_row, for a block of rows x cols
+static void gemmini_identity_compute(uint32_t A_sp_addr, bool negate,
+    uint32_t acc_row, bool accumulate, size_t cols, size_t rows) {
+    const uint32_t acc_addr = (1 << (ADDR_LEN-1)) | (accumulate ? 1 << (ADDR_LEN-2) : 0) | acc_row;
+
+    gemmini_extended_preload(negate ? DIM : 0, acc_addr, DIM, DIM, cols, rows);
+    gemmini_extended_compute_preloaded(A_sp_addr, GARBAGE_ADDR, cols, rows, DIM, DIM);
+}
+
+// Blocks moved in by each group of tiled_resadd3. Consecutive groups use
+// alternate halves of the accumulator.
+#ifndef RESADD_GROUP_BLOCKS
+#define RESADD_GROUP_BLOCKS (ACC_ROWS / DIM / 2)
+#endif
+
+// Same as resadd3, but on Gemmini unless tiled_matmul_type is CPU. Each block
+// of A is first moved out of the accumulator into C with an acc_shift of
+// res_scale, which gives ROUNDING_RIGHT_SHIFT(A, res_scale), and moved back
+// in. That's then added to B in the accumulator, and moved out through ReLU.
+// Adding B, scaled up by res_scale, before the shift would round ties
+// differently from resadd3.
+static void tiled_resadd3(const size_t I, const size_t J,
+    const elem_t A[I][J],
+    const elem_t B[I][J],
+    elem_t C[I][J],
+    bool relu,
+    const struct ConvParams * params,
+    enum tiled_matmul_type_t tiled_matmul_type) {
+
+    if (tiled_matmul_type == CPU || params->res_scale < 0) {
+        resadd3(I, J, A, B, C, relu, params);
+        return;
+    }
+
+    const size_t rows = params->batch_size * params->out_dim_pooled * params->out_dim_pooled;
+    const size_t cols = params->out_channels;
+    const size_t row_blocks = (rows + DIM - 1) / DIM;
+    const size_t col_blocks = (cols + DIM - 1) / DIM;
+    const size_t blocks = row_blocks * col_blocks;
+
+    gemmini_mvin_identity();
+    gemmini_config_ld(J * sizeof(elem_t));
+    gemmini_config_st(J * sizeof(elem_t));
+
+    if (params->res_scale == 0)
+        gemmini_config_ex(WEIGHT_STATIONARY, relu ? RELU : NO_ACTIVATION, 0, 0, 0);
+
+    for (size_t group = 0; group * RESADD_GROUP_BLOCKS < blocks; group++) {
+        const size_t first = group * RESADD_GROUP_BLOCKS;
+        const size_t n = blocks - first < RESADD_GROUP_BLOCKS ? blocks - first : RESADD_GROUP_BLOCKS;
+
+        // Alternate between two halves of the scratchpad and accumulator, so
+        // that one group can be moved in while the one before it is still
+        // being computed
+        const uint32_t A_sp_addr = 2*DIM + (group % 2) * 2 * RESADD_GROUP_BLOCKS * DIM;
+        const uint32_t B_sp_addr = A_sp_addr + RESADD_GROUP_BLOCKS * DIM;
+        const uint32_t acc_row = (group % 2) * RESADD_GROUP_BLOCKS * DIM;
+        const uint32_t acc_addr = (1 << (ADDR_LEN-1)) | acc_row;
+
+#define RESADD_BLOCK(b) \
+        const size_t row = ((first + (b)) / col_blocks) * DIM; \
+        const size_t col = ((first + (b)) % col_blocks) * DIM; \
+        const size_t block_rows = rows - row < DIM ? rows - row : DIM; \
+        const size_t block_cols = cols - col < DIM ? cols - col : DIM;
+
+        // B is moved in before A, so that it has been read by the time any
+        // scaled block of A is written over it, when C is B
+        for (size_t b = 0; b < n; b++) {
+            RESADD_BLOCK(b);
+            gemmini_extended_mvin(&B[row][col], B_sp_addr + b*DIM, block_cols, block_rows);
+        }
+
+        for (size_t b = 0; b < n; b++) {
+            RESADD_BLOCK(b);
+            gemmini_extended_mvin(&A[row][col], A_sp_addr + b*DIM, block_cols, block_rows);
+        }
+
+        if (params->res_scale > 0) {
+            // Scale A down into C, and move it back in over A
+            gemmini_config_ex(WEIGHT_STATIONARY, NO_ACTIVATION, 0, params->res_scale, 0);
+
+            for (size_t b = 0; b < n; b++) {
+                RESADD_BLOCK(b);
+                gemmini_identity_compute(A_sp_addr + b*DIM, false, acc_row + b*DIM, false,
+                    block_cols, block_rows);
+            }
+
+            for (size_t b = 0; b < n; b++) {
+                RESADD_BLOCK(b);
+                gemmini_extended_mvout(&C[row][col], acc_addr + b*DIM,
+                    block_cols, block_rows);
+            }
+
+            gemmini_fence();
+
+            for (size_t b = 0; b < n; b++) {
+                RESADD_BLOCK(b);
+                gemmini_extended_mvin(&C[row][col], A_sp_addr + b*DIM, block_cols, block_rows);
+            }
+
+            gemmini_config_ex(WEIGHT_STATIONARY, relu ? RELU : NO_ACTIVATION, 0, 0, 0);
+        }
+
+        // Add B
+        for (size_t b = 0; b < n; b++) {
+            RESADD_BLOCK(b);
+            gemmini_identity_compute(A_sp_addr + b*DIM, false, acc_row + b*DIM, false,
+                block_cols, block_rows);
+            gemmini_identity_compute(B_sp_addr + b*DIM, false, acc_row + b*DIM, true,
+                block_cols, block_rows);
+        }
+
+        for (size_t b = 0; b < n; b++) {
+            RESADD_BLOCK(b);
+            gemmini_extended_mvout(&C[row][col], acc_addr + b*DIM,
+                block_cols, block_rows);
+        }
+
+#undef RESADD_BLOCK
+
+        // The next group's acc_shift mustn't apply to these mvouts
+        if (params->res_scale > 0)
+            gemmini_fence();
+    }
+
+    gemmini_fence();
+}
+
+// Blocks pooled by each group of tiled_pool_with_col2im. Each one takes two
+// blocks of the accumulator, and a block of pool_diff.
+#ifndef POOL_GROUP_BLOCKS
+#define POOL_GROUP_BLOCKS (ACC_ROWS / DIM / 2)
+#endif
+
+static elem_t pool_diff[POOL_GROUP_BLOCKS * DIM][DIM] row_align(1);
+
+// Same as pool_with_col2im, but on Gemmini unless tiled_matmul_type is CPU.
+// The input must not be negative (e.g. it came out of a ReLU), because
+// max(m, t) is computed as m + relu(t - m), and t - m must fit in an elem_t.
+// The pixels under each tap of the pooling window are gathered like
+// tiled_conv's patches, with out-of-bounds pixels read as 0, just like
+// pool_with_col2im.
+//
+// For each block, the accumulator holds the running maximum m, and
+// x = t - m for the next tap t. x goes out through ReLU into pool_diff, and
+// comes back in as d, which is added to m. Since the next x is x - t + t' - d,
+// only d has to take that round trip through DRAM.
+static void tiled_pool_with_col2im(size_t I, size_t J,
+    size_t batch_size, size_t channels, size_t out_dim,
+    elem_t input[I][J],
+    elem_t output[batch_size][out_dim][out_dim][channels],
+    const struct ConvParams * params,
+    enum tiled_matmul_type_t tiled_matmul_type)
+{
+    const size_t taps = params->pool_size * params->pool_size;
+
+    // Each block also needs its taps and d in the scratchpad
+    const size_t spad_blocks = (BANK_NUM * BANK_ROWS / DIM - 2) / (taps + 1);
+    const size_t group_blocks = spad_blocks < POOL_GROUP_BLOCKS ? spad_blocks : POOL_GROUP_BLOCKS;
+
+    if (tiled_matmul_type == CPU || channels != J || group_blocks == 0) {
+        pool_with_col2im(I, J, batch_size, channels, out_dim, input, output, params);
+        return;
+    }
+
+    // The pooling window, described the way tiled_conv_mvin_block expects
+    struct ConvParams window;
+    memset(&window, 0, sizeof(window));
+    window.in_dim = params->out_dim;
+    window.out_dim = out_dim;
+    window.in_channels = channels;
+    window.kernel_size = params->pool_size;
+    window.stride = params->pool_stride;
+    window.padding = params->pool_padding;
+
+    const size_t pixels = batch_size * out_dim * out_dim;
+    const size_t col_blocks = (channels + DIM - 1) / DIM;
+    const size_t blocks = ((pixels + DIM - 1) / DIM) * col_blocks;
+
+    const uint32_t taps_sp_addr = 2*DIM;
+    const uint32_t d_sp_addr = taps_sp_addr + group_blocks * taps * DIM;
+    const uint32_t x_acc_row = 0;
+    const uint32_t m_acc_row = POOL_GROUP_BLOCKS * DIM;
+    const uint32_t x_acc_addr = (1 << (ADDR_LEN-1)) | x_acc_row;
+    const uint32_t m_acc_addr = (1 << (ADDR_LEN-1)) | m_acc_row;
+
+    gemmini_mvin_identity();
+    gemmini_config_ex(WEIGHT_STATIONARY, RELU, 0, 0, 0);
+
+    for (size_t first = 0; first < blocks; first += group_blocks) {
+        const size_t n = blocks - first < group_blocks ? blocks - first : group_blocks;
+
+#define POOL_BLOCK(b) \
+        const size_t p = ((first + (b)) / col_blocks) * DIM; \
+        const size_t c = ((first + (b)) % col_blocks) * DIM; \
+        const size_t rows = pixels - p < DIM ? pixels - p : DIM; \
+        const size_t cols = channels - c < DIM ? channels - c : DIM;
+
+        gemmini_config_ld(params->pool_stride * channels * sizeof(elem_t));
+
+        for (size_t b = 0; b < n; b++) {
+            POOL_BLOCK(b);
+            const uint32_t tap_addr = taps_sp_addr + b * taps * DIM;
+            for (size_t t = 0; t < taps; t++) {
+                tiled_conv_mvin_block(&input[0][0], p, rows,
+                    t / params->pool_size, (t % params->pool_size) * channels + c, cols,
+                    tap_addr + t*DIM, &window);
+            }
+        }
+
+        // m = t_0, and x = t_1 - m
+        for (size_t b = 0; b < n; b++) {
+            POOL_BLOCK(b);
+            const uint32_t tap_addr = taps_sp_addr + b * taps * DIM;
+            gemmini_identity_compute(tap_addr, false, m_acc_row + b*DIM, false, cols, rows);
+            if (taps > 1) {
+                gemmini_identity_compute(tap_addr + DIM, false, x_acc_row + b*DIM, false, cols, rows);
+                gemmini_identity_compute(tap_addr, true, x_acc_row + b*DIM, true, cols, rows);
+            }
+        }
+
+        for (size_t t = 1; t < taps; t++) {
+            // d = relu(x)
+            gemmini_config_st(DIM * sizeof(elem_t));
+            for (size_t b = 0; b < n; b++) {
+                POOL_BLOCK(b);
+                gemmini_extended_mvout(pool_diff[b*DIM], x_acc_addr + b*DIM,
+                    cols, rows);
+            }
+
+            gemmini_fence();
+
+            gemmini_config_ld(DIM * sizeof(elem_t));
+            for (size_t b = 0; b < n; b++) {
+                POOL_BLOCK(b);
+                gemmini_extended_mvin(pool_diff[b*DIM], d_sp_addr + b*DIM, cols, rows);
+            }
+
+            // m += d, and x += t' - t - d
+            for (size_t b = 0; b < n; b++) {
+                POOL_BLOCK(b);
+                const uint32_t tap_addr = taps_sp_addr + b * taps * DIM;
+                gemmini_identity_compute(d_sp_addr + b*DIM, false, m_acc_row + b*DIM, true, cols, rows);
+                if (t < taps - 1) {
+                    gemmini_identity_compute(tap_addr + (t+1)*DIM, false, x_acc_row + b*DIM, true, cols, rows);
+                    gemmini_identity_compute(tap_addr + t*DIM, true, x_acc_row + b*DIM, true, cols, rows);
+                    gemmini_identity_compute(d_sp_addr + b*DIM, true, x_acc_row + b*DIM, true, cols, rows);
+                }
+            }
+        }
+
+        // m is never negative, so the ReLU leaves it alone
+        gemmini_config_st(channels * sizeof(elem_t));
+        for (size_t b = 0; b < n; b++) {
+            POOL_BLOCK(b);
+            gemmini_extended_mvout(&output[0][0][0][0] + p * channels + c,
+                m_acc_addr + b*DIM, cols, rows);
+        }
+
+#undef POOL_BLOCK
+
+        // The next group's taps are moved in over these ones
+        gemmini_fence();
+        conv_bounce_row = 0;
+    }
+}
+
 #endif // GEMMINI_NN_H
 
@@ -0,0 +1,197 @@
+// See LICENSE for license details.
+
+#ifndef SRC_MAIN_C_GEMMINI_PACK_H
+#define SRC_MAIN_C_GEMMINI_PACK_H
+
+// Packing and unpacking of sub-byte matrices
+//
+// Matrices of elements narrower than elem_t (4 or 2 bits) are packed in DRAM
+// lowest bits first, with every row starting on a byte boundary. mvins unpack
+// them into full elem_t's in the scratchpad, and mvouts pack them again.
+//
+// packed_get and packed_set access single elements. pack_matrix and
+// unpack_matrix convert whole matrices, eight elements at a time in a 64-bit
+// word (SWAR), which is one register on RV64 and which compilers can widen
+// further with host vector units. They're meant for quantizing weights once,
+// when a model is loaded.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "include/gemmini_params.h"
+
+#define ELEM_T_BITS ((int)(sizeof(elem_t) * 8))
+
+// Bytes taken up by "elems" elements packed at "precision" bits each
+#define packed_bytes(elems, precision) (((elems) * (precision) + 7) / 8)
+
+// Reads element "col" of a packed row
+static elem_t packed_get(const void * row, size_t col, int precision) {
+  if (precision >= ELEM_T_BITS)
+    return ((const elem_t *)row)[col];
+
+  const size_t bit = col * precision;
+  const int shift = 8 - precision;
+  const int8_t packed = ((const uint8_t *)row)[bit / 8] >> (bit % 8);
+  return (int8_t)(packed << shift) >> shift;
+}
+
+// Writes element "col" of a packed row, saturating it to "precision" bits
+static void packed_set(void * row, size_t col, int precision, elem_t x) {
+  if (precision >= ELEM_T_BITS) {
+    ((elem_t *)row)[col] = x;
+    return;
+  }
+
+  const elem_t max = (1 << (precision - 1)) - 1;
+  const elem_t min = -(1 << (precision - 1));
+  x = x > max ? max : (x < min ? min : x);
+
+  const size_t bit = col * precision;
+  uint8_t * byte = (uint8_t *)row + bit / 8;
+  const uint8_t mask = ((1 << precision) - 1) << (bit % 8);
+  *byte = (*byte & ~mask) | (((uint8_t)x << (bit % 8)) & mask);
+}
+
+// The word-at-a-time routines assume 8-bit elements, stored little-endian in
+// a uint64_t
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PACK_SWAR (sizeof(elem_t) == 1)
+#else
+#define PACK_SWAR 0
+#endif
+
+#define PACK_BYTES(b) (0x0101010101010101ULL * (uint8_t)(b))
+
+// Saturates each of the eight signed bytes in w to "precision" bits
+static uint64_t pack_saturate_word(uint64_t w, int precision) {
+  const int high_bits = 8 - precision;
+  const uint64_t half = PACK_BYTES(1 << (precision - 1));
+
+  // Add half of the range to each byte, without carrying into the next one.
+  // The bytes which were in range are left with their high bits clear.
+  const uint64_t low7 = PACK_BYTES(0x7F), top = PACK_BYTES(0x80);
+  const uint64_t biased = ((w & low7) + half) ^ (w & top);
+  const uint64_t high = (biased >> precision) & PACK_BYTES((1 << high_bits) - 1);
+  const uint64_t out = ((high + PACK_BYTES((1 << high_bits) - 1)) >> high_bits) & PACK_BYTES(1);
+  const uint64_t out_mask = out * 0xFF;
+
+  // Out-of-range bytes become the largest or smallest value, by their sign
+  const uint64_t negative = ((w >> 7) & PACK_BYTES(1)) * 0xFF;
+  const uint64_t saturated = PACK_BYTES((1 << (precision - 1)) - 1) ^ negative;
+
+  return (w & ~out_mask) | (saturated & out_mask);
+}
+
+// Packs eight elements, which must already be in range, into "precision" * 8
+// bits
+static uint32_t pack_word(uint64_t w, int precision) {
+  if (precision == 4) {
+    uint64_t p = w & PACK_BYTES(0x0F);
+    p = (p | (p >> 4)) & 0x00FF00FF00FF00FFULL;
+    p = (p | (p >> 8)) & 0x0000FFFF0000FFFFULL;
+    return (uint32_t)(p | (p >> 16));
+  } else {
+    uint64_t p = w & PACK_BYTES(0x03);
+    p = (p | (p >> 6)) & 0x000F000F000F000FULL;
+    p = (p | (p >> 12)) & 0x000000FF000000FFULL;
+    return (uint32_t)(p | (p >> 24)) & 0xFFFF;
+  }
+}
+
+// Unpacks eight sign-extended elements from "precision" * 8 bits
+static uint64_t unpack_word(uint32_t packed, int precision) {
+  uint64_t p = packed;
+
+  if (precision == 4) {
+    p = (p | (p << 16)) & 0x0000FFFF0000FFFFULL;
+    p = (p | (p << 8)) & 0x00FF00FF00FF00FFULL;
+    p = (p | (p << 4)) & PACK_BYTES(0x0F);
+  } else {
+    p = (p | (p << 24)) & 0x000000FF000000FFULL;
+    p = (p | (p << 12)) & 0x000F000F000F000FULL;
+    p = (p | (p << 6)) & PACK_BYTES(0x03);
+  }
+
+  // Flipping the sign bit and subtracting it again sign-extends each byte.
+  // The subtraction is done as an addition which can't carry out of a byte.
+  const uint64_t sign = PACK_BYTES(1 << (precision - 1));
+  return ((p ^ sign) + (PACK_BYTES(0x80) - sign)) ^ PACK_BYTES(0x80);
+}
+
+// Packs the first "cols" elements of src into dst at "precision" bits,
+// saturating each of them
+static void pack_row(const elem_t * src, uint8_t * dst, size_t cols, int precision) {
+  size_t col = 0;
+
+  if (PACK_SWAR) {
+    const size_t word_bytes = precision;
+
+    for (; col + 8 <= cols; col += 8) {
+      uint64_t w;
+      memcpy(&w, src + col, sizeof(w));
+
+      const uint32_t p = pack_word(pack_saturate_word(w, precision), precision);
+      memcpy(dst + col * precision / 8, &p, word_bytes);
+    }
+  }
+
+  for (; col < cols; col++)
+    packed_set(dst, col, precision, src[col]);
+}
+
+// Unpacks the first "cols" elements of a row packed at "precision" bits
+static void unpack_row(const uint8_t * src, elem_t * dst, size_t cols, int precision) {
+  size_t col = 0;
+
+  if (PACK_SWAR) {
+    const size_t word_bytes = precision;
+
+    for (; col + 8 <= cols; col += 8) {
+      uint32_t p = 0;
+      memcpy(&p, src + col * precision / 8, word_bytes);
+
+      const uint64_t w = unpack_word(p, precision);
+      memcpy(dst + col, &w, sizeof(w));
+    }
+  }
+
+  for (; col < cols; col++)
+    dst[col] = packed_get(src, col, precision);
+}
+
+// Packs a rows x cols matrix at "precision" bits (ELEM_T_BITS, 4 or 2),
+// saturating every element. src_stride is the distance between src's rows in
+// elements, and dst_stride the distance between dst's rows in bytes, which is
+// packed_bytes(cols, precision) for a dense matrix.
+void pack_matrix(size_t rows, size_t cols,
+        const elem_t * src, size_t src_stride,
+        void * dst, size_t dst_stride, int precision) {
+  for (size_t r = 0; r < rows; r++) {
+    const elem_t * s = src + r * src_stride;
+    uint8_t * d = (uint8_t *)dst + r * dst_stride;
+
+    if (precision >= ELEM_T_BITS)
+      memcpy(d, s, cols * sizeof(elem_t));
+    else
+      pack_row(s, d, cols, precision);
+  }
+}
+
+// The inverse of pack_matrix, which sign-extends every element
+void unpack_matrix(size_t rows, size_t cols,
+        const void * src, size_t src_stride,
+        elem_t * dst, size_t dst_stride, int precision) {
+  for (size_t r = 0; r < rows; r++) {
+    const uint8_t * s = (const uint8_t *)src + r * src_stride;
+    elem_t * d = dst + r * dst_stride;
+
+    if (precision >= ELEM_T_BITS)
+      memcpy(d, s, cols * sizeof(elem_t));
+    else
+      unpack_row(s, d, cols, precision);
+  }
+}
+
+#endif // SRC_MAIN_C_GEMMINI_PACK_H
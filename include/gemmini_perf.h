@@ -0,0 +1,334 @@
+// See LICENSE for license details.
+
+#ifndef SRC_MAIN_C_GEMMINI_PERF_H
+#define SRC_MAIN_C_GEMMINI_PERF_H
+
+// Cycle-approximate timing model of Gemmini. When GEMMINI_PERF_MODEL is
+// defined (on top of GEMMINI_HOST_EMU), every instruction seen by the emulator
+// is also timed here.
+//
+// The model has three in-order units (load, execute, store) which run in
+// parallel. An instruction starts once its unit is free, once every
+// scratchpad/accumulator row it touches has no outstanding hazard, and once a
+// slot in the reorder buffer is available. The CPU pays a fixed cost to issue
+// each instruction, and stalls at fences until every unit has drained.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "include/gemmini_params.h"
+
+#ifndef GEMMINI_HOST_EMU
+#error GEMMINI_PERF_MODEL requires GEMMINI_HOST_EMU
+#endif
+
+// Tunable parameters of the model
+#ifndef PERF_ISSUE_CYCLES
+#define PERF_ISSUE_CYCLES 4 // CPU cycles to issue one RoCC instruction
+#endif
+#ifndef PERF_ROB_ENTRIES
+#define PERF_ROB_ENTRIES 16 // Instructions which may be in flight at once
+#endif
+#ifndef PERF_BUS_BYTES
+#define PERF_BUS_BYTES 16 // Bytes the DMA moves per cycle
+#endif
+#ifndef PERF_DMA_LATENCY
+#define PERF_DMA_LATENCY 64 // Round-trip latency of one DMA request
+#endif
+#ifndef PERF_FILL_LATENCY
+#define PERF_FILL_LATENCY (2*DIM) // Cycles for a row to cross the array
+#endif
+
+#define PERF_SP_ROWS (BANK_NUM * BANK_ROWS)
+
+enum perf_unit_t {PERF_LOAD, PERF_EXECUTE, PERF_STORE, PERF_UNITS};
+
+struct gemmini_perf_counters_t {
+  uint64_t cycles;
+  uint64_t mvins, mvouts, preloads, computes, configs, loops;
+  uint64_t bytes_in, bytes_out;
+  uint64_t busy[PERF_UNITS];
+};
+
+struct gemmini_perf_state_t {
+  uint64_t cpu_time;
+  uint64_t unit_free[PERF_UNITS];
+  uint64_t rob[PERF_ROB_ENTRIES]; // Completion time of each slot's instruction
+  int mode;
+
+  // Precision of the elements which mvins and mvouts move
+  int load_bits, store_bits;
+
+  // Operands latched by the most recent preload
+  uint32_t preload_addr, out_addr;
+  size_t preload_rows, out_rows;
+
+  // Reorder buffer slot and issue time of the most recent loop instruction
+  size_t loop_slot;
+  uint64_t loop_issue;
+
+  // Completion times of the last write to, and last read from, each row
+  uint64_t sp_written[PERF_SP_ROWS], sp_read[PERF_SP_ROWS];
+  uint64_t acc_written[ACC_ROWS], acc_read[ACC_ROWS];
+
+  struct gemmini_perf_counters_t total, layer;
+  const char * layer_name;
+  uint64_t layer_start;
+  bool registered;
+};
+
+static struct gemmini_perf_state_t gemmini_perf_state = {
+  .preload_addr = GARBAGE_ADDR,
+  .out_addr = GARBAGE_ADDR,
+  .load_bits = sizeof(elem_t) * 8,
+  .store_bits = sizeof(elem_t) * 8,
+};
+
+static uint64_t gemmini_perf_max(uint64_t a, uint64_t b) {
+  return a > b ? a : b;
+}
+
+// Returns the earliest cycle at which rows [addr, addr+rows) can be read
+// (is_write == false) or overwritten (is_write == true)
+static uint64_t gemmini_perf_hazard(uint32_t addr, size_t rows, bool is_write) {
+  struct gemmini_perf_state_t * s = &gemmini_perf_state;
+  if (addr == GARBAGE_ADDR)
+    return 0;
+
+  const bool acc = (addr >> (ADDR_LEN-1)) & 1;
+  const size_t base = addr & ((1 << (ADDR_LEN-2)) - 1);
+  const size_t limit = acc ? ACC_ROWS : PERF_SP_ROWS;
+  const uint64_t * written = acc ? s->acc_written : s->sp_written;
+  const uint64_t * read = acc ? s->acc_read : s->sp_read;
+
+  uint64_t t = 0;
+  for (size_t r = base; r < base + rows && r < limit; r++) {
+    t = gemmini_perf_max(t, written[r]);
+    if (is_write)
+      t = gemmini_perf_max(t, read[r]);
+  }
+  return t;
+}
+
+static void gemmini_perf_touch(uint32_t addr, size_t rows, bool is_write, uint64_t t) {
+  struct gemmini_perf_state_t * s = &gemmini_perf_state;
+  if (addr == GARBAGE_ADDR)
+    return;
+
+  const bool acc = (addr >> (ADDR_LEN-1)) & 1;
+  const size_t base = addr & ((1 << (ADDR_LEN-2)) - 1);
+  const size_t limit = acc ? ACC_ROWS : PERF_SP_ROWS;
+  uint64_t * times = acc ? (is_write ? s->acc_written : s->acc_read) :
+    (is_write ? s->sp_written : s->sp_read);
+
+  for (size_t r = base; r < base + rows && r < limit; r++)
+    times[r] = gemmini_perf_max(times[r], t);
+}
+
+// Number of rows of the scratchpad or accumulator covered by a mvin/mvout
+static size_t gemmini_perf_rows(size_t cols, size_t rows) {
+  const size_t blocks = cols / DIM + (cols % DIM != 0);
+  return blocks == 0 ? 0 : (blocks - 1) * DIM + rows;
+}
+
+// Cycles the DMA is busy moving "rows" rows of "row_bytes" bytes each. Every
+// row is split into requests of at most MAX_BYTES.
+static uint64_t gemmini_perf_dma_cycles(size_t rows, size_t row_bytes) {
+  const size_t requests = row_bytes / MAX_BYTES + (row_bytes % MAX_BYTES != 0);
+  const size_t beats = row_bytes / PERF_BUS_BYTES + (row_bytes % PERF_BUS_BYTES != 0);
+  return rows * (beats > requests ? beats : requests);
+}
+
+// Schedules an instruction which entered the reorder buffer at cycle
+// "issue", and returns the cycle at which it completes
+static uint64_t gemmini_perf_schedule(uint64_t issue, uint64_t rs1, uint64_t rs2, int funct) {
+  struct gemmini_perf_state_t * s = &gemmini_perf_state;
+
+  enum perf_unit_t unit = PERF_EXECUTE;
+  uint64_t deps = 0;
+  uint64_t busy = 1;
+  uint64_t latency = 0;
+
+  // Rows read and written by this instruction
+  uint32_t rd_addr[3] = {GARBAGE_ADDR, GARBAGE_ADDR, GARBAGE_ADDR};
+  size_t rd_rows[3] = {0, 0, 0};
+  uint32_t wr_addr = GARBAGE_ADDR;
+  size_t wr_rows = 0;
+
+  if (funct == k_CONFIG) {
+    const int type = rs1 & 3;
+    unit = type == CONFIG_LD ? PERF_LOAD : (type == CONFIG_ST ? PERF_STORE : PERF_EXECUTE);
+    if (type == CONFIG_EX)
+      s->mode = (rs1 >> 2) & 1;
+    else if (type == CONFIG_LD)
+      s->load_bits = 1 << ((rs1 >> 2) & 7);
+    else if (type == CONFIG_ST)
+      s->store_bits = 1 << ((rs1 >> 2) & 7);
+    s->layer.configs++;
+  } else if (funct == k_MVIN || funct == k_MVOUT) {
+    const uint32_t sp_addr = (uint32_t)rs2;
+    const size_t cols = (rs2 >> ADDR_LEN) & 0xFFFF;
+    const size_t rows = (rs2 >> (ADDR_LEN + 16)) & 0xFFFF;
+    const bool acc = (sp_addr >> (ADDR_LEN-1)) & 1;
+    const int bits = funct == k_MVIN ? s->load_bits : s->store_bits;
+    const size_t row_bytes = acc && funct == k_MVIN ? cols * sizeof(acc_t) :
+      (cols * bits + 7) / 8;
+    const size_t bytes = rows * row_bytes;
+
+    busy = gemmini_perf_dma_cycles(rows, row_bytes);
+    latency = PERF_DMA_LATENCY;
+
+    if (funct == k_MVIN) {
+      unit = PERF_LOAD;
+      wr_addr = sp_addr;
+      wr_rows = gemmini_perf_rows(cols, rows);
+      s->layer.mvins++;
+      s->layer.bytes_in += bytes;
+    } else {
+      unit = PERF_STORE;
+      rd_addr[0] = sp_addr;
+      rd_rows[0] = gemmini_perf_rows(cols, rows);
+      s->layer.mvouts++;
+      s->layer.bytes_out += bytes;
+    }
+  } else if (funct == k_PRELOAD) {
+    s->preload_addr = (uint32_t)rs1;
+    s->preload_rows = (rs1 >> (ADDR_LEN + 16)) & 0xFFFF;
+    s->out_addr = (uint32_t)rs2;
+    s->out_rows = (rs2 >> (ADDR_LEN + 16)) & 0xFFFF;
+    s->layer.preloads++;
+  } else if (funct == k_COMPUTE_PRELOADED || funct == k_COMPUTE_ACCUMULATE) {
+    rd_addr[0] = (uint32_t)rs1;
+    rd_rows[0] = (rs1 >> (ADDR_LEN + 16)) & 0xFFFF;
+    rd_addr[1] = (uint32_t)rs2;
+    rd_rows[1] = (rs2 >> (ADDR_LEN + 16)) & 0xFFFF;
+    if (funct == k_COMPUTE_PRELOADED) {
+      rd_addr[2] = s->preload_addr;
+      rd_rows[2] = s->preload_rows;
+    }
+    wr_addr = s->out_addr;
+    wr_rows = s->out_rows;
+
+    // Rows stream through the array one per cycle. In OS mode, results must
+    // also be shifted back out of the array before they can be written.
+    busy = DIM;
+    if (s->mode == OUTPUT_STATIONARY && s->out_addr != GARBAGE_ADDR)
+      busy += DIM;
+    latency = PERF_FILL_LATENCY;
+    s->layer.computes++;
+  } else {
+    // Flushes just occupy a reorder buffer slot
+    return issue;
+  }
+
+  for (int i = 0; i < 3; i++)
+    deps = gemmini_perf_max(deps, gemmini_perf_hazard(rd_addr[i], rd_rows[i], false));
+  deps = gemmini_perf_max(deps, gemmini_perf_hazard(wr_addr, wr_rows, true));
+
+  const uint64_t start = gemmini_perf_max(gemmini_perf_max(issue, s->unit_free[unit]), deps);
+  const uint64_t done = start + busy + latency;
+  s->unit_free[unit] = start + busy;
+  s->layer.busy[unit] += busy;
+
+  for (int i = 0; i < 3; i++)
+    gemmini_perf_touch(rd_addr[i], rd_rows[i], false, start + busy);
+  gemmini_perf_touch(wr_addr, wr_rows, true, done);
+
+  return done;
+}
+
+static void gemmini_perf_exec(uint64_t rs1, uint64_t rs2, int funct) {
+  struct gemmini_perf_state_t * s = &gemmini_perf_state;
+
+  // Wait for a free slot in the reorder buffer, then issue. Slots are freed
+  // as soon as their instruction completes, in any order.
+  size_t slot = 0;
+  for (size_t i = 1; i < PERF_ROB_ENTRIES; i++)
+    if (s->rob[i] < s->rob[slot])
+      slot = i;
+
+  const uint64_t issue = gemmini_perf_max(s->cpu_time, s->rob[slot]);
+  s->cpu_time = issue + PERF_ISSUE_CYCLES;
+
+  if (funct == k_LOOP_WS) {
+    // The loop itself does nothing. It holds its slot until the last of the
+    // instructions it unrolls into, which gemmini_perf_exec_unrolled times,
+    // has completed.
+    s->loop_slot = slot;
+    s->loop_issue = issue;
+    s->rob[slot] = issue;
+    s->layer.loops++;
+    return;
+  }
+
+  s->rob[slot] = gemmini_perf_schedule(issue, rs1, rs2, funct);
+}
+
+// Times an instruction which the hardware generated by unrolling the most
+// recent loop, rather than one which the CPU had to issue
+static void gemmini_perf_exec_unrolled(uint64_t rs1, uint64_t rs2, int funct) {
+  struct gemmini_perf_state_t * s = &gemmini_perf_state;
+
+  const uint64_t done = gemmini_perf_schedule(s->loop_issue, rs1, rs2, funct);
+  s->rob[s->loop_slot] = gemmini_perf_max(s->rob[s->loop_slot], done);
+}
+
+// Stalls the CPU until every outstanding instruction has completed
+static void gemmini_perf_fence() {
+  struct gemmini_perf_state_t * s = &gemmini_perf_state;
+  for (size_t i = 0; i < PERF_ROB_ENTRIES; i++)
+    s->cpu_time = gemmini_perf_max(s->cpu_time, s->rob[i]);
+}
+
+static void gemmini_perf_print(const char * name, const struct gemmini_perf_counters_t * c) {
+  printf("%s: %llu cycles, %llu mvins (%llu bytes), %llu mvouts (%llu bytes), %llu preloads, %llu computes, %llu loops, load/execute/store busy %llu/%llu/%llu\n",
+      name, (unsigned long long)c->cycles,
+      (unsigned long long)c->mvins, (unsigned long long)c->bytes_in,
+      (unsigned long long)c->mvouts, (unsigned long long)c->bytes_out,
+      (unsigned long long)c->preloads, (unsigned long long)c->computes,
+      (unsigned long long)c->loops,
+      (unsigned long long)c->busy[PERF_LOAD], (unsigned long long)c->busy[PERF_EXECUTE],
+      (unsigned long long)c->busy[PERF_STORE]);
+}
+
+static void gemmini_perf_report() {
+  gemmini_perf_print("perf total", &gemmini_perf_state.total);
+}
+
+// Starts timing a new layer. Layers should not be nested.
+static void gemmini_perf_begin(const char * name) {
+  struct gemmini_perf_state_t * s = &gemmini_perf_state;
+
+  if (!s->registered) {
+    atexit(gemmini_perf_report);
+    s->registered = true;
+  }
+
+  memset(&s->layer, 0, sizeof(s->layer));
+  s->layer_name = name;
+  s->layer_start = s->cpu_time;
+}
+
+// Prints the estimated number of cycles since the matching
+// gemmini_perf_begin(), including the time to drain every unit
+static void gemmini_perf_end() {
+  struct gemmini_perf_state_t * s = &gemmini_perf_state;
+
+  gemmini_perf_fence();
+  s->layer.cycles = s->cpu_time - s->layer_start;
+  gemmini_perf_print(s->layer_name, &s->layer);
+
+  s->total.cycles += s->layer.cycles;
+  s->total.mvins += s->layer.mvins;
+  s->total.mvouts += s->layer.mvouts;
+  s->total.preloads += s->layer.preloads;
+  s->total.computes += s->layer.computes;
+  s->total.configs += s->layer.configs;
+  s->total.loops += s->layer.loops;
+  s->total.bytes_in += s->layer.bytes_in;
+  s->total.bytes_out += s->layer.bytes_out;
+  for (int u = 0; u < PERF_UNITS; u++)
+    s->total.busy[u] += s->layer.busy[u];
+}
+
+#endif // SRC_MAIN_C_GEMMINI_PERF_H
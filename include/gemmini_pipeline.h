@@ -0,0 +1,164 @@
+// See LICENSE for license details.
+
+#ifndef GEMMINI_PIPELINE_H
+#define GEMMINI_PIPELINE_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+// Layer pipelining across harts
+//
+// A network can be split into stages (e.g. im2col, matmul, pooling) which
+// stream a sequence of items (e.g. images) through them. Stage s runs on hart
+// s % nc, so with two harts, hart 0 can run the CPU-only stages of image n+1
+// while hart 1 drives Gemmini for image n.
+//
+// Consecutive stages are connected by lock-free single-producer,
+// single-consumer rings of item indices. A stage only pops an item after it
+// has finished with it, so a ring of capacity "depth" also guarantees that
+// item n's buffers aren't overwritten until item n-depth has left the next
+// stage. Each stage should therefore keep "depth" copies of its output
+// buffers, use copy n % depth for item n, and only read the buffers of the
+// stage right before it.
+
+#ifndef PIPELINE_MAX_STAGES
+#define PIPELINE_MAX_STAGES 8
+#endif
+
+#ifndef PIPELINE_MAX_DEPTH
+#define PIPELINE_MAX_DEPTH 4
+#endif
+
+struct spsc_ring_t {
+  size_t items[PIPELINE_MAX_DEPTH];
+  size_t capacity;
+
+  // head is only written by the producer, and tail only by the consumer
+  volatile size_t head, tail;
+};
+
+static void spsc_ring_init(struct spsc_ring_t * ring, size_t capacity) {
+  if (capacity == 0 || capacity > PIPELINE_MAX_DEPTH) {
+    printf("Pipeline depth must be between 1 and %d\n", PIPELINE_MAX_DEPTH);
+    exit(1);
+  }
+
+  ring->capacity = capacity;
+  ring->head = 0;
+  ring->tail = 0;
+}
+
+static bool spsc_ring_full(const struct spsc_ring_t * ring) {
+  return ring->head - ring->tail == ring->capacity;
+}
+
+// Returns false, without waiting, if the ring is full
+static bool spsc_ring_push(struct spsc_ring_t * ring, size_t item) {
+  if (spsc_ring_full(ring))
+    return false;
+
+  ring->items[ring->head % ring->capacity] = item;
+
+  // The item, and everything the producer wrote for it, must be visible
+  // before the consumer sees the new head
+  __sync_synchronize();
+  ring->head++;
+
+  return true;
+}
+
+// Returns false, without waiting, if the ring is empty. Otherwise, the item
+// stays in the ring until spsc_ring_pop is called.
+static bool spsc_ring_peek(const struct spsc_ring_t * ring, size_t * item) {
+  if (ring->head == ring->tail)
+    return false;
+
+  __sync_synchronize();
+  *item = ring->items[ring->tail % ring->capacity];
+
+  return true;
+}
+
+static void spsc_ring_pop(struct spsc_ring_t * ring) {
+  // Everything the consumer did with the item must be finished before the
+  // producer is allowed to reuse its slot
+  __sync_synchronize();
+  ring->tail++;
+}
+
+struct pipeline_stage_t {
+  void (*run)(size_t item, void * arg);
+  void * arg;
+};
+
+struct pipeline_t {
+  struct pipeline_stage_t stages[PIPELINE_MAX_STAGES];
+  size_t n_stages;
+  size_t n_items;
+
+  // rings[s] connects stage s to stage s+1
+  struct spsc_ring_t rings[PIPELINE_MAX_STAGES - 1];
+};
+
+static void pipeline_init(struct pipeline_t * pipeline, size_t n_items, size_t depth) {
+  pipeline->n_stages = 0;
+  pipeline->n_items = n_items;
+
+  for (size_t s = 0; s < PIPELINE_MAX_STAGES - 1; s++)
+    spsc_ring_init(&pipeline->rings[s], depth);
+}
+
+static void pipeline_add_stage(struct pipeline_t * pipeline,
+    void (*run)(size_t item, void * arg), void * arg) {
+  if (pipeline->n_stages == PIPELINE_MAX_STAGES) {
+    printf("Pipelines can't have more than %d stages\n", PIPELINE_MAX_STAGES);
+    exit(1);
+  }
+
+  pipeline->stages[pipeline->n_stages].run = run;
+  pipeline->stages[pipeline->n_stages].arg = arg;
+  pipeline->n_stages++;
+}
+
+// Runs this hart's stages until every item has gone through them. Every hart
+// must call this with the same pipeline, its hart ID "cid", and the number of
+// harts "nc". A hart with several stages round-robins between whichever of
+// them have both an input and space for their output, so this never
+// deadlocks, and with nc == 1 it runs the whole pipeline on its own.
+static void pipeline_run(struct pipeline_t * pipeline, size_t cid, size_t nc) {
+  size_t done[PIPELINE_MAX_STAGES] = {0};
+  size_t remaining = 0;
+
+  for (size_t s = cid; s < pipeline->n_stages; s += nc)
+    remaining += pipeline->n_items;
+
+  while (remaining > 0) {
+    for (size_t s = cid; s < pipeline->n_stages; s += nc) {
+      if (done[s] == pipeline->n_items)
+        continue;
+
+      struct spsc_ring_t * in = s == 0 ? NULL : &pipeline->rings[s-1];
+      struct spsc_ring_t * out = s == pipeline->n_stages-1 ? NULL : &pipeline->rings[s];
+
+      size_t item = done[s];
+      if (in != NULL && !spsc_ring_peek(in, &item))
+        continue;
+      if (out != NULL && spsc_ring_full(out))
+        continue;
+
+      pipeline->stages[s].run(item, pipeline->stages[s].arg);
+
+      if (in != NULL)
+        spsc_ring_pop(in);
+      if (out != NULL)
+        spsc_ring_push(out, item);
+
+      done[s]++;
+      remaining--;
+    }
+  }
+}
+
+#endif // GEMMINI_PIPELINE_H
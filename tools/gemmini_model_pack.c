@@ -0,0 +1,427 @@
+// See LICENSE for license details.
+
+// Converts generated parameter headers, and image headers like
+// imagenet/images.h, into a model file for include/gemmini_model.h. This runs
+// on the host, not on Gemmini, but must see the same gemmini_params.h as the
+// programs which load the model:
+//
+//   cc -O2 -DGEMMINI_HOST_EMU -I. -o gemmini_model_pack tools/gemmini_model_pack.c -lm
+//   ./gemmini_model_pack resnet50.model imagenet/resnet50_params.h imagenet/images.h
+//
+// Every elem_t or acc_t array which has an initializer becomes a tensor with
+// the array's name and dimensions, and every ConvParams or FcParams struct a
+// parameter entry with the struct's name. Other declarations, comments and
+// preprocessor lines are skipped. Array dimensions must be plain numbers, and
+// initializers plain (possibly negative) numbers, true or false, although
+// nested braces may be left out or cut short as in C.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "include/gemmini.h"
+#include "include/gemmini_model.h"
+
+struct entry_t {
+  char name[MODEL_NAME_LEN];
+  enum model_entry_type_t type;
+  size_t n_dims;
+  size_t dims[MODEL_MAX_DIMS];
+  void * data;
+  size_t bytes;
+};
+
+static struct entry_t * entries;
+static size_t n_entries, entries_capacity;
+
+// The header being parsed, and the token at "pos"
+static const char * path;
+static char * src;
+static size_t pos, line;
+static const char * tok;
+static size_t tok_len;
+
+static const char * conv_fields[] = {
+#define FIELD_NAME(field) #field,
+  MODEL_CONV_PARAMS_FIELDS(FIELD_NAME)
+};
+
+static const char * fc_fields[] = {
+  MODEL_FC_PARAMS_FIELDS(FIELD_NAME)
+#undef FIELD_NAME
+};
+
+static void fail(const char * msg) {
+  fprintf(stderr, "%s:%zu: %s, at \"%.*s\"\n", path, line, msg, (int)tok_len, tok);
+  exit(1);
+}
+
+// Moves to the next token, skipping whitespace, comments and preprocessor
+// lines. tok_len is 0 at the end of the header.
+static void next() {
+  pos += tok_len;
+
+  for (;;) {
+    if (src[pos] == '\n') {
+      line++;
+      pos++;
+    } else if (isspace((unsigned char)src[pos])) {
+      pos++;
+    } else if (src[pos] == '#' || (src[pos] == '/' && src[pos + 1] == '/')) {
+      while (src[pos] != '\0' && src[pos] != '\n')
+        pos++;
+    } else if (src[pos] == '/' && src[pos + 1] == '*') {
+      for (pos += 2; src[pos] != '\0' && !(src[pos] == '*' && src[pos + 1] == '/'); pos++)
+        if (src[pos] == '\n')
+          line++;
+      if (src[pos] != '\0')
+        pos += 2;
+    } else {
+      break;
+    }
+  }
+
+  tok = src + pos;
+  tok_len = 0;
+
+  if (isalnum((unsigned char)tok[0]) || tok[0] == '_') {
+    while (isalnum((unsigned char)tok[tok_len]) || tok[tok_len] == '_')
+      tok_len++;
+  } else if (tok[0] == '"' || tok[0] == '\'') {
+    for (tok_len = 1; tok[tok_len] != '\0' && tok[tok_len] != tok[0]; tok_len++)
+      if (tok[tok_len] == '\\' && tok[tok_len + 1] != '\0')
+        tok_len++;
+    if (tok[tok_len] != '\0')
+      tok_len++;
+  } else if (tok[0] != '\0') {
+    tok_len = 1;
+  }
+}
+
+static bool is(const char * s) {
+  return tok_len == strlen(s) && strncmp(tok, s, tok_len) == 0;
+}
+
+static void expect(const char * s) {
+  if (!is(s)) {
+    char msg[32];
+    snprintf(msg, sizeof(msg), "expected \"%s\"", s);
+    fail(msg);
+  }
+
+  next();
+}
+
+static bool is_ident() {
+  return tok_len > 0 && (isalpha((unsigned char)tok[0]) || tok[0] == '_');
+}
+
+static int64_t number() {
+  bool negative = false;
+
+  while (is("-") || is("+")) {
+    negative ^= is("-");
+    next();
+  }
+
+  int64_t x;
+  if (is("true")) {
+    x = 1;
+  } else if (is("false")) {
+    x = 0;
+  } else if (tok_len > 0 && isdigit((unsigned char)tok[0])) {
+    x = strtoll(tok, NULL, 0);
+  } else {
+    fail("expected a number");
+  }
+
+  next();
+  return negative ? -x : x;
+}
+
+// Skips the rest of a declaration or function which isn't converted
+static void skip() {
+  int depth = 0;
+
+  while (tok_len > 0) {
+    if (is("{") || is("(") || is("[")) {
+      depth++;
+    } else if (is("}") || is(")") || is("]")) {
+      if (--depth == 0 && is("}")) {
+        next();
+        if (is(";"))
+          next();
+        return;
+      }
+    } else if (is(";") && depth == 0) {
+      next();
+      return;
+    }
+
+    next();
+  }
+}
+
+static struct entry_t * add_entry(const char * name, size_t name_len) {
+  if (name_len >= MODEL_NAME_LEN)
+    fail("name is too long");
+
+  if (n_entries == entries_capacity) {
+    entries_capacity = entries_capacity ? 2 * entries_capacity : 64;
+    entries = realloc(entries, entries_capacity * sizeof(*entries));
+    if (entries == NULL) {
+      perror("realloc failed");
+      exit(1);
+    }
+  }
+
+  struct entry_t * e = &entries[n_entries++];
+  memset(e, 0, sizeof(*e));
+  memcpy(e->name, name, name_len);
+  return e;
+}
+
+// Parses the braces of an array initializer, whose first element is at
+// "base", and whose elements are "stride" elements apart at this depth.
+// Like C, a value without braces around it fills the next element, and
+// elements which aren't given are zero.
+static void parse_array(struct entry_t * e, size_t depth, size_t base) {
+  size_t stride = 1;
+  for (size_t d = depth + 1; d < e->n_dims; d++)
+    stride *= e->dims[d];
+
+  const size_t end = base + stride * e->dims[depth];
+  size_t cursor = base;
+
+  expect("{");
+
+  while (!is("}")) {
+    if (is("{") && depth + 1 < e->n_dims) {
+      cursor = base + (cursor - base + stride - 1) / stride * stride;
+      if (cursor >= end)
+        fail("too many elements");
+
+      parse_array(e, depth + 1, cursor);
+      cursor += stride;
+    } else {
+      if (cursor >= end)
+        fail("too many elements");
+
+      const int64_t x = number();
+
+      if (e->type == MODEL_ELEM) {
+        if ((elem_t)x != x)
+          fail("element out of range");
+        ((elem_t *)e->data)[cursor++] = x;
+      } else {
+        if ((acc_t)x != x)
+          fail("element out of range");
+        ((acc_t *)e->data)[cursor++] = x;
+      }
+    }
+
+    if (!is(","))
+      break;
+    next();
+  }
+
+  expect("}");
+}
+
+static void parse_params(struct entry_t * e, const char ** fields, size_t n_fields) {
+  int32_t * values = (int32_t *)e->data;
+  size_t f = 0;
+
+  expect("{");
+
+  while (!is("}")) {
+    if (is(".")) {
+      next();
+      for (f = 0; f < n_fields && !is(fields[f]); f++)
+        ;
+      if (f == n_fields)
+        fail("unknown field");
+      next();
+      expect("=");
+    }
+
+    if (f >= n_fields)
+      fail("too many fields");
+    values[f++] = number();
+
+    if (!is(","))
+      break;
+    next();
+  }
+
+  expect("}");
+}
+
+// Parses one top-level declaration, adding an entry if it's an array or
+// struct which is converted
+static void parse_declaration() {
+  enum model_entry_type_t type;
+  size_t elem_size;
+  bool params = false;
+
+  while (is("static") || is("const"))
+    next();
+
+  if (is("elem_t")) {
+    type = MODEL_ELEM;
+    elem_size = sizeof(elem_t);
+  } else if (is("acc_t")) {
+    type = MODEL_ACC;
+    elem_size = sizeof(acc_t);
+  } else if (is("struct")) {
+    next();
+    if (is("ConvParams"))
+      type = MODEL_CONV_PARAMS;
+    else if (is("FcParams"))
+      type = MODEL_FC_PARAMS;
+    else
+      return skip();
+    elem_size = sizeof(int32_t);
+    params = true;
+  } else {
+    return skip();
+  }
+
+  next();
+  while (is("const"))
+    next();
+
+  if (!is_ident())
+    return skip();
+
+  const char * name = tok;
+  const size_t name_len = tok_len;
+  size_t dims[MODEL_MAX_DIMS], n_dims = 0;
+  next();
+
+  while (is("[")) {
+    next();
+    if (n_dims == MODEL_MAX_DIMS)
+      fail("too many dimensions");
+    if (tok_len == 0 || !isdigit((unsigned char)tok[0]))
+      fail("array dimensions must be numbers");
+    dims[n_dims++] = strtoull(tok, NULL, 0);
+    next();
+    expect("]");
+  }
+
+  // Attributes, like row_align(1)
+  int depth = 0;
+  while (tok_len > 0 && (depth > 0 || (!is("=") && !is(";") && !is(",")))) {
+    if (is("("))
+      depth++;
+    else if (is(")"))
+      depth--;
+    next();
+  }
+
+  if (!is("=") || params != (n_dims == 0))
+    return skip();
+  next();
+
+  struct entry_t * e = add_entry(name, name_len);
+  e->type = type;
+
+  if (params) {
+    const size_t n_fields = type == MODEL_CONV_PARAMS ? MODEL_CONV_PARAMS_N_FIELDS : MODEL_FC_PARAMS_N_FIELDS;
+    e->n_dims = 1;
+    e->dims[0] = n_fields;
+  } else {
+    e->n_dims = n_dims;
+    memcpy(e->dims, dims, sizeof(dims));
+  }
+
+  size_t count = 1;
+  for (size_t d = 0; d < e->n_dims; d++)
+    count *= e->dims[d];
+
+  e->bytes = count * elem_size;
+  e->data = calloc(count ? count : 1, elem_size);
+  if (e->data == NULL) {
+    perror("calloc failed");
+    exit(1);
+  }
+
+  if (type == MODEL_CONV_PARAMS)
+    parse_params(e, conv_fields, MODEL_CONV_PARAMS_N_FIELDS);
+  else if (type == MODEL_FC_PARAMS)
+    parse_params(e, fc_fields, MODEL_FC_PARAMS_N_FIELDS);
+  else
+    parse_array(e, 0, 0);
+
+  expect(";");
+}
+
+static void parse_header(const char * p) {
+  FILE * f = fopen(p, "rb");
+  if (f == NULL) {
+    perror(p);
+    exit(1);
+  }
+
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  src = malloc(size + 2);
+  if (src == NULL || fread(src, 1, size, f) != (size_t)size) {
+    perror(p);
+    exit(1);
+  }
+  src[size] = src[size + 1] = '\0';
+  fclose(f);
+
+  path = p;
+  pos = 0;
+  line = 1;
+  tok_len = 0;
+  next();
+
+  while (tok_len > 0)
+    parse_declaration();
+
+  free(src);
+}
+
+int main(int argc, char * argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s model header.h [header.h ...]\n", argv[0]);
+    return 1;
+  }
+
+  for (int i = 2; i < argc; i++)
+    parse_header(argv[i]);
+
+  size_t capacity = model_table_bytes(n_entries);
+  for (size_t i = 0; i < n_entries; i++)
+    capacity += model_align(entries[i].bytes);
+
+  void * data = aligned_alloc(MODEL_ALIGN, capacity);
+  if (data == NULL) {
+    perror("aligned_alloc failed");
+    exit(1);
+  }
+
+  struct model_writer_t w;
+  model_writer_init(&w, data, capacity, n_entries);
+
+  for (size_t i = 0; i < n_entries; i++) {
+    const struct entry_t * e = &entries[i];
+    model_write_entry(&w, e->name, e->type, e->type == MODEL_ELEM ? ELEM_T_BITS : 32,
+        e->n_dims, e->dims, e->data);
+  }
+
+  const size_t size = model_writer_finish(&w);
+  model_save(argv[1], data, size);
+
+  fprintf(stderr, "Wrote %zu entries, %zu bytes, to %s\n", n_entries, size, argv[1]);
+  return 0;
+}
@@ -0,0 +1,317 @@
+// See LICENSE for license details.
+
+// Summarizes the "gemmini_trace" lines which gemmini_trace_dump() prints when
+// a program is compiled with GEMMINI_TRACE (see include/gemmini.h). This runs
+// on the host, not on Gemmini:
+//
+//   cc -O2 -o gemmini_trace_summary tools/gemmini_trace_summary.c
+//   ./program | ./gemmini_trace_summary
+//
+// For each matrix which a tiled matmul named, it reports how many bytes were
+// moved in, how many of them were tiles which had already been moved in
+// before, and the reuse distance of those reloads: the number of distinct
+// bytes moved into the same memory (scratchpad or accumulator) since the
+// tile was last moved in. A reload whose reuse distance, plus the tile
+// itself, fits in that memory could have been avoided by keeping the tile
+// resident.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_MATRICES 4096
+#define N_BUCKETS 5
+
+struct tile_t {
+  uint64_t dram;
+  size_t rows, cols, bytes;
+  bool acc;
+  char matrix;
+  size_t stack_pos;
+  bool used;
+};
+
+struct matrix_t {
+  char name;
+  uint64_t addr, bytes;
+};
+
+struct stats_t {
+  uint64_t mvins, bytes, unique_bytes;
+  uint64_t reloads, reload_bytes;
+  uint64_t avoidable, avoidable_bytes;
+  uint64_t buckets[N_BUCKETS];
+};
+
+// Distinct tiles ordered from least to most recently moved in, with one
+// stack for the scratchpad and one for the accumulator
+struct stack_t {
+  size_t * tiles;
+  size_t len, capacity;
+  uint64_t capacity_bytes;
+};
+
+static struct tile_t * tiles;
+static size_t n_tiles, tiles_capacity;
+static size_t * table; // Open-addressing hash table of tile indices + 1
+static size_t table_size;
+
+static struct matrix_t matrices[MAX_MATRICES];
+static size_t n_matrices;
+
+static struct stats_t stats[256];
+static uint64_t op_counts[16];
+static const char * op_names[16];
+static size_t n_ops;
+
+static void * checked_realloc(void * p, size_t bytes) {
+  p = realloc(p, bytes);
+  if (p == NULL) {
+    printf("Out of memory\n");
+    exit(1);
+  }
+  return p;
+}
+
+static size_t hash(uint64_t dram, size_t rows, size_t cols, bool acc) {
+  uint64_t h = dram * 0x9E3779B97F4A7C15ULL ^ ((uint64_t)acc << 32) ^ (rows << 16) ^ cols;
+  return (size_t)(h ^ (h >> 29));
+}
+
+static void grow_table() {
+  const size_t old_size = table_size;
+  size_t * old = table;
+
+  table_size = table_size == 0 ? 1024 : table_size * 2;
+  table = checked_realloc(NULL, table_size * sizeof(size_t));
+  memset(table, 0, table_size * sizeof(size_t));
+
+  for (size_t i = 0; i < old_size; i++) {
+    if (old[i] == 0)
+      continue;
+
+    const struct tile_t * t = &tiles[old[i] - 1];
+    size_t slot = hash(t->dram, t->rows, t->cols, t->acc) % table_size;
+    while (table[slot] != 0)
+      slot = (slot + 1) % table_size;
+    table[slot] = old[i];
+  }
+
+  free(old);
+}
+
+static size_t find_tile(uint64_t dram, size_t rows, size_t cols, bool acc) {
+  if (2 * (n_tiles + 1) > table_size)
+    grow_table();
+
+  size_t slot = hash(dram, rows, cols, acc) % table_size;
+  for (; table[slot] != 0; slot = (slot + 1) % table_size) {
+    const struct tile_t * t = &tiles[table[slot] - 1];
+    if (t->dram == dram && t->rows == rows && t->cols == cols && t->acc == acc)
+      return table[slot] - 1;
+  }
+
+  if (n_tiles == tiles_capacity) {
+    tiles_capacity = tiles_capacity == 0 ? 1024 : tiles_capacity * 2;
+    tiles = checked_realloc(tiles, tiles_capacity * sizeof(struct tile_t));
+  }
+
+  struct tile_t * t = &tiles[n_tiles];
+  memset(t, 0, sizeof(*t));
+  t->dram = dram;
+  t->rows = rows;
+  t->cols = cols;
+  t->acc = acc;
+
+  table[slot] = n_tiles + 1;
+  return n_tiles++;
+}
+
+// The most recently named matrix which contains "addr", or '?'
+static char matrix_of(uint64_t addr) {
+  for (size_t m = n_matrices; m > 0; m--)
+    if (addr >= matrices[m-1].addr && addr < matrices[m-1].addr + matrices[m-1].bytes)
+      return matrices[m-1].name;
+  return '?';
+}
+
+static void count_op(const char * name) {
+  for (size_t i = 0; i < n_ops; i++) {
+    if (strcmp(op_names[i], name) == 0) {
+      op_counts[i]++;
+      return;
+    }
+  }
+
+  if (n_ops < 16) {
+    op_names[n_ops] = strdup(name);
+    op_counts[n_ops++] = 1;
+  }
+}
+
+// Returns the number of bytes in the tiles which were moved in after tile
+// "t", then makes t the most recent one
+static uint64_t touch(struct stack_t * s, size_t t) {
+  uint64_t distance = 0;
+
+  if (tiles[t].used) {
+    const size_t pos = tiles[t].stack_pos;
+    for (size_t i = pos + 1; i < s->len; i++) {
+      distance += tiles[s->tiles[i]].bytes;
+      tiles[s->tiles[i]].stack_pos--;
+    }
+    memmove(&s->tiles[pos], &s->tiles[pos + 1], (s->len - pos - 1) * sizeof(size_t));
+    s->len--;
+  }
+
+  if (s->len == s->capacity) {
+    s->capacity = s->capacity == 0 ? 1024 : s->capacity * 2;
+    s->tiles = checked_realloc(s->tiles, s->capacity * sizeof(size_t));
+  }
+
+  tiles[t].stack_pos = s->len;
+  s->tiles[s->len++] = t;
+
+  return distance;
+}
+
+// Finds " key=" in "line", and parses the number after it
+static uint64_t field(const char * line, const char * key) {
+  char pattern[32];
+  snprintf(pattern, sizeof(pattern), " %s=", key);
+
+  const char * p = strstr(line, pattern);
+  if (p == NULL) {
+    printf("Missing %s in: %s", key, line);
+    exit(1);
+  }
+
+  return strtoull(p + strlen(pattern), NULL, 0);
+}
+
+static void print_percent(uint64_t part, uint64_t whole) {
+  const uint64_t p = whole == 0 ? 0 : part * 1000 / whole;
+  printf(" %8llu.%llu%%", (unsigned long long)(p / 10), (unsigned long long)(p % 10));
+}
+
+int main(int argc, char * argv[]) {
+  FILE * f = stdin;
+  if (argc > 1 && (f = fopen(argv[1], "r")) == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  struct stack_t sp = {0}, acc = {0};
+  uint64_t dropped = 0;
+  int addr_len = 32;
+  bool seen_begin = false;
+  char line[512];
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char op[32];
+    if (sscanf(line, "gemmini_trace %31s", op) != 1)
+      continue;
+
+    if (strcmp(op, "begin") == 0) {
+      sp.capacity_bytes = field(line, "sp_bytes");
+      acc.capacity_bytes = field(line, "acc_bytes");
+      dropped = field(line, "dropped");
+      addr_len = field(line, "addr_len");
+      seen_begin = true;
+      continue;
+    } else if (strcmp(op, "end") == 0) {
+      continue;
+    } else if (strcmp(op, "matrix") == 0) {
+      const char * name = strstr(line, " name=");
+      if (name == NULL || n_matrices == MAX_MATRICES) {
+        printf("Can't parse: %s", line);
+        return 1;
+      }
+
+      struct matrix_t * m = &matrices[n_matrices++];
+      m->name = name[strlen(" name=")];
+      m->addr = field(line, "addr");
+      m->bytes = field(line, "bytes");
+      continue;
+    }
+
+    count_op(op);
+
+    if (strcmp(op, "mvin") != 0)
+      continue;
+
+    const uint64_t dram = field(line, "dram");
+    const uint64_t spad = field(line, "spad");
+    const bool is_acc = (spad >> (addr_len - 1)) & 1;
+    const size_t t = find_tile(dram, field(line, "rows"), field(line, "cols"), is_acc);
+    struct stack_t * s = is_acc ? &acc : &sp;
+
+    tiles[t].bytes = field(line, "bytes");
+    tiles[t].matrix = matrix_of(dram);
+
+    struct stats_t * st = &stats[(unsigned char)tiles[t].matrix];
+    const bool reload = tiles[t].used;
+    const uint64_t distance = touch(s, t);
+    tiles[t].used = true;
+
+    st->mvins++;
+    st->bytes += tiles[t].bytes;
+
+    if (!reload) {
+      st->unique_bytes += tiles[t].bytes;
+      continue;
+    }
+
+    st->reloads++;
+    st->reload_bytes += tiles[t].bytes;
+
+    if (distance + tiles[t].bytes <= s->capacity_bytes) {
+      st->avoidable++;
+      st->avoidable_bytes += tiles[t].bytes;
+    }
+
+    // Buckets of a quarter of the memory each, with the last one for
+    // everything beyond it
+    size_t bucket = s->capacity_bytes == 0 ? N_BUCKETS - 1 : distance * 4 / s->capacity_bytes;
+    st->buckets[bucket < N_BUCKETS ? bucket : N_BUCKETS - 1]++;
+  }
+
+  if (!seen_begin) {
+    printf("No gemmini_trace output found\n");
+    return 1;
+  }
+
+  if (dropped > 0)
+    printf("Warning: the oldest %llu instructions were dropped from the trace\n\n",
+        (unsigned long long)dropped);
+
+  printf("Instructions:\n");
+  for (size_t i = 0; i < n_ops; i++)
+    printf("  %-20s %llu\n", op_names[i], (unsigned long long)op_counts[i]);
+
+  printf("\nMoved in (reuse distance is relative to the scratchpad, or the accumulator for mvins into it):\n");
+  printf("  matrix %10s %12s %12s %10s %10s %12s %10s | reloads by reuse distance: <1/4 <1/2 <3/4 <1 >=1\n",
+      "mvins", "bytes", "reloaded", "", "reloads", "avoidable", "");
+
+  for (int m = 0; m < 256; m++) {
+    const struct stats_t * st = &stats[m];
+    if (st->mvins == 0)
+      continue;
+
+    printf("  %-6c %10llu %12llu %12llu", m,
+        (unsigned long long)st->mvins, (unsigned long long)st->bytes,
+        (unsigned long long)st->reload_bytes);
+    print_percent(st->reload_bytes, st->bytes);
+    printf(" %10llu %12llu", (unsigned long long)st->reloads,
+        (unsigned long long)st->avoidable_bytes);
+    print_percent(st->avoidable_bytes, st->bytes);
+    printf(" |");
+    for (int b = 0; b < N_BUCKETS; b++)
+      printf(" %llu", (unsigned long long)st->buckets[b]);
+    printf("\n");
+  }
+
+  return 0;
+}